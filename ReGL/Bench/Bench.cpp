@@ -0,0 +1,393 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Dependencies/stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+
+#include <glad/glad.h>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "../Shaders/Shader.h"
+#include "../Source/Camera.h"
+#include "../Source/Cube.h"
+#include "../Source/Framebuffer.h"
+#include "../Source/GpuTimer.h"
+#include "../Source/FrameUniforms.h"
+#include "../Source/Headless.h"
+#include "../Source/Profiler.h"
+#include "../Source/StateCache.h"
+#include "../Source/Texture.h"
+#include "Bench.h"
+
+// regl_bench: renders ReGL scenes into an offscreen framebuffer without a window and reports frame times.
+// Run it from the ReGL directory so the Shaders/ and Textures/ paths resolve.
+//
+// Usage: regl_bench [mode] [options]
+//   cube    The textured cube scene from Main.cpp (default).
+//           --frames N     frames to measure (default 1000)
+//           --warmup N     frames rendered before measuring (default 50)
+//           --width W      framebuffer width (default 800)
+//           --height H     framebuffer height (default 600)
+//           --dump FILE    write the last frame as a binary PPM
+//           --trace FILE   write the profiler zones of the measured frames as a Chrome trace
+//           --no-gpu-timers  don't measure GPU time per pass (timestamp queries)
+//   shaders Build time of the Texture program, compiled from source vs. loaded from the program binary cache.
+//           --iterations N builds of each kind (default 50)
+//   instancing  1k/10k/100k cubes, one draw per cube vs. one instanced draw (InstancingBench.cpp).
+//           --frames N     frames per configuration (default 20)
+//           --count N      only run this instance count
+//   textures  Decode + upload of the scene textures: on the GL thread, on loader threads, and streamed through PBOs
+//           (TextureBench.cpp). Also reports the GL thread time spent in pump() per frame while loading, and
+//           cooked .ktx2 loading against decoding + CPU mipmaps when regl_cook has been run.
+//           --copies N     load each texture N times (default 8)
+//           --threads N    loader worker threads (default: one per hardware thread)
+//           --budget-kb N  streaming upload budget per frame in KiB (default 1024)
+//   mipmaps   Mip chains of the scene textures: glGenerateMipmap against the CPU generator, box and Kaiser filters,
+//           on one thread and on a pool (TextureBench.cpp).
+//           --iterations N runs of each (default 20)
+//           --threads N    pool threads (default: one per hardware thread)
+//   residency  Copies of the scene textures under a VRAM budget, used through a sliding window so levels are evicted
+//           and streamed back in (TextureBench.cpp).
+//           --copies N     copies of each texture (default 16)
+//           --frames N     simulated frames (default 600)
+//           --window N     textures used per frame (default 8)
+//           --step-frames N  frames before the window moves by one texture (default 10)
+//           --budget-kb N  VRAM budget in KiB (default: half of all textures)
+//   profiler  Cost of one REGL_PROFILE_ZONE, alone and nested, on one and on several threads. No GL needed.
+//           --zones N      zones per thread (default 10000000)
+//           --threads N    threads recording at once for the contended run (default 4)
+//   software  The cube scene drawn by the tile-binned software rasterizer (SoftwareBench.cpp). No GL needed.
+//           --frames, --warmup, --width, --height, --dump as for cube
+//           --threads N    rasterizer threads (default: one per hardware thread)
+//           --golden FILE  compare the last frame with a PPM, e.g. the --dump of a cube run with the same options
+//           --min-psnr DB  lowest PSNR that passes the comparison (default 30)
+//   meshes    Generated spheres of 65k and 982k vertices stored as 32-bit floats with 32-bit indices, and in the compact
+//           layouts of Source/Mesh.h (half or snorm16 positions, unorm8 colors, unorm16 uvs) (MeshBench.cpp).
+//           --frames N     frames per layout (default 20)
+//           --draws N      draws of the sphere per frame (default 4)
+//   meshopt   Generated tori in grid order, shuffled, and shuffled then optimized by Source/MeshOptimizer.h (vertex cache
+//           pass alone and all passes): ACMR, ATVR, vertex overfetch, overdraw and frame times (MeshBench.cpp).
+//           --frames N     frames per variant, one full turn of the torus (default 24)
+//   meshload  A 640k-triangle torus from file to GPU buffers: OBJ parsed at load time against the memory-mapped .rmesh
+//           the cook step writes (MeshBench.cpp). Writes and deletes meshload_bench.obj/.rmesh in the current directory.
+//           --iterations N loads of each (default 5)
+//   culling   Frustum culling of 100k and 1M boxes by a turning camera: scalar, SIMD boxes and spheres, and SIMD boxes on
+//           worker threads (CullingBench.cpp). Reports visible and culled objects per frame. No GL needed.
+//           --frames N     frames per variant, one full turn (default 60)
+//           --count N      only run this object count
+//           --threads N    worker threads (default: one per hardware thread)
+//   bvh       The culling scenes in a BVH (Source/BVH.h, CullingBench.cpp): build, refit and rebuild after objects moved,
+//           frustum culling against the linear SIMD loop, ray casts and box queries against brute force. No GL needed.
+//           --frames N     culling frames, one full turn (default 60)
+//           --rays N       ray casts, and box queries (default 1000)
+//           --count N      only run this object count
+//   occlusion  100 buildings as occluders and 100k small objects seen from street level: BVH frustum culling, then the
+//           occlusion buffer of Source/OcclusionCulling.h on one thread and on all of them (CullingBench.cpp). Reports
+//           raster and test times and objects occluded per frame. No GL needed.
+//           --frames N     frames, one full turn (default 60)
+//           --count N      objects (default 100000)
+//           --width W      occlusion buffer width (default 256)
+//           --height H     occlusion buffer height (default 128)
+//           --dump FILE    write the last occlusion buffer as a binary PPM
+//   frames    Main.cpp's frame loop with synthetic costs: simulation and render on one thread, then on two threads with
+//           FramePackets handed over by Source/FrameExchange.h (ThreadingBench.cpp). Checks every packet arrives whole
+//           and in order. No GL needed.
+//           --frames N     frames of each (default 300)
+//           --sim-us N     simulation time per frame in microseconds (default 4000)
+//           --render-us N  render time per frame in microseconds (default 6000)
+//           --draws N      draws per packet (default 1000)
+//           --render-busy  the render step keeps its core busy instead of mostly waiting (needs two cores to overlap)
+//   timestep  Main.cpp's fixed simulation steps (Source/FixedTimestep.h) on a virtual clock: steps per second and the
+//           error of interpolated against latest-step positions at 30 to 240 fps, then steps slower than real time
+//           with and without the catch-up cap (TimestepBench.cpp). No GL needed.
+//           --seconds N    virtual seconds per frame rate (default 10)
+//           --sim-hz N     simulation steps per second (default 60)
+//           --max-steps N  catch-up cap (default 5)
+//           --step-cost-us N  real time per step for the cap test, in microseconds (default 20000)
+//   jobs      The work-stealing JobSystem of Source/JobSystem.h with 1, 2, 4 ... 64 threads: cost per empty job, submitted
+//           one by one and split by parallelFor, and the speedup of a parallelFor over small items against TileWorkers
+//           (ThreadingBench.cpp). Then checks dependencies, nested parallelFors and jobs from outside threads. No GL needed.
+//           --jobs N       empty jobs (default 100000)
+//           --items N      items of the parallelFor (default 1048576)
+//           --grain N      items per job (default 1024)
+//           --max-threads N  last thread count (default 64)
+//   commands  50k cubes of 4 materials drawn directly on the GL thread, then recorded into command buffers
+//           (Source/CommandBuffer.h) on one and on all job threads and replayed, in recording order and radix-sorted by
+//           key (CommandBench.cpp). Reports record and replay times and state changes per frame, checks the merged
+//           commands don't depend on the thread count and compares the images.
+//           --frames N     frames per variant (default 10)
+//           --count N      cubes (default 50000)
+//           --width W, --height H  framebuffer size (default 800x600)
+//           --threads N    job threads (default: one per hardware thread)
+
+
+// ------------------------CUBE------------------------
+static int runCubeBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 1000);
+	const int warmup = argInt(argc, argv, "--warmup", 50);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+	const char* dumpPath = argString(argc, argv, "--dump", NULL);
+	const char* tracePath = argString(argc, argv, "--trace", NULL);
+	const bool gpuTimers = !argFlag(argc, argv, "--no-gpu-timers");
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+
+	Framebuffer target(width, height);
+	GLStateCache glState;
+	glState.enable(GL_DEPTH_TEST);
+
+	ProgramCache programCache;
+	programCache.init(HeadlessContext::getProcAddress);
+	Shader myShader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache);
+	programCache.printStats();
+	Cube cube;
+	unsigned int texture1 = loadTexture("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+	unsigned int texture2 = loadTexture("Textures/awesomeface.png", GL_LINEAR);
+
+	myShader.use();
+	myShader.setInt("texture1", 0);
+	myShader.setInt("texture2", 1);
+
+	GLint modelLoc = myShader.getUniformLocation("model");
+
+	FrameUniforms frameUniforms;
+	myShader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+
+	Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+	target.bind();
+	GpuTimer gpuTimer;
+
+	// Same work as one iteration of the render loop in Main.cpp. Time is simulated at 60 Hz so every run draws the same frames.
+	auto renderFrame = [&](int frame) {
+		REGL_PROFILE_ZONE("Frame");
+		float time = frame / 60.0f;
+		if (gpuTimers)
+			gpuTimer.beginFrame();
+
+		{
+			REGL_GPU_ZONE(gpuTimer, "Clear");
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+
+		glState.bindTexture2D(0, texture1);
+		glState.bindTexture2D(1, texture2);
+		glState.useProgram(myShader.ID);
+
+		{
+			REGL_GPU_ZONE(gpuTimer, "Uniforms");
+			frameUniforms.update(camera, (float)width / (float)height, time, &glState);
+
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::rotate(model, time * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
+			myShader.setMat4(modelLoc, model);
+		}
+
+		{
+			REGL_GPU_ZONE(gpuTimer, "Draw");
+			cube.draw(glState);
+		}
+
+		{
+			REGL_GPU_ZONE(gpuTimer, "Finish");
+			glFinish(); // Stands in for glfwSwapBuffers: wait until the frame is actually done.
+		}
+		if (gpuTimers)
+			gpuTimer.endFrame();
+	};
+
+	for (int i = 0; i < warmup; ++i)
+		renderFrame(i);
+	gpuTimer.flush();
+	gpuTimer.resetStats(); // Only the measured frames count.
+
+	FrameTimes times;
+	times.reserve(frames);
+	BenchClock clock;
+	for (int i = 0; i < frames; ++i) {
+		clock.restart();
+		renderFrame(warmup + i);
+		times.add(clock.elapsedMs());
+	}
+	times.report("cube");
+	if (gpuTimers) {
+		gpuTimer.flush();
+		gpuTimer.report("cube/");
+	}
+	std::cout << "cube state calls per frame: " << (double)glState.Issued / (warmup + frames) << " issued, "
+		<< (double)glState.Skipped / (warmup + frames) << " skipped" << std::endl;
+
+	if (dumpPath) {
+		std::vector<unsigned char> pixels;
+		target.readPixels(pixels);
+		if (writePPM(dumpPath, pixels, width, height))
+			std::cout << "Wrote " << dumpPath << std::endl;
+		else
+			std::cout << "Failed to write " << dumpPath << std::endl;
+	}
+	if (tracePath)
+		Profiler::instance().writeChromeTrace(tracePath);
+
+	// De-allocate all resources while the context is still alive.
+	glDeleteTextures(1, &texture1);
+	glDeleteTextures(1, &texture2);
+	glDeleteProgram(myShader.ID);
+	cube.cleanup();
+	frameUniforms.cleanup();
+	gpuTimer.cleanup();
+	target.cleanup();
+	return 0;
+}
+
+
+// ------------------------SHADERS------------------------
+static int runShaderBench(int argc, char** argv)
+{
+	const int iterations = argInt(argc, argv, "--iterations", 50);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	ProgramCache cache("ShaderCache");
+	if (!cache.init(HeadlessContext::getProcAddress))
+		return -1;
+
+	// Compile from source every time (no cache).
+	FrameTimes compileTimes;
+	BenchClock clock;
+	for (int i = 0; i < iterations; ++i) {
+		clock.restart();
+		Shader shader("Shaders/Texture.vert", "Shaders/Texture.frag");
+		glFinish();
+		compileTimes.add(clock.elapsedMs());
+		glDeleteProgram(shader.ID);
+	}
+	compileTimes.report("shaders/compile");
+
+	// Prime the cache once, then every build is a hit.
+	Shader primed("Shaders/Texture.vert", "Shaders/Texture.frag", &cache);
+	glDeleteProgram(primed.ID);
+
+	FrameTimes cachedTimes;
+	for (int i = 0; i < iterations; ++i) {
+		clock.restart();
+		Shader shader("Shaders/Texture.vert", "Shaders/Texture.frag", &cache);
+		glFinish();
+		cachedTimes.add(clock.elapsedMs());
+		glDeleteProgram(shader.ID);
+	}
+	cachedTimes.report("shaders/cached");
+	cache.printStats();
+	return 0;
+}
+
+
+// ------------------------PROFILER------------------------
+// Records `zones` zones as fast as possible and reports the average cost per zone.
+static double profileZones(int zones, bool nested)
+{
+	BenchClock clock;
+	if (nested) {
+		for (int i = 0; i < zones; i += 2) {
+			REGL_PROFILE_ZONE("Outer");
+			REGL_PROFILE_ZONE("Inner");
+		}
+	}
+	else {
+		for (int i = 0; i < zones; ++i) {
+			REGL_PROFILE_ZONE("Zone");
+		}
+	}
+	return clock.elapsedMs() * 1e6 / zones;
+}
+
+static int runProfilerBench(int argc, char** argv)
+{
+	const int zones = argInt(argc, argv, "--zones", 10000000);
+	const int threads = argInt(argc, argv, "--threads", 4);
+
+	profileZones(PROFILER_RING_SIZE, false); // Creates this thread's buffer and touches its pages.
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "profiler/zone  " << profileZones(zones, false) << "ns per zone" << std::endl;
+	std::cout << "profiler/nested  " << profileZones(zones, true) << "ns per zone" << std::endl;
+
+	// Every thread writes its own buffer, so this should cost the same per zone as the single-threaded run.
+	std::vector<double> perThread(threads);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t) {
+		workers.push_back(std::thread([&perThread, t, zones] {
+			REGL_PROFILE_THREAD("Worker");
+			profileZones(PROFILER_RING_SIZE, false);
+			perThread[t] = profileZones(zones, false);
+		}));
+	}
+	double sum = 0.0;
+	for (int t = 0; t < threads; ++t) {
+		workers[t].join();
+		sum += perThread[t];
+	}
+	std::cout << "profiler/" << threads << "-threads  " << sum / threads << "ns per zone" << std::endl;
+
+	BenchClock clock;
+	Profiler::instance().writeChromeTrace("regl_bench_trace.json");
+	std::cout << "profiler/write-trace  " << clock.elapsedMs() << "ms" << std::endl;
+	std::remove("regl_bench_trace.json");
+	return 0;
+}
+
+
+struct BenchEntry
+{
+	const char* Name;
+	BenchMode Run;
+};
+
+static const BenchEntry BENCH_MODES[] = {
+	{ "cube", runCubeBench },
+	{ "shaders", runShaderBench },
+	{ "instancing", runInstancingBench },
+	{ "textures", runTextureBench },
+	{ "mipmaps", runMipmapBench },
+	{ "residency", runResidencyBench },
+	{ "profiler", runProfilerBench },
+	{ "software", runSoftwareBench },
+	{ "meshes", runMeshBench },
+	{ "meshopt", runMeshOptimizerBench },
+	{ "meshload", runMeshLoadBench },
+	{ "culling", runCullingBench },
+	{ "bvh", runBVHBench },
+	{ "occlusion", runOcclusionBench },
+	{ "frames", runFramesBench },
+	{ "timestep", runTimestepBench },
+	{ "jobs", runJobsBench },
+	{ "commands", runCommandBench },
+};
+
+
+int main(int argc, char** argv)
+{
+	REGL_PROFILE_THREAD("Main");
+	const char* mode = (argc > 1 && argv[1][0] != '-') ? argv[1] : "cube";
+	for (const BenchEntry& entry : BENCH_MODES)
+		if (std::strcmp(entry.Name, mode) == 0)
+			return entry.Run(argc, argv);
+
+	std::cout << "Unknown benchmark '" << mode << "'. Available:";
+	for (const BenchEntry& entry : BENCH_MODES)
+		std::cout << " " << entry.Name;
+	std::cout << std::endl;
+	return -1;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Shared helpers for the regl_bench executable.
+// Every benchmark mode is a function taking the remaining command line and returning the process exit code.
+typedef int (*BenchMode)(int argc, char** argv);
+
+// Benchmark modes implemented in their own files.
+int runInstancingBench(int argc, char** argv);
+int runTextureBench(int argc, char** argv);
+int runMipmapBench(int argc, char** argv);
+int runResidencyBench(int argc, char** argv);
+int runSoftwareBench(int argc, char** argv);
+int runMeshBench(int argc, char** argv);
+int runMeshOptimizerBench(int argc, char** argv);
+int runMeshLoadBench(int argc, char** argv);
+int runCullingBench(int argc, char** argv);
+int runBVHBench(int argc, char** argv);
+int runOcclusionBench(int argc, char** argv);
+int runFramesBench(int argc, char** argv);
+int runTimestepBench(int argc, char** argv);
+int runJobsBench(int argc, char** argv);
+int runCommandBench(int argc, char** argv);
+
+
+// Returns the integer value following `name` on the command line, or `fallback` if it is not there.
+inline int argInt(int argc, char** argv, const char* name, int fallback)
+{
+	for (int i = 0; i + 1 < argc; ++i)
+		if (std::strcmp(argv[i], name) == 0)
+			return std::atoi(argv[i + 1]);
+	return fallback;
+}
+
+// Returns the string value following `name` on the command line, or `fallback` if it is not there.
+inline const char* argString(int argc, char** argv, const char* name, const char* fallback)
+{
+	for (int i = 0; i + 1 < argc; ++i)
+		if (std::strcmp(argv[i], name) == 0)
+			return argv[i + 1];
+	return fallback;
+}
+
+// Returns true if the flag `name` is present on the command line.
+inline bool argFlag(int argc, char** argv, const char* name)
+{
+	for (int i = 0; i < argc; ++i)
+		if (std::strcmp(argv[i], name) == 0)
+			return true;
+	return false;
+}
+
+
+// Write RGBA8 pixels, bottom row first (as glReadPixels returns them), as a binary PPM, top row first.
+inline bool writePPM(const char* path, const std::vector<unsigned char>& rgba, int width, int height)
+{
+	FILE* file = std::fopen(path, "wb");
+	if (!file)
+		return false;
+	std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int y = height - 1; y >= 0; --y) // OpenGL rows are bottom-up.
+		for (int x = 0; x < width; ++x)
+			std::fwrite(&rgba[((size_t)y * width + x) * 4], 1, 3, file);
+	std::fclose(file);
+	return true;
+}
+
+// Read a binary PPM written by writePPM() back into RGB8 pixels, top row first.
+inline bool readPPM(const char* path, std::vector<unsigned char>& rgb, int& width, int& height)
+{
+	FILE* file = std::fopen(path, "rb");
+	if (!file)
+		return false;
+	int maxValue = 0;
+	bool ok = std::fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && maxValue == 255 && std::fgetc(file) != EOF;
+	if (ok) {
+		rgb.resize((size_t)width * height * 3);
+		ok = std::fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	}
+	std::fclose(file);
+	return ok;
+}
+
+
+// Wall-clock stopwatch with sub-microsecond resolution.
+class BenchClock
+{
+public:
+	BenchClock() : start(std::chrono::steady_clock::now()) {}
+
+	void restart() { start = std::chrono::steady_clock::now(); }
+
+	// Milliseconds since construction or the last restart().
+	double elapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+
+// Collects per-frame (or per-iteration) times and prints min/median/p99/mean/max.
+class FrameTimes
+{
+public:
+	std::vector<double> Samples; // Milliseconds, in the order they were recorded.
+
+	void reserve(size_t count) { Samples.reserve(count); }
+	void add(double ms) { Samples.push_back(ms); }
+
+	// Value at the given percentile (0..100) using nearest-rank on a sorted copy.
+	double percentile(double p) const
+	{
+		if (Samples.empty())
+			return 0.0;
+		std::vector<double> sorted(Samples);
+		std::sort(sorted.begin(), sorted.end());
+		size_t rank = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+		return sorted[std::min(rank, sorted.size() - 1)];
+	}
+
+	double mean() const
+	{
+		double sum = 0.0;
+		for (double s : Samples)
+			sum += s;
+		return Samples.empty() ? 0.0 : sum / (double)Samples.size();
+	}
+
+	// One line per benchmark, easy to grep and to diff between runs.
+	void report(const std::string& name) const
+	{
+		std::cout << std::fixed << std::setprecision(4)
+			<< name
+			<< "  n=" << Samples.size()
+			<< "  min=" << percentile(0.0) << "ms"
+			<< "  median=" << percentile(50.0) << "ms"
+			<< "  p99=" << percentile(99.0) << "ms"
+			<< "  mean=" << mean() << "ms"
+			<< "  max=" << percentile(100.0) << "ms"
+			<< std::endl;
+	}
+};
@@ -0,0 +1,261 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Shaders/Shader.h"
+#include "../Source/Camera.h"
+#include "../Source/CommandBuffer.h"
+#include "../Source/Cube.h"
+#include "../Source/Framebuffer.h"
+#include "../Source/FrameUniforms.h"
+#include "../Source/Headless.h"
+#include "../Source/JobSystem.h"
+#include "../Source/RadixSort.h"
+#include "../Source/StateCache.h"
+#include "../Source/Texture.h"
+#include "Bench.h"
+
+
+// Position of cube i of `count` on a 3D grid centered on the origin.
+static glm::vec3 gridPosition(int i, int count)
+{
+	int side = (int)std::ceil(std::cbrt((double)count));
+	float half = (side - 1) * 0.5f;
+	return glm::vec3((i % side) - half, ((i / side) % side) - half, (i / (side * side)) - half) * 1.5f;
+}
+
+// Model matrix of cube i, turning with time.
+static glm::mat4 gridModel(int i, int count, float time)
+{
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), gridPosition(i, count));
+	model = glm::rotate(model, time * glm::radians(50.0f) + i, glm::vec3(0.5f, 1.0f, 0.0f));
+	return glm::scale(model, glm::vec3(0.5f));
+}
+
+// Material of cube i: one of two programs times one of two texture orders, scattered so code order keeps switching.
+static int gridMaterial(int i)
+{
+	uint32_t hash = (uint32_t)i * 2654435761u;
+	return (int)(hash >> 30);
+}
+
+static bool sameCommands(const CommandBuffer& a, const CommandBuffer& b)
+{
+	return a.Commands.size() == b.Commands.size() && a.Uniforms == b.Uniforms
+		&& (a.Commands.empty() || std::memcmp(a.Commands.data(), b.Commands.data(), a.Commands.size() * sizeof(DrawCommand)) == 0);
+}
+
+
+// ------------------------COMMANDS------------------------
+// A grid of cubes with four materials (two programs, two texture orders) scattered over it, drawn one setMat4 +
+// glDrawElements at a time on the GL thread, then through command buffers (Source/CommandBuffer.h): recorded on a
+// JobSystem of one thread and of all of them, merged, and replayed. First with one key for every draw, so they replay
+// in recording order, then with drawSortKey() keys (program, textures, front to back) radix-sorted on the job system.
+// Reports the CPU time of recording (matrices and sort included) and of the replay, and the state changes per frame.
+// Checks that the merged commands are the same whatever the thread count, that the radix sort agrees with
+// std::stable_sort, that no frame raises a GL error, and that every image matches the direct draws.
+int runCommandBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 10);
+	const int count = argInt(argc, argv, "--count", 50000);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+	const unsigned int threads = (unsigned int)argInt(argc, argv, "--threads", 0);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	Framebuffer target(width, height);
+	GLStateCache state;
+	state.enable(GL_DEPTH_TEST);
+
+	// Two programs per path: the same code, told apart by a define, so switching between them is a real program change.
+	ProgramCache programCache;
+	programCache.init(HeadlessContext::getProcAddress);
+	Shader perDrawShaders[2] = {
+		Shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define MATERIAL 0\n"),
+		Shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define MATERIAL 1\n"),
+	};
+	Shader objectShaders[2] = {
+		Shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define OBJECT_BLOCK\n#define MATERIAL 0\n"),
+		Shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define OBJECT_BLOCK\n#define MATERIAL 1\n"),
+	};
+	Shader* shaders[] = { &perDrawShaders[0], &perDrawShaders[1], &objectShaders[0], &objectShaders[1] };
+	for (Shader* shader : shaders) {
+		shader->use();
+		shader->setInt("texture1", 0);
+		shader->setInt("texture2", 1);
+		shader->bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+		shader->bindUniformBlock("ObjectData", OBJECT_UNIFORMS_BINDING);
+	}
+	state.invalidate();
+	GLint modelLocs[2] = { perDrawShaders[0].getUniformLocation("model"), perDrawShaders[1].getUniformLocation("model") };
+
+	Cube cube;
+	unsigned int texture1 = loadTexture("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+	unsigned int texture2 = loadTexture("Textures/awesomeface.png", GL_LINEAR);
+	FrameUniforms frameUniforms;
+	CommandExecutor executor;
+	const uint32_t stride = executor.uniformStride(sizeof(ObjectData));
+
+	float extent = (float)std::ceil(std::cbrt((double)count)) * 1.5f;
+	Camera camera(glm::vec3(0.0f, 0.0f, extent * 1.5f));
+	const float farPlane = extent * 3.0f;
+	const glm::mat4 projection = camera.GetProjectionMatrix((float)width / (float)height, 0.1f, farPlane);
+	target.bind();
+
+	JobSystem oneThread(1), allThreads(threads);
+	std::cout << count << " cubes, 4 materials, " << frames << " frames, uniform stride " << stride << " bytes, "
+		<< allThreads.threadCount() << " threads" << std::endl;
+
+	DrawCommand materials[4];
+	for (int material = 0; material < 4; ++material) {
+		bool swapped = (material & 1) != 0;
+		materials[material] = CommandBuffer::meshCommand(0, objectShaders[material >> 1].ID, cube, swapped ? texture2 : texture1,
+			swapped ? texture1 : texture2);
+	}
+
+	struct Variant
+	{
+		const char* Name;
+		JobSystem* Jobs; // NULL: direct draws.
+		bool Sorted;
+	};
+	const Variant variants[] = {
+		{ "direct", NULL, false },
+		{ "recorded/1-thread", &oneThread, false },
+		{ "recorded/threads", &allThreads, false },
+		{ "sorted/1-thread", &oneThread, true },
+		{ "sorted/threads", &allThreads, true },
+	};
+	const int variantCount = sizeof(variants) / sizeof(variants[0]);
+
+	std::vector<unsigned char> images[variantCount];
+	CommandBuffer merged[variantCount];
+	bool failed = false;
+	for (int v = 0; v < variantCount; ++v) {
+		const Variant& variant = variants[v];
+		CommandRecorder recorder;
+		FrameTimes recordTimes, replayTimes;
+		for (int frame = 0; frame < frames + 1; ++frame) { // The first frame is a warm-up and is not recorded.
+			const float time = frame / 60.0f;
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			// Every frame, like the render thread, through the same state cache as the command replay.
+			frameUniforms.update(camera.GetViewMatrix(), projection, camera.Position, time, &state);
+			glFinish();
+
+			BenchClock clock;
+			double recordMs = 0.0;
+			if (variant.Jobs == NULL) {
+				for (int i = 0; i < count; ++i) {
+					int material = gridMaterial(i);
+					bool swapped = (material & 1) != 0;
+					Shader& shader = perDrawShaders[material >> 1];
+					state.useProgram(shader.ID);
+					state.bindTexture2D(0, swapped ? texture2 : texture1);
+					state.bindTexture2D(1, swapped ? texture1 : texture2);
+					shader.setMat4(modelLocs[material >> 1], gridModel(i, count, time));
+					cube.draw(state);
+				}
+			}
+			else {
+				recorder.record(*variant.Jobs, count, stride, merged[v], [&](int i, CommandBuffer& buffer) {
+					int material = gridMaterial(i);
+					DrawCommand command = materials[material];
+					if (variant.Sorted) {
+						float depth = glm::dot(gridPosition(i, count) - camera.Position, camera.Front) / farPlane;
+						command.Key = drawSortKey(0, false, command.Program, material & 1, depth);
+					}
+					ObjectData object = { gridModel(i, count, time) };
+					buffer.draw(command, object);
+				});
+				recordMs = clock.elapsedMs();
+				clock.restart();
+				executor.execute(merged[v], state);
+			}
+			glFinish();
+			GLenum error = glGetError();
+			if (error != GL_NO_ERROR) {
+				std::cout << "  FAILED: GL error 0x" << std::hex << error << std::dec << " on frame " << frame << std::endl;
+				failed = true;
+			}
+			if (frame > 0) {
+				if (variant.Jobs != NULL)
+					recordTimes.add(recordMs);
+				replayTimes.add(clock.elapsedMs());
+			}
+		}
+		target.readPixels(images[v]); // The last frame: every cube has turned since the first one.
+
+		if (variant.Jobs != NULL)
+			recordTimes.report(std::string("commands/record/") + variant.Name);
+		replayTimes.report(std::string("commands/") + (variant.Jobs == NULL ? "draw/" : "replay/") + variant.Name);
+		if (variant.Jobs != NULL) {
+			const StateChanges& changes = variant.Sorted ? recorder.Sorted : recorder.Unsorted;
+			double recorded = (double)recorder.Frames;
+			std::cout << "  state changes per frame: " << changes.total() / recorded << " (programs " << changes.Programs / recorded
+				<< ", VAOs " << changes.VertexArrays / recorded << ", textures " << changes.Textures / recorded << ")" << std::endl;
+		}
+		int differing = 0;
+		for (size_t i = 0; i < images[0].size(); ++i)
+			differing += images[0][i] != images[v][i];
+		if (v > 0) {
+			std::cout << "  image against direct draws: " << differing << " bytes differ" << std::endl;
+			failed = failed || differing != 0;
+		}
+	}
+
+	bool deterministic = sameCommands(merged[1], merged[2]) && sameCommands(merged[3], merged[4]);
+	std::cout << "Merged commands with 1 and " << allThreads.threadCount() << " threads: " << (deterministic ? "identical" : "DIFFERENT") << std::endl;
+	failed = failed || !deterministic;
+
+	// The sort on its own: the keys of the last sorted frame, shuffled back to recording order.
+	{
+		std::vector<SortItem> keys(merged[4].Commands.size());
+		std::vector<uint64_t> recordingOrder(keys.size());
+		for (const DrawCommand& command : merged[4].Commands)
+			recordingOrder[command.UniformOffset / stride] = command.Key;
+		RadixSorter sorter;
+		FrameTimes radixTimes, stableTimes;
+		std::vector<SortItem> stable;
+		for (int run = 0; run < 10; ++run) {
+			for (size_t i = 0; i < keys.size(); ++i)
+				keys[i] = SortItem{ recordingOrder[i], (uint32_t)i };
+			stable = keys;
+			BenchClock clock;
+			sorter.sort(keys, &allThreads);
+			radixTimes.add(clock.elapsedMs());
+			clock.restart();
+			std::stable_sort(stable.begin(), stable.end(), [](const SortItem& a, const SortItem& b) { return a.Key < b.Key; });
+			stableTimes.add(clock.elapsedMs());
+		}
+		radixTimes.report("commands/sort/radix");
+		stableTimes.report("commands/sort/stable_sort");
+		bool same = true;
+		for (size_t i = 0; i < keys.size(); ++i)
+			same = same && keys[i].Index == stable[i].Index;
+		std::cout << "Radix sort (" << sorter.Passes << " passes) against std::stable_sort: " << (same ? "same order" : "DIFFERENT") << std::endl;
+		failed = failed || !same;
+	}
+
+	glDeleteTextures(1, &texture1);
+	glDeleteTextures(1, &texture2);
+	for (Shader* shader : shaders)
+		glDeleteProgram(shader->ID);
+	executor.cleanup();
+	cube.cleanup();
+	frameUniforms.cleanup();
+	target.cleanup();
+	return failed ? -1 : 0;
+}
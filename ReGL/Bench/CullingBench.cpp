@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Source/BVH.h"
+#include "../Source/Camera.h"
+#include "../Source/Culling.h"
+#include "../Source/OcclusionCulling.h"
+#include "../Source/TileWorkers.h"
+#include "Bench.h"
+
+
+// `count` boxes scattered over a 200 x 50 x 200 area around the origin, 0.2 to 2 units on a side.
+static void scatterBoxes(size_t count, CullingSet& objects)
+{
+	std::srand(1234);
+	auto random = [](float low, float high) { return low + (high - low) * (float)std::rand() / (float)RAND_MAX; };
+	objects.clear();
+	for (size_t i = 0; i < count; ++i) {
+		glm::vec3 center(random(-100.0f, 100.0f), random(-25.0f, 25.0f), random(-100.0f, 100.0f));
+		glm::vec3 extent(random(0.1f, 1.0f), random(0.1f, 1.0f), random(0.1f, 1.0f));
+		objects.add(center, extent);
+	}
+}
+
+
+// ------------------------CULLING------------------------
+// Frustum culling of 100k and 1M boxes with a camera turning around at the center of the scene: one box at a time
+// with Frustum::intersectsBox, then CullingSet four at a time (boxes and spheres) on one thread and on TileWorkers.
+// The SIMD box results are checked against the scalar ones.
+int runCullingBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 60);
+	const int onlyCount = argInt(argc, argv, "--count", 0);
+	const float aspect = 800.0f / 600.0f;
+	TileWorkers workers((unsigned int)argInt(argc, argv, "--threads", 0));
+
+	const size_t counts[] = { 100000, 1000000 };
+	for (size_t count : counts) {
+		if (onlyCount > 0)
+			count = (size_t)onlyCount;
+		CullingSet objects;
+		scatterBoxes(count, objects);
+		std::cout << count << " boxes, " << frames << " frames, " << workers.threadCount() << " threads" << std::endl;
+
+		struct Variant
+		{
+			const char* Name;
+			CullShape Shape;
+			bool Simd;
+			bool Threads;
+		};
+		const Variant variants[] = {
+			{ "culling/scalar-boxes", CULL_BOXES, false, false },
+			{ "culling/simd-spheres", CULL_SPHERES, true, false },
+			{ "culling/simd-boxes", CULL_BOXES, true, false },
+			{ "culling/simd-boxes-mt", CULL_BOXES, true, true },
+		};
+		std::vector<size_t> reference(frames);
+		std::vector<unsigned int> visible;
+		for (const Variant& variant : variants) {
+			Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+			FrameTimes times;
+			size_t visibleTotal = 0, mismatches = 0;
+			for (int frame = 0; frame < frames; ++frame) {
+				camera.Yaw = 360.0f * (float)frame / (float)frames;
+				camera.ProcessMouseMovement(0.0f, 0.0f); // Recompute Front from Yaw.
+				const Frustum& frustum = camera.GetFrustum(aspect);
+
+				BenchClock clock;
+				if (variant.Simd)
+					objects.cull(frustum, visible, variant.Shape, variant.Threads ? &workers : NULL);
+				else {
+					visible.clear();
+					for (size_t i = 0; i < objects.size(); ++i) {
+						glm::vec3 center(objects.CenterX[i], objects.CenterY[i], objects.CenterZ[i]);
+						glm::vec3 extent(objects.ExtentX[i], objects.ExtentY[i], objects.ExtentZ[i]);
+						if (frustum.intersectsBox(center, extent))
+							visible.push_back((unsigned int)i);
+					}
+				}
+				times.add(clock.elapsedMs());
+
+				visibleTotal += visible.size();
+				if (!variant.Simd)
+					reference[frame] = visible.size();
+				else if (variant.Shape == CULL_BOXES && visible.size() != reference[frame])
+					mismatches++;
+			}
+			times.report(variant.Name);
+			std::cout << std::fixed << std::setprecision(1) << "  per frame: " << (double)visibleTotal / frames << " visible, "
+				<< (double)(count * frames - visibleTotal) / frames << " culled";
+			if (variant.Simd && variant.Shape == CULL_BOXES)
+				std::cout << ", " << mismatches << " frames differing from scalar";
+			std::cout << std::endl;
+		}
+		if (onlyCount > 0)
+			break;
+	}
+	return 0;
+}
+
+
+// ------------------------BVH------------------------
+// The same scenes through a BVH (Source/BVH.h): build time, refit after a tenth of the objects moved and after all of
+// them did, frustum culling against CullingSet, ray casts from the camera against testing every box, and box queries.
+// Results are checked against the brute force ones.
+int runBVHBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 60);
+	const int rays = argInt(argc, argv, "--rays", 1000);
+	const int onlyCount = argInt(argc, argv, "--count", 0);
+	const float aspect = 800.0f / 600.0f;
+
+	const size_t counts[] = { 100000, 1000000 };
+	for (size_t count : counts) {
+		if (onlyCount > 0)
+			count = (size_t)onlyCount;
+		CullingSet objects;
+		scatterBoxes(count, objects);
+		std::vector<AABB> boxes(count);
+		for (size_t i = 0; i < count; ++i)
+			boxes[i] = AABB::fromCenterExtent(glm::vec3(objects.CenterX[i], objects.CenterY[i], objects.CenterZ[i]),
+				glm::vec3(objects.ExtentX[i], objects.ExtentY[i], objects.ExtentZ[i]));
+
+		BVH tree;
+		BenchClock clock;
+		tree.build(boxes);
+		double buildMs = clock.elapsedMs();
+		std::cout << count << " boxes: built " << tree.Nodes.size() << " nodes in " << std::fixed << std::setprecision(1) << buildMs
+			<< "ms, SAH cost " << tree.BuildCost << std::endl;
+
+		// Culling, the tree against the linear SIMD loop, on the same frames as the culling bench.
+		FrameTimes linearTimes, treeTimes;
+		size_t nodesVisited = 0, mismatches = 0;
+		std::vector<unsigned int> linearVisible, treeVisible;
+		Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+		for (int frame = 0; frame < frames; ++frame) {
+			camera.Yaw = 360.0f * (float)frame / (float)frames;
+			camera.ProcessMouseMovement(0.0f, 0.0f);
+			const Frustum& frustum = camera.GetFrustum(aspect);
+			linearTimes.add(objects.cull(frustum, linearVisible).Ms);
+			treeTimes.add(tree.cullFrustum(frustum, treeVisible).Ms);
+			nodesVisited += tree.Last.NodesVisited;
+			if (treeVisible.size() != linearVisible.size())
+				mismatches++;
+		}
+		linearTimes.report("bvh/cull-linear-simd");
+		treeTimes.report("bvh/cull-tree");
+		std::cout << std::fixed << std::setprecision(1) << "  per frame: " << (double)tree.TotalVisible / frames << " visible, "
+			<< (double)nodesVisited / frames << " nodes visited, " << mismatches << " frames differing from linear" << std::endl;
+
+		// Rays from the camera position in random directions, against every box.
+		std::srand(99);
+		auto random = [](float low, float high) { return low + (high - low) * (float)std::rand() / (float)RAND_MAX; };
+		std::vector<glm::vec3> directions(rays);
+		for (glm::vec3& direction : directions)
+			direction = glm::normalize(glm::vec3(random(-1.0f, 1.0f), random(-0.3f, 0.3f), random(-1.0f, 1.0f)));
+		const glm::vec3 origin(0.5f, 0.0f, 0.5f);
+		FrameTimes bruteRays, treeRays;
+		size_t hits = 0, rayMismatches = 0, rayNodes = 0;
+		for (const glm::vec3& direction : directions) {
+			clock.restart();
+			float nearest = 1000.0f;
+			int nearestObject = -1;
+			for (size_t i = 0; i < count; ++i) {
+				float enter = 0.0f, exit = nearest;
+				for (int axis = 0; axis < 3; ++axis) {
+					float t0 = (boxes[i].Min[axis] - origin[axis]) / direction[axis];
+					float t1 = (boxes[i].Max[axis] - origin[axis]) / direction[axis];
+					enter = std::max(enter, std::min(t0, t1));
+					exit = std::min(exit, std::max(t0, t1));
+				}
+				if (enter <= exit) {
+					nearest = enter;
+					nearestObject = (int)i;
+				}
+			}
+			bruteRays.add(clock.elapsedMs());
+
+			clock.restart();
+			RayHit hit;
+			BVHStats stats;
+			bool found = tree.raycast(origin, direction, 1000.0f, hit, &stats);
+			treeRays.add(clock.elapsedMs());
+			rayNodes += stats.NodesVisited;
+			hits += found ? 1 : 0;
+			if (found != (nearestObject >= 0) || (found && std::fabs(hit.Distance - nearest) > 1e-3f))
+				rayMismatches++;
+		}
+		bruteRays.report("bvh/ray-brute");
+		treeRays.report("bvh/ray-tree");
+		std::cout << "  " << hits << "/" << rays << " rays hit, " << (double)rayNodes / rays << " nodes visited per ray, "
+			<< rayMismatches << " differing from brute force" << std::endl;
+
+		// Cursor picks: the screen position of random box centers, turned back into a ray by Camera::GetRayDirection.
+		// The ray has to point at the center, and the tree has to return that box or one in front of it.
+		{
+			const float screenWidth = 800.0f, screenHeight = 600.0f;
+			Camera picker(glm::vec3(0.5f, 0.0f, 0.5f));
+			picker.Zoom = 60.0f;
+			int picks = 0, picked = 0, pickMismatches = 0;
+			float worstAngle = 0.0f;
+			for (int pick = 0; pick < rays; ++pick) {
+				picker.Yaw = random(0.0f, 360.0f);
+				picker.ProcessMouseMovement(0.0f, 0.0f);
+				glm::mat4 viewProjection = picker.GetProjectionMatrix(screenWidth / screenHeight) * picker.GetViewMatrix();
+				unsigned int object = (unsigned int)(std::rand() % count);
+				glm::vec3 center = boxes[object].center();
+				glm::vec4 clip = viewProjection * glm::vec4(center, 1.0f);
+				if (clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w)
+					continue; // Not on screen: can't be clicked.
+				float x = (clip.x / clip.w * 0.5f + 0.5f) * screenWidth;
+				float y = (0.5f - clip.y / clip.w * 0.5f) * screenHeight; // Cursor y goes down.
+				glm::vec3 direction = picker.GetRayDirection(x, y, screenWidth, screenHeight);
+				float angle = std::acos(std::min(1.0f, glm::dot(direction, glm::normalize(center - picker.Position))));
+				worstAngle = std::max(worstAngle, angle);
+				RayHit hit;
+				bool found = tree.raycast(picker.Position, direction, 1000.0f, hit);
+				picks++;
+				picked += (found && hit.Object == object) ? 1 : 0;
+				if (angle > 1e-3f || !found || hit.Distance > glm::length(center - picker.Position))
+					pickMismatches++;
+			}
+			std::cout << std::setprecision(5) << "  cursor picks: " << picks << " on screen, " << picked << " picked the clicked box, "
+				<< pickMismatches << " missing it (worst ray error " << worstAngle << " rad)" << std::endl;
+		}
+
+		// Box queries: 5-unit boxes at random spots.
+		FrameTimes boxTimes;
+		size_t found = 0, boxMismatches = 0;
+		std::vector<unsigned int> overlapping;
+		for (int query = 0; query < rays; ++query) {
+			glm::vec3 center(random(-100.0f, 100.0f), random(-25.0f, 25.0f), random(-100.0f, 100.0f));
+			AABB box = AABB::fromCenterExtent(center, glm::vec3(2.5f));
+			overlapping.clear();
+			clock.restart();
+			tree.queryBox(box, overlapping);
+			boxTimes.add(clock.elapsedMs());
+			found += overlapping.size();
+			if (query % 100 == 0) { // Brute force is slow, check some.
+				size_t expected = 0;
+				for (const AABB& other : boxes)
+					expected += box.overlaps(other) ? 1 : 0;
+				boxMismatches += (expected != overlapping.size()) ? 1 : 0;
+			}
+		}
+		boxTimes.report("bvh/box-query");
+		std::cout << "  " << (double)found / rays << " objects per query, " << boxMismatches << " checked queries differing from brute force" << std::endl;
+
+		// Refit after moving 10% of the objects a little, then all of them further.
+		const float moves[] = { 0.5f, 5.0f };
+		const size_t strides[] = { 10, 1 };
+		for (int pass = 0; pass < 2; ++pass) {
+			for (size_t i = 0; i < count; i += strides[pass]) {
+				glm::vec3 offset(random(-moves[pass], moves[pass]), random(-moves[pass], moves[pass]), random(-moves[pass], moves[pass]));
+				boxes[i] = AABB(boxes[i].Min + offset, boxes[i].Max + offset);
+			}
+			clock.restart();
+			for (size_t i = 0; i < count; i += strides[pass])
+				tree.update((unsigned int)i, boxes[i]);
+			tree.refit();
+			double refitMs = clock.elapsedMs();
+			clock.restart();
+			BVH rebuilt;
+			rebuilt.build(boxes);
+			double rebuildMs = clock.elapsedMs();
+			std::cout << std::fixed << std::setprecision(2) << "bvh/refit  " << count / strides[pass] << " objects moved up to " << moves[pass]
+				<< ": refit " << refitMs << "ms (SAH cost x" << tree.sahCost() / tree.BuildCost << "), rebuild " << rebuildMs << "ms" << std::endl;
+		}
+		if (onlyCount > 0)
+			break;
+	}
+	return 0;
+}
+
+
+// ------------------------OCCLUSION------------------------
+// A city block grid: 100 buildings, which are the occluders, and 100k small objects on the ground between and behind
+// them, seen from street level by a camera turning around. Objects go through BVH frustum culling, then through the
+// occlusion buffer (Source/OcclusionCulling.h) drawn from the buildings in the frustum, on one thread and on all of them.
+int runOcclusionBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 60);
+	const int count = argInt(argc, argv, "--count", 100000);
+	const int width = argInt(argc, argv, "--width", 256);
+	const int height = argInt(argc, argv, "--height", 128);
+	const char* dumpPath = argString(argc, argv, "--dump", NULL);
+	const float aspect = 800.0f / 600.0f;
+
+	// A unit box, -0.5 to 0.5, as occluder geometry.
+	const float boxPositions[] = {
+		-0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f, 0.5f, -0.5f,  -0.5f, 0.5f, -0.5f,
+		-0.5f, -0.5f, 0.5f,   0.5f, -0.5f, 0.5f,   0.5f, 0.5f, 0.5f,   -0.5f, 0.5f, 0.5f,
+	};
+	const unsigned int boxIndices[] = {
+		0, 1, 2, 2, 3, 0,  4, 5, 6, 6, 7, 4,  0, 4, 7, 7, 3, 0,  1, 5, 6, 6, 2, 1,  3, 2, 6, 6, 7, 3,  0, 1, 5, 5, 4, 0,
+	};
+
+	// Buildings centered in the cells of a 20-unit street grid, objects anywhere on the ground.
+	std::vector<glm::mat4> buildingModels;
+	std::vector<AABB> buildingBounds;
+	std::srand(7);
+	auto random = [](float low, float high) { return low + (high - low) * (float)std::rand() / (float)RAND_MAX; };
+	for (int i = -5; i < 5; ++i) {
+		for (int j = -5; j < 5; ++j) {
+			glm::vec3 center(i * 20.0f + 10.0f, 0.0f, j * 20.0f + 10.0f), size(14.0f, random(6.0f, 30.0f), 14.0f);
+			center.y = size.y * 0.5f;
+			buildingModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), size));
+			buildingBounds.push_back(AABB::fromCenterExtent(center, size * 0.5f));
+		}
+	}
+	std::vector<AABB> objectBounds(count);
+	for (AABB& bounds : objectBounds)
+		bounds = AABB::fromCenterExtent(glm::vec3(random(-100.0f, 100.0f), random(0.2f, 3.0f), random(-100.0f, 100.0f)), glm::vec3(0.2f));
+	BVH tree;
+	tree.build(objectBounds);
+
+	OcclusionBuffer singleThreaded(width, height, 1), threaded(width, height);
+	OcclusionBuffer* buffers[] = { &singleThreaded, &threaded };
+	const char* names[] = { "occlusion/1-thread", "occlusion/threads" };
+	std::cout << count << " objects, " << buildingModels.size() << " buildings, " << threaded.Width << "x" << threaded.Height << " occlusion buffer" << std::endl;
+
+	std::vector<unsigned int> visible;
+	for (int b = 0; b < 2; ++b) {
+		OcclusionBuffer& occlusion = *buffers[b];
+		Camera camera(glm::vec3(0.0f, 1.7f, 0.0f));
+		FrameTimes rasterTimes, testTimes;
+		size_t frustumVisible = 0, occluders = 0, triangles = 0;
+		for (int frame = 0; frame < frames; ++frame) {
+			camera.Yaw = 360.0f * (float)frame / (float)frames;
+			camera.ProcessMouseMovement(0.0f, 0.0f);
+			const Frustum& frustum = camera.GetFrustum(aspect);
+			tree.cullFrustum(frustum, visible);
+			frustumVisible += visible.size();
+
+			occlusion.beginFrame(camera.GetProjectionMatrix(aspect) * camera.GetViewMatrix());
+			for (size_t i = 0; i < buildingModels.size(); ++i) {
+				if (!frustum.intersectsBox(buildingBounds[i].center(), buildingBounds[i].extent()))
+					continue;
+				occlusion.addOccluder(boxPositions, 3, boxIndices, 36, buildingModels[i]);
+				occluders++;
+			}
+			triangles += occlusion.OccluderTriangles;
+			occlusion.rasterize();
+			occlusion.filter(objectBounds, visible);
+			rasterTimes.add(occlusion.RasterMs);
+			testTimes.add(occlusion.TestMs);
+		}
+		rasterTimes.report(std::string(names[b]) + "-raster");
+		testTimes.report(std::string(names[b]) + "-test");
+		std::cout << std::fixed << std::setprecision(1) << "  " << occlusion.threadCount() << " threads, per frame: "
+			<< (double)occluders / frames << " occluders (" << (double)triangles / frames << " triangles), "
+			<< (double)frustumVisible / frames << " in the frustum, " << (double)occlusion.TotalOccluded / frames << " occluded, "
+			<< (double)(frustumVisible - occlusion.TotalOccluded) / frames << " drawn" << std::endl;
+	}
+
+	if (dumpPath) {
+		std::vector<uint8_t> image;
+		threaded.debugImage(image);
+		if (!writePPM(dumpPath, image, threaded.Width, threaded.Height))
+			std::cout << "Cannot write " << dumpPath << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include <glad/glad.h>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Shaders/Shader.h"
+#include "../Source/Camera.h"
+#include "../Source/Cube.h"
+#include "../Source/Framebuffer.h"
+#include "../Source/FrameUniforms.h"
+#include "../Source/Headless.h"
+#include "../Source/InstanceBuffer.h"
+#include "../Source/Texture.h"
+#include "Bench.h"
+
+
+// Model matrices for `count` rotating cubes on a 3D grid centered on the origin.
+static void buildGrid(std::vector<glm::mat4>& models, int count, float time)
+{
+	int side = (int)std::ceil(std::cbrt((double)count));
+	float half = (side - 1) * 0.5f;
+	models.resize(count);
+	for (int i = 0; i < count; ++i) {
+		glm::vec3 position((i % side) - half, ((i / side) % side) - half, (i / (side * side)) - half);
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), position * 1.5f);
+		model = glm::rotate(model, time * glm::radians(50.0f) + i, glm::vec3(0.5f, 1.0f, 0.0f));
+		models[i] = glm::scale(model, glm::vec3(0.5f));
+	}
+}
+
+
+// ------------------------INSTANCING------------------------
+// Draws the same grid of cubes with one setMat4 + glDrawElements per cube, and with a single glDrawElementsInstanced.
+int runInstancingBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 20);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+	const int onlyCount = argInt(argc, argv, "--count", 0);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	Framebuffer target(width, height);
+	glEnable(GL_DEPTH_TEST);
+
+	ProgramCache programCache;
+	programCache.init(HeadlessContext::getProcAddress);
+	Shader perDrawShader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache);
+	Shader instancedShader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define INSTANCED\n");
+
+	Cube cube;
+	InstanceBuffer instances;
+	instances.attach(cube.VAO);
+
+	unsigned int texture1 = loadTexture("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+	unsigned int texture2 = loadTexture("Textures/awesomeface.png", GL_LINEAR);
+
+	Shader* shaders[] = { &perDrawShader, &instancedShader };
+	for (Shader* shader : shaders) {
+		shader->use();
+		shader->setInt("texture1", 0);
+		shader->setInt("texture2", 1);
+		shader->bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+	}
+	GLint modelLoc = perDrawShader.getUniformLocation("model");
+
+	FrameUniforms frameUniforms;
+	target.bind();
+
+	const int counts[] = { 1000, 10000, 100000 };
+	std::vector<glm::mat4> models;
+	for (int count : counts) {
+		if (onlyCount > 0 && count != onlyCount)
+			continue;
+
+		// Pull the camera back far enough to see the whole grid.
+		float extent = (float)std::ceil(std::cbrt((double)count)) * 1.5f;
+		Camera camera(glm::vec3(0.0f, 0.0f, extent * 1.5f));
+		frameUniforms.update(camera, (float)width / (float)height, 0.0f);
+
+		for (int instanced = 0; instanced < 2; ++instanced) {
+			Shader& shader = instanced ? instancedShader : perDrawShader;
+			FrameTimes times;
+			BenchClock clock;
+			for (int frame = 0; frame < frames + 1; ++frame) { // The first frame is a warm-up and is not recorded.
+				clock.restart();
+				buildGrid(models, count, frame / 60.0f); // Both paths pay for computing the matrices.
+
+				glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, texture1);
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, texture2);
+				shader.use();
+
+				if (instanced) {
+					instances.upload(models);
+					cube.drawInstanced((GLsizei)count);
+				}
+				else {
+					for (int i = 0; i < count; ++i) {
+						shader.setMat4(modelLoc, models[i]);
+						cube.draw();
+					}
+				}
+				glFinish();
+				if (frame > 0)
+					times.add(clock.elapsedMs());
+			}
+			times.report(std::string("instancing/") + (instanced ? "instanced" : "per-draw") + "/" + std::to_string(count));
+		}
+	}
+
+	glDeleteTextures(1, &texture1);
+	glDeleteTextures(1, &texture2);
+	glDeleteProgram(perDrawShader.ID);
+	glDeleteProgram(instancedShader.ID);
+	instances.cleanup();
+	cube.cleanup();
+	frameUniforms.cleanup();
+	target.cleanup();
+	return 0;
+}
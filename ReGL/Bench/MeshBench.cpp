@@ -0,0 +1,442 @@
+#include <glad/glad.h>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Shaders/Shader.h"
+#include "../Source/Camera.h"
+#include "../Source/Framebuffer.h"
+#include "../Source/FrameUniforms.h"
+#include "../Source/Headless.h"
+#include "../Source/Mesh.h"
+#include "../Source/MeshFile.h"
+#include "../Source/MeshOptimizer.h"
+#include "../Source/ObjLoader.h"
+#include "../Source/Texture.h"
+#include "Bench.h"
+
+
+// Float vertices of a unit UV sphere with `rings` x `segments` quads, in the cube's layout (position, color, uv).
+// The color is the normal mapped to [0, 1].
+static void buildSphere(int rings, int segments, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+{
+	const float pi = 3.14159265358979f;
+	vertices.clear();
+	indices.clear();
+	vertices.reserve((size_t)(rings + 1) * (segments + 1) * 8);
+	indices.reserve((size_t)rings * segments * 6);
+	for (int ring = 0; ring <= rings; ++ring) {
+		float v = (float)ring / rings;
+		float theta = v * pi;
+		for (int segment = 0; segment <= segments; ++segment) {
+			float u = (float)segment / segments;
+			float phi = u * 2.0f * pi;
+			float x = std::sin(theta) * std::cos(phi), y = std::cos(theta), z = std::sin(theta) * std::sin(phi);
+			const float vertex[8] = { x, y, z, x * 0.5f + 0.5f, y * 0.5f + 0.5f, z * 0.5f + 0.5f, u, v };
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+	}
+	for (int ring = 0; ring < rings; ++ring) {
+		for (int segment = 0; segment < segments; ++segment) {
+			unsigned int a = ring * (segments + 1) + segment, b = a + segments + 1;
+			const unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Float vertices of a torus around the y axis with `rings` x `segments` quads, laid out like buildSphere's. Unlike a
+// sphere, parts of it hide others from most directions, so the triangle order changes the overdraw.
+static void buildTorus(int rings, int segments, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+{
+	const float pi = 3.14159265358979f, major = 0.7f, minor = 0.3f;
+	vertices.clear();
+	indices.clear();
+	for (int ring = 0; ring <= rings; ++ring) {
+		float v = (float)ring / rings;
+		float theta = v * 2.0f * pi; // Around the tube.
+		for (int segment = 0; segment <= segments; ++segment) {
+			float u = (float)segment / segments;
+			float phi = u * 2.0f * pi; // Around the axis.
+			float nx = std::cos(theta) * std::cos(phi), ny = std::sin(theta), nz = std::cos(theta) * std::sin(phi);
+			float x = (major + minor * std::cos(theta)) * std::cos(phi), y = minor * ny, z = (major + minor * std::cos(theta)) * std::sin(phi);
+			const float vertex[8] = { x, y, z, nx * 0.5f + 0.5f, ny * 0.5f + 0.5f, nz * 0.5f + 0.5f, u, v };
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+		}
+	}
+	for (int ring = 0; ring < rings; ++ring) {
+		for (int segment = 0; segment < segments; ++segment) {
+			unsigned int a = ring * (segments + 1) + segment, b = a + segments + 1;
+			const unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Put triangles and vertices in random order, like an exporter that doesn't care would.
+static void shuffleMesh(std::vector<float>& vertices, std::vector<unsigned int>& indices, unsigned int seed)
+{
+	std::mt19937 random(seed);
+	const size_t vertexCount = vertices.size() / 8, triangleCount = indices.size() / 3;
+	std::vector<unsigned int> order(triangleCount);
+	std::iota(order.begin(), order.end(), 0u);
+	std::shuffle(order.begin(), order.end(), random);
+	std::vector<unsigned int> shuffled(indices.size());
+	for (size_t t = 0; t < triangleCount; ++t)
+		std::memcpy(&shuffled[t * 3], &indices[order[t] * 3], 3 * sizeof(unsigned int));
+
+	std::vector<unsigned int> remap(vertexCount);
+	std::iota(remap.begin(), remap.end(), 0u);
+	std::shuffle(remap.begin(), remap.end(), random);
+	std::vector<float> moved(vertices.size());
+	for (size_t v = 0; v < vertexCount; ++v)
+		std::memcpy(&moved[remap[v] * 8], &vertices[v * 8], 8 * sizeof(float));
+	for (unsigned int& index : shuffled)
+		index = remap[index];
+	vertices.swap(moved);
+	indices.swap(shuffled);
+}
+
+// Largest difference between the positions as given and as the GPU will read them back from `mesh`-style encoding.
+static float maxPositionError(const VertexLayout& layout, const std::vector<float>& vertices, const std::vector<uint8_t>& encoded)
+{
+	const VertexAttribute& position = layout.Attributes[0];
+	float maxError = 0.0f;
+	for (size_t v = 0; v < vertices.size() / 8; ++v) {
+		const uint8_t* data = encoded.data() + v * layout.Stride + position.Offset;
+		for (int c = 0; c < 3; ++c) {
+			float decoded;
+			if (position.Format == VERTEX_HALF) {
+				uint16_t half;
+				std::memcpy(&half, data + c * 2, 2);
+				decoded = halfToFloat(half);
+			}
+			else if (position.Format == VERTEX_SNORM16) {
+				int16_t snorm;
+				std::memcpy(&snorm, data + c * 2, 2);
+				decoded = std::max(snorm / 32767.0f, -1.0f);
+			}
+			else
+				std::memcpy(&decoded, data + c * 4, 4);
+			maxError = std::max(maxError, std::fabs(decoded - vertices[v * 8 + c]));
+		}
+	}
+	return maxError;
+}
+
+
+// ------------------------MESHES------------------------
+// Draws generated spheres stored with 32-bit floats and 32-bit indices, and with the compact layouts of Source/Mesh.h.
+int runMeshBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 20);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+	const int draws = argInt(argc, argv, "--draws", 4); // Draws of the mesh per frame.
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	Framebuffer target(width, height);
+	glEnable(GL_DEPTH_TEST);
+
+	ProgramCache programCache;
+	programCache.init(HeadlessContext::getProcAddress);
+	Shader shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache);
+	unsigned int texture1 = loadTexture("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+	unsigned int texture2 = loadTexture("Textures/awesomeface.png", GL_LINEAR);
+	shader.use();
+	shader.setInt("texture1", 0);
+	shader.setInt("texture2", 1);
+	shader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+	GLint modelLoc = shader.getUniformLocation("model");
+
+	FrameUniforms frameUniforms;
+	Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+	frameUniforms.update(camera, (float)width / (float)height, 0.0f);
+	target.bind();
+
+	struct LayoutCase
+	{
+		const char* Name;
+		VertexLayout Layout;
+		bool WideIndices; // Keep 32-bit indices even when 16 bits would do, like the float arrays of the original cube.
+	};
+	LayoutCase cases[3];
+	cases[0].Name = "float";
+	cases[0].Layout.add(0, 3, VERTEX_FLOAT).add(1, 3, VERTEX_FLOAT).add(2, 2, VERTEX_FLOAT);
+	cases[0].WideIndices = true;
+	cases[1].Name = "half";
+	cases[1].Layout.add(0, 3, VERTEX_HALF).add(1, 3, VERTEX_UNORM8).add(2, 2, VERTEX_UNORM16);
+	cases[1].WideIndices = false;
+	cases[2].Name = "snorm16";
+	cases[2].Layout.add(0, 3, VERTEX_SNORM16).add(1, 3, VERTEX_UNORM8).add(2, 2, VERTEX_UNORM16);
+	cases[2].WideIndices = false;
+
+	const int sizes[][2] = { { 180, 360 }, { 700, 1400 } }; // 65k vertices (16-bit indices) and 982k vertices.
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	for (const int* size : sizes) {
+		buildSphere(size[0], size[1], vertices, indices);
+		const size_t vertexCount = vertices.size() / 8;
+		std::cout << "Sphere: " << vertexCount << " vertices, " << indices.size() / 3 << " triangles" << std::endl;
+
+		for (LayoutCase& layoutCase : cases) {
+			std::vector<uint8_t> encoded = encodeVertices(layoutCase.Layout, vertices.data(), 8, vertexCount);
+			Mesh mesh = layoutCase.WideIndices
+				? Mesh(layoutCase.Layout, encoded.data(), vertexCount, indices.data(), indices.size(), GL_UNSIGNED_INT)
+				: Mesh(layoutCase.Layout, vertices.data(), 8, vertexCount, indices.data(), indices.size());
+
+			FrameTimes times;
+			BenchClock clock;
+			for (int frame = 0; frame < frames + 1; ++frame) { // The first frame is a warm-up and is not recorded.
+				clock.restart();
+				glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, texture1);
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, texture2);
+				shader.use();
+				for (int i = 0; i < draws; ++i) {
+					glm::mat4 model = glm::rotate(glm::mat4(1.0f), (frame + i) * 0.05f, glm::vec3(0.5f, 1.0f, 0.0f));
+					shader.setMat4(modelLoc, model);
+					mesh.draw();
+				}
+				glFinish();
+				if (frame > 0)
+					times.add(clock.elapsedMs());
+			}
+			std::string name = std::string("meshes/") + layoutCase.Name + "/" + std::to_string(vertexCount);
+			times.report(name);
+			std::cout << std::fixed << std::setprecision(6) << name << "  stride=" << mesh.Layout.Stride << "B"
+				<< "  vertices=" << mesh.vertexBytes() / 1024 << "KiB"
+				<< "  indices=" << mesh.indexBytes() / 1024 << "KiB (" << indexSize(mesh.IndexType) * 8 << "-bit)"
+				<< "  max position error=" << maxPositionError(layoutCase.Layout, vertices, encoded) << std::endl;
+			mesh.cleanup();
+		}
+	}
+
+	glDeleteTextures(1, &texture1);
+	glDeleteTextures(1, &texture2);
+	glDeleteProgram(shader.ID);
+	frameUniforms.cleanup();
+	target.cleanup();
+	return 0;
+}
+
+
+// ------------------------MESH OPTIMIZER------------------------
+// Tori in grid order, shuffled, shuffled then reordered for the vertex cache only, and shuffled then run through
+// optimizeMesh(): vertex cache and fetch statistics, overdraw (fragments that passed the depth test per covered pixel,
+// over a full turn) and draw times.
+int runMeshOptimizerBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 24);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	Framebuffer target(width, height);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE); // Without it, most overdraw is back faces, which no static order can avoid from every direction.
+
+	ProgramCache programCache;
+	programCache.init(HeadlessContext::getProcAddress);
+	Shader shader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache);
+	unsigned int texture1 = loadTexture("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+	unsigned int texture2 = loadTexture("Textures/awesomeface.png", GL_LINEAR);
+	shader.use();
+	shader.setInt("texture1", 0);
+	shader.setInt("texture2", 1);
+	shader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+	GLint modelLoc = shader.getUniformLocation("model");
+
+	FrameUniforms frameUniforms;
+	Camera camera(glm::vec3(0.0f, 0.0f, 2.5f));
+	frameUniforms.update(camera, (float)width / (float)height, 0.0f);
+	target.bind();
+
+	VertexLayout layout;
+	layout.add(0, 3, VERTEX_HALF).add(1, 3, VERTEX_UNORM8).add(2, 2, VERTEX_UNORM16);
+	GLuint query;
+	glGenQueries(1, &query);
+	std::vector<unsigned char> pixels;
+
+	const int sizes[][2] = { { 128, 256 }, { 400, 800 } }; // 33k and 321k vertices.
+	for (const int* size : sizes) {
+		std::vector<float> gridVertices, vertices;
+		std::vector<unsigned int> gridIndices, indices;
+		buildTorus(size[0], size[1], gridVertices, gridIndices);
+		const size_t vertexCount = gridVertices.size() / 8;
+		std::cout << "Torus: " << vertexCount << " vertices, " << gridIndices.size() / 3 << " triangles" << std::endl;
+
+		const char* variants[] = { "grid", "shuffled", "vertex-cache", "optimized" };
+		for (int variant = 0; variant < 4; ++variant) {
+			vertices = gridVertices;
+			indices = gridIndices;
+			double optimizeMs = 0.0;
+			if (variant > 0)
+				shuffleMesh(vertices, indices, 1234u);
+			if (variant == 2)
+				optimizeVertexCache(indices.data(), indices.size(), vertices.size() / 8); // To see what the other two passes add.
+			if (variant == 3) {
+				BenchClock optimizeClock;
+				optimizeMesh(vertices, 8, indices);
+				optimizeMs = optimizeClock.elapsedMs();
+			}
+			VertexCacheStats cacheStats = analyzeVertexCache(indices.data(), indices.size(), vertices.size() / 8);
+			VertexFetchStats fetchStats = analyzeVertexFetch(indices.data(), indices.size(), vertices.size() / 8, layout.Stride);
+			Mesh mesh(layout, vertices.data(), 8, vertices.size() / 8, indices.data(), indices.size());
+
+			FrameTimes times;
+			BenchClock clock;
+			GLuint64 samples = 0, covered = 0;
+			for (int frame = 0; frame < frames + 1; ++frame) { // The first frame is a warm-up and is not recorded.
+				clock.restart();
+				glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, texture1);
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, texture2);
+				shader.use();
+				glm::mat4 model = glm::rotate(glm::mat4(1.0f), frame * 6.2831853f / frames, glm::vec3(1.0f, 0.3f, 0.0f));
+				shader.setMat4(modelLoc, model);
+				glBeginQuery(GL_SAMPLES_PASSED, query);
+				mesh.draw();
+				glEndQuery(GL_SAMPLES_PASSED);
+				glFinish();
+				if (frame == 0)
+					continue;
+				times.add(clock.elapsedMs());
+
+				GLuint64 passed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &passed);
+				samples += passed;
+				target.readPixels(pixels);
+				for (size_t i = 0; i < pixels.size(); i += 4)
+					if (std::memcmp(&pixels[i], &pixels[0], 3) != 0) // Not the clear color, which the torus never covers in the corner.
+						covered++;
+			}
+
+			std::string name = std::string("meshopt/") + variants[variant] + "/" + std::to_string(vertexCount);
+			times.report(name);
+			std::cout << std::fixed << std::setprecision(3) << name
+				<< "  ACMR=" << cacheStats.ACMR << "  ATVR=" << cacheStats.ATVR << "  overfetch=" << fetchStats.Overfetch
+				<< "  overdraw=" << (covered ? samples / (double)covered : 0.0);
+			if (variant == 3)
+				std::cout << "  optimize=" << optimizeMs << "ms";
+			std::cout << std::endl;
+			mesh.cleanup();
+		}
+	}
+
+	glDeleteQueries(1, &query);
+	glDeleteTextures(1, &texture1);
+	glDeleteTextures(1, &texture2);
+	glDeleteProgram(shader.ID);
+	frameUniforms.cleanup();
+	target.cleanup();
+	return 0;
+}
+
+
+// Write buildSphere/buildTorus vertices as an OBJ with positions, uvs and normals (the normal is the color mapped back).
+static bool writeObj(const char* path, const std::vector<float>& vertices, const std::vector<unsigned int>& indices)
+{
+	FILE* file = std::fopen(path, "wb");
+	if (!file)
+		return false;
+	for (size_t v = 0; v < vertices.size(); v += 8)
+		std::fprintf(file, "v %.6f %.6f %.6f\n", vertices[v], vertices[v + 1], vertices[v + 2]);
+	for (size_t v = 0; v < vertices.size(); v += 8)
+		std::fprintf(file, "vt %.6f %.6f\n", vertices[v + 6], vertices[v + 7]);
+	for (size_t v = 0; v < vertices.size(); v += 8)
+		std::fprintf(file, "vn %.4f %.4f %.4f\n", vertices[v + 3] * 2.0f - 1.0f, vertices[v + 4] * 2.0f - 1.0f, vertices[v + 5] * 2.0f - 1.0f);
+	for (size_t i = 0; i < indices.size(); i += 3)
+		std::fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", indices[i] + 1, indices[i] + 1, indices[i] + 1,
+			indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 2] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+	bool ok = std::ferror(file) == 0;
+	std::fclose(file);
+	return ok;
+}
+
+
+// ------------------------MESH LOADING------------------------
+// Time from file to GPU buffers for the same torus: parsing an OBJ and encoding it at load time, against mapping the
+// .rmesh the cook step would have written. The files are in the OS cache after the first run, so this is the
+// parsing and copying cost, not the disk.
+int runMeshLoadBench(int argc, char** argv)
+{
+	const int iterations = argInt(argc, argv, "--iterations", 5);
+	const char* objPath = "meshload_bench.obj";
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	buildTorus(400, 800, vertices, indices);
+	if (!writeObj(objPath, vertices, indices)) {
+		std::cout << "Cannot write " << objPath << std::endl;
+		return -1;
+	}
+
+	// What regl_cook writes for it.
+	ObjMesh obj;
+	if (!loadObj(objPath, obj))
+		return -1;
+	VertexLayout layout;
+	layout.add(MESH_POSITION_LOCATION, 3, VERTEX_HALF).add(MESH_TEXCOORD_LOCATION, 2, VERTEX_UNORM16).add(MESH_NORMAL_LOCATION, 3, VERTEX_OCT_SNORM16);
+	optimizeMesh(obj.Vertices, obj.Stride, obj.Indices);
+	const size_t vertexCount = obj.Vertices.size() / obj.Stride;
+	const float boundsMin[3] = { -1.0f, -0.3f, -1.0f }, boundsMax[3] = { 1.0f, 0.3f, 1.0f };
+	const std::string meshPath = cookedMeshPath(objPath);
+	if (!writeMeshFile(meshPath, layout, encodeVertices(layout, obj.Vertices.data(), obj.Stride, vertexCount), vertexCount, obj.Indices, boundsMin, boundsMax))
+		return -1;
+
+	std::ifstream objFile(objPath, std::ios::binary | std::ios::ate), meshFile(meshPath.c_str(), std::ios::binary | std::ios::ate);
+	std::cout << "Torus: " << vertexCount << " vertices, " << obj.Indices.size() / 3 << " triangles; "
+		<< objPath << " " << (size_t)objFile.tellg() / 1024 << " KiB, " << meshPath << " " << (size_t)meshFile.tellg() / 1024 << " KiB" << std::endl;
+
+	FrameTimes objTimes, meshTimes;
+	for (int i = 0; i < iterations; ++i) {
+		BenchClock clock;
+		ObjMesh parsed;
+		if (!loadObj(objPath, parsed))
+			return -1;
+		Mesh fromObj(layout, parsed.Vertices.data(), parsed.Stride, parsed.Vertices.size() / parsed.Stride, parsed.Indices.data(), parsed.Indices.size());
+		glFinish();
+		objTimes.add(clock.elapsedMs());
+		fromObj.cleanup();
+
+		clock.restart();
+		Mesh fromFile;
+		if (!loadMeshFile(meshPath, fromFile))
+			return -1;
+		glFinish();
+		meshTimes.add(clock.elapsedMs());
+		fromFile.cleanup();
+	}
+	objTimes.report("meshload/obj");
+	meshTimes.report("meshload/rmesh");
+
+	std::remove(objPath);
+	std::remove(meshPath.c_str());
+	return 0;
+}
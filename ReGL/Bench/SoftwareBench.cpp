@@ -0,0 +1,111 @@
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../Source/Camera.h"
+#include "../Source/Cube.h"
+#include "../Source/Profiler.h"
+#include "../Source/SoftwareRasterizer.h"
+#include "Bench.h"
+
+
+// Peak signal-to-noise ratio of the RGB channels, in dB. rgba is bottom row first, golden (a PPM) top row first.
+static double goldenPSNR(const std::vector<uint8_t>& rgba, const std::vector<unsigned char>& golden, int width, int height)
+{
+	double squaredError = 0.0;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			const uint8_t* ours = &rgba[((size_t)(height - 1 - y) * width + x) * 4];
+			const unsigned char* theirs = &golden[((size_t)y * width + x) * 3];
+			for (int c = 0; c < 3; ++c) {
+				double d = (double)ours[c] - (double)theirs[c];
+				squaredError += d * d;
+			}
+		}
+	}
+	double mse = squaredError / ((double)width * height * 3);
+	return (mse == 0.0) ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+
+// ------------------------SOFTWARE------------------------
+// The cube scene of runCubeBench, drawn by the software rasterizer. The frames are the same as the cube bench's for
+// the same --frames/--warmup/--width/--height, so `cube --dump` output is a golden image for `software --golden`.
+int runSoftwareBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 100);
+	const int warmup = argInt(argc, argv, "--warmup", 50);
+	const int width = argInt(argc, argv, "--width", 800);
+	const int height = argInt(argc, argv, "--height", 600);
+	const int threads = argInt(argc, argv, "--threads", 0);
+	const char* dumpPath = argString(argc, argv, "--dump", NULL);
+	const char* goldenPath = argString(argc, argv, "--golden", NULL);
+	const double minPSNR = std::atof(argString(argc, argv, "--min-psnr", "30"));
+
+	SoftwareTexture texture1, texture2;
+	if (!texture1.load("Textures/wall.jpg", true) || !texture2.load("Textures/awesomeface.png", false))
+		return -1;
+
+	SoftwareRasterizer rasterizer(width, height, threads);
+	std::cout << "Software rasterizer: " << rasterizer.threadCount() << " threads, "
+		<< SoftwareRasterizer::TILE_SIZE << "x" << SoftwareRasterizer::TILE_SIZE << " tiles" << std::endl;
+
+	Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+	const glm::mat4 viewProjection = camera.GetProjectionMatrix((float)width / (float)height) * camera.GetViewMatrix();
+	const int indexCount = sizeof(CUBE_INDICES) / sizeof(CUBE_INDICES[0]);
+
+	// Same frame as runCubeBench's renderFrame, time simulated at 60 Hz.
+	auto renderFrame = [&](int frame) {
+		REGL_PROFILE_ZONE("Frame");
+		float time = frame / 60.0f;
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::rotate(model, time * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
+
+		rasterizer.beginFrame(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+		rasterizer.drawTextured(CUBE_VERTICES, 8, 0, 6, CUBE_INDICES, indexCount, viewProjection * model, texture1, texture2, 0.25f);
+		rasterizer.endFrame();
+	};
+
+	for (int i = 0; i < warmup; ++i)
+		renderFrame(i);
+
+	FrameTimes times;
+	times.reserve(frames);
+	BenchClock clock;
+	for (int i = 0; i < frames; ++i) {
+		clock.restart();
+		renderFrame(warmup + i);
+		times.add(clock.elapsedMs());
+	}
+	times.report("software");
+	std::cout << "software triangles per frame: " << rasterizer.TrianglesBinned << " binned into "
+		<< rasterizer.TileBinEntries << " tile entries" << std::endl;
+
+	if (dumpPath) {
+		if (writePPM(dumpPath, rasterizer.Color, width, height))
+			std::cout << "Wrote " << dumpPath << std::endl;
+		else
+			std::cout << "Failed to write " << dumpPath << std::endl;
+	}
+
+	if (goldenPath) {
+		std::vector<unsigned char> golden;
+		int goldenWidth = 0, goldenHeight = 0;
+		if (!readPPM(goldenPath, golden, goldenWidth, goldenHeight) || goldenWidth != width || goldenHeight != height) {
+			std::cout << "Cannot compare with " << goldenPath << ": not a " << width << "x" << height << " PPM" << std::endl;
+			return -1;
+		}
+		double psnr = goldenPSNR(rasterizer.Color, golden, width, height);
+		bool pass = psnr >= minPSNR;
+		std::cout << std::fixed << std::setprecision(2) << "software/golden  psnr=" << psnr << "dB  min=" << minPSNR << "dB  "
+			<< (pass ? "PASS" : "FAIL") << std::endl;
+		if (!pass)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,297 @@
+#include <glad/glad.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Source/Headless.h"
+#include "../Source/KTX2.h"
+#include "../Source/Mipmap.h"
+#include "../Source/Texture.h"
+#include "../Source/TextureLoader.h"
+#include "../Source/TextureResidency.h"
+#include "../Source/TextureStreamer.h"
+#include "../Source/TileWorkers.h"
+#include "Bench.h"
+
+
+// Simulated frames while the loader works: pump() once per frame and record how long the GL thread spent per frame.
+// The worst frames show the upload hitches.
+static void pumpFrames(TextureLoader& loader, FrameTimes& frameTimes)
+{
+	BenchClock clock;
+	while (loader.pendingCount() > 0) {
+		clock.restart();
+		loader.pump();
+		glFinish();
+		frameTimes.add(clock.elapsedMs());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Stand-in for the rest of the frame.
+	}
+}
+
+
+// ------------------------TEXTURES------------------------
+// Time to get the scene's textures decoded and uploaded: synchronously on the GL thread, through the TextureLoader
+// with direct uploads, and through the TextureLoader with PBO streaming.
+int runTextureBench(int argc, char** argv)
+{
+	const int copies = argInt(argc, argv, "--copies", 8);
+	const int iterations = argInt(argc, argv, "--iterations", 5);
+	const int threads = argInt(argc, argv, "--threads", 0);
+	const int budgetKB = argInt(argc, argv, "--budget-kb", 1024);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	const char* paths[] = { "Textures/wall.jpg", "Textures/awesomeface.png" };
+	std::vector<unsigned int> textures;
+
+	FrameTimes syncTimes, asyncTimes, streamedTimes;
+	FrameTimes asyncFrames, streamedFrames;
+	BenchClock clock;
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		// Everything on the GL thread.
+		clock.restart();
+		for (int i = 0; i < copies; ++i)
+			for (const char* path : paths)
+				textures.push_back(loadTexture(path, GL_LINEAR_MIPMAP_LINEAR));
+		glFinish();
+		syncTimes.add(clock.elapsedMs());
+		glDeleteTextures((GLsizei)textures.size(), textures.data());
+		textures.clear();
+
+		// Decode on loader threads, glTexImage2D on the GL thread.
+		{
+			TextureLoader loader(threads); // Thread start-up is part of the measured cost.
+			clock.restart();
+			for (int i = 0; i < copies; ++i)
+				for (const char* path : paths)
+					textures.push_back(loader.load(path, GL_LINEAR_MIPMAP_LINEAR));
+			pumpFrames(loader, asyncFrames);
+			asyncTimes.add(clock.elapsedMs());
+			glDeleteTextures((GLsizei)textures.size(), textures.data());
+			textures.clear();
+		}
+
+		// Decode on loader threads, copy into PBOs on loader threads, budgeted glTexSubImage2D on the GL thread.
+		{
+			TextureStreamer streamer(256 << 10, 8, (size_t)budgetKB << 10);
+			TextureLoader loader(threads, &streamer);
+			clock.restart();
+			for (int i = 0; i < copies; ++i)
+				for (const char* path : paths)
+					textures.push_back(loader.load(path, GL_LINEAR_MIPMAP_LINEAR));
+			pumpFrames(loader, streamedFrames);
+			streamedTimes.add(clock.elapsedMs());
+			loader.shutdown();
+			streamer.cleanup();
+			glDeleteTextures((GLsizei)textures.size(), textures.data());
+			textures.clear();
+		}
+	}
+
+	// Cooked .ktx2 files (regl_cook) against decoding + CPU mipmaps, both on the GL thread. The variants above already
+	// use the cooked files when they exist; this isolates the difference.
+	FrameTimes decodeTimes, cookedTimes;
+	size_t decodedBytes = 0, cookedBytes = 0;
+	CompressedFormats formats = queryCompressedFormats();
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		KTX2Image cooked;
+		bool allCooked = true;
+		for (const char* path : paths)
+			allCooked = allCooked && readKTX2(cookedTexturePath(path), cooked) && formats.supports(cooked.Format);
+		if (!allCooked) {
+			if (iteration == 0)
+				std::cout << "textures/ktx2: no cooked textures (run regl_cook) or formats not supported, skipped" << std::endl;
+			break;
+		}
+
+		clock.restart();
+		decodedBytes = 0;
+		stbi_set_flip_vertically_on_load(true);
+		for (int i = 0; i < copies; ++i) {
+			for (const char* path : paths) {
+				int width, height, channels;
+				unsigned char* pixels = stbi_load(path, &width, &height, &channels, 0);
+				textures.push_back(createTexture(GL_LINEAR_MIPMAP_LINEAR));
+				uploadTexture(pixels, width, height, channels, generateMipmaps(pixels, width, height, channels, textureMipOptions(channels)));
+				stbi_image_free(pixels);
+				decodedBytes += (size_t)width * height * channels * 4 / 3;
+			}
+		}
+		glFinish();
+		decodeTimes.add(clock.elapsedMs());
+		glDeleteTextures((GLsizei)textures.size(), textures.data());
+		textures.clear();
+
+		clock.restart();
+		cookedBytes = 0;
+		for (int i = 0; i < copies; ++i) {
+			for (const char* path : paths) {
+				readKTX2(cookedTexturePath(path), cooked);
+				textures.push_back(createTexture(GL_LINEAR_MIPMAP_LINEAR));
+				uploadCompressedTexture(cooked);
+				for (const std::vector<uint8_t>& level : cooked.Levels)
+					cookedBytes += level.size();
+			}
+		}
+		glFinish();
+		cookedTimes.add(clock.elapsedMs());
+		glDeleteTextures((GLsizei)textures.size(), textures.data());
+		textures.clear();
+	}
+
+	std::string suffix = "/" + std::to_string(copies * 2) + "-images";
+	syncTimes.report("textures/sync" + suffix);
+	asyncTimes.report("textures/async" + suffix);
+	streamedTimes.report("textures/streamed" + suffix);
+	asyncFrames.report("textures/async/pump-per-frame");
+	streamedFrames.report("textures/streamed/pump-per-frame");
+	if (!cookedTimes.Samples.empty()) {
+		decodeTimes.report("textures/stb+mipmaps" + suffix);
+		cookedTimes.report("textures/ktx2" + suffix);
+		std::cout << "textures/memory  uncompressed=" << decodedBytes / 1024 << "KiB  ktx2=" << cookedBytes / 1024 << "KiB" << std::endl;
+	}
+	return 0;
+}
+
+
+// ------------------------MIPMAPS------------------------
+// Mip chain of each scene texture: glGenerateMipmap against the CPU generator (Mipmap.h), per filter and thread count.
+int runMipmapBench(int argc, char** argv)
+{
+	const int iterations = argInt(argc, argv, "--iterations", 20);
+	const int threads = argInt(argc, argv, "--threads", 0);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	TileWorkers workers(threads);
+	const char* paths[] = { "Textures/wall.jpg", "Textures/awesomeface.png" };
+	for (const char* path : paths) {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* pixels = stbi_load(path, &width, &height, &channels, 0);
+		if (!pixels) {
+			std::cout << "Failed to load texture: " << path << std::endl;
+			return -1;
+		}
+		GLenum format = textureFormat(channels);
+		std::string name = std::string("mipmaps/") + path + "/";
+
+		// Driver: upload level 0 and generate the rest, until the GPU is done.
+		FrameTimes driverTimes;
+		unsigned int texture = createTexture(GL_LINEAR_MIPMAP_LINEAR);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int i = 0; i < iterations; ++i) {
+			BenchClock clock;
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glFinish();
+			driverTimes.add(clock.elapsedMs());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		driverTimes.report(name + "glGenerateMipmap");
+
+		// CPU: generation alone (it runs on decode threads or at cook time), then the level-by-level upload on the GL thread.
+		const MipFilter filters[] = { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+		std::vector<MipLevel> mips;
+		for (MipFilter filter : filters) {
+			for (int pooled = 0; pooled < 2; ++pooled) {
+				MipOptions options = textureMipOptions(channels);
+				options.Filter = filter;
+				options.Workers = pooled ? &workers : NULL;
+				FrameTimes times;
+				for (int i = 0; i < iterations; ++i) {
+					BenchClock clock;
+					mips = generateMipmaps(pixels, width, height, channels, options);
+					times.add(clock.elapsedMs());
+				}
+				times.report(name + ((filter == MIP_FILTER_BOX) ? "cpu-box" : "cpu-kaiser")
+					+ (pooled ? "/" + std::to_string(workers.threadCount()) + "-threads" : "/1-thread"));
+			}
+		}
+
+		FrameTimes uploadTimes;
+		for (int i = 0; i < iterations; ++i) {
+			BenchClock clock;
+			uploadTexture(pixels, width, height, channels, mips);
+			glFinish();
+			uploadTimes.add(clock.elapsedMs());
+		}
+		uploadTimes.report(name + "cpu-upload");
+
+		glDeleteTextures(1, &texture);
+		stbi_image_free(pixels);
+	}
+	return 0;
+}
+
+
+// ------------------------RESIDENCY------------------------
+// Many copies of the scene textures under a VRAM budget smaller than all of them. A window of textures slides over the
+// set, so the ones it leaves behind get evicted and the ones it reaches are streamed back in.
+int runResidencyBench(int argc, char** argv)
+{
+	const int copies = argInt(argc, argv, "--copies", 16);
+	const int frames = argInt(argc, argv, "--frames", 600);
+	const int window = argInt(argc, argv, "--window", 8);
+	const int framesPerStep = argInt(argc, argv, "--step-frames", 10);
+	const int budgetKB = argInt(argc, argv, "--budget-kb", 0);
+
+	HeadlessContext context;
+	if (!context.Valid)
+		return -1;
+
+	TextureLoader loader;
+	TextureResidency residency(loader, (size_t)-1);
+	std::vector<unsigned int> textures;
+	for (int i = 0; i < copies; ++i) {
+		textures.push_back(residency.load("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR));
+		textures.push_back(residency.load("Textures/awesomeface.png", GL_LINEAR_MIPMAP_LINEAR));
+	}
+	loader.finish();
+
+	size_t totalBytes = 0;
+	for (unsigned int texture : textures)
+		totalBytes += residency.fullBytes(texture);
+	residency.BudgetBytes = budgetKB ? (size_t)budgetKB << 10 : totalBytes / 2; // Default: half of everything fits.
+	residency.update(); // Evict down to the budget: the initial full-size load isn't an overshoot of the run.
+	residency.PeakResidentBytes = residency.ResidentBytes;
+	std::cout << "residency: " << textures.size() << " textures, " << totalBytes / 1024 << " KiB in total, budget "
+		<< residency.BudgetBytes / 1024 << " KiB" << std::endl;
+
+	FrameTimes frameTimes;
+	size_t maxOverBudget = 0;
+	// Sampled after every step that can load or evict, so transient overshoots count, like in PeakResidentBytes.
+	auto trackOverBudget = [&]() {
+		if (residency.ResidentBytes > residency.BudgetBytes)
+			maxOverBudget = std::max(maxOverBudget, residency.ResidentBytes - residency.BudgetBytes);
+	};
+	for (int frame = 0; frame < frames; ++frame) {
+		BenchClock clock;
+		loader.pump(); // Uploads the reloads that finished: the overshoot, if any, is here.
+		trackOverBudget();
+		residency.update();
+		trackOverBudget();
+		int first = (frame / framesPerStep) % (int)textures.size();
+		for (int i = 0; i < window; ++i) {
+			glBindTexture(GL_TEXTURE_2D, residency.use(textures[(first + i) % textures.size()]));
+		}
+		trackOverBudget();
+		glFinish();
+		frameTimes.add(clock.elapsedMs());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Stand-in for the rest of the frame, the loader works meanwhile.
+		trackOverBudget();
+	}
+	frameTimes.report("residency/frame");
+	residency.printStats();
+	std::cout << "residency: at most " << maxOverBudget / 1024 << " KiB over budget" << std::endl;
+
+	loader.shutdown();
+	residency.cleanup();
+	return 0;
+}
@@ -0,0 +1,286 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// GLM Mathematics Library
+#include <glm/glm.hpp>
+
+#include "../Source/FrameExchange.h"
+#include "../Source/FramePacket.h"
+#include "../Source/JobSystem.h"
+#include "../Source/TileWorkers.h"
+#include "Bench.h"
+
+
+// Busy for `ms`, like the main thread's input, culling and packet building.
+static void spinFor(double ms)
+{
+	BenchClock clock;
+	while (clock.elapsedMs() < ms) {
+	}
+}
+
+// Mostly idle for `ms`, like a render thread waiting for the driver and vsync.
+static void yieldFor(double ms)
+{
+	BenchClock clock;
+	while (clock.elapsedMs() < ms)
+		std::this_thread::yield();
+}
+
+// A packet whose draws all carry its frame number, so a packet read while it is being written shows up.
+static void fillPacket(FramePacket& packet, uint64_t frame, int draws)
+{
+	packet.Frame = frame;
+	packet.Draws.resize(draws);
+	for (int i = 0; i < draws; ++i) {
+		packet.Draws[i].Object = (unsigned int)i;
+		packet.Draws[i].Model = glm::mat4(1.0f);
+		packet.Draws[i].Model[3][0] = (float)frame;
+	}
+}
+
+static bool checkPacket(const FramePacket& packet)
+{
+	for (const FrameDraw& draw : packet.Draws)
+		if (draw.Model[3][0] != (float)packet.Frame)
+			return false;
+	return true;
+}
+
+
+// ------------------------FRAMES------------------------
+// The frame loop of Main.cpp with synthetic costs: a simulation step building a FramePacket, then a render step
+// consuming it. On one thread a frame costs their sum; with the render step on its own thread, fed through a
+// FrameExchange (Source/FrameExchange.h), it should cost their max. Also checks that every packet arrives whole and in order.
+int runFramesBench(int argc, char** argv)
+{
+	const int frames = argInt(argc, argv, "--frames", 300);
+	const double simulationMs = argInt(argc, argv, "--sim-us", 4000) / 1000.0;
+	const double renderMs = argInt(argc, argv, "--render-us", 6000) / 1000.0;
+	const int draws = argInt(argc, argv, "--draws", 1000);
+	const bool renderBusy = argFlag(argc, argv, "--render-busy");
+	auto render = [&]() {
+		if (renderBusy)
+			spinFor(renderMs);
+		else
+			yieldFor(renderMs);
+	};
+
+	std::cout << frames << " frames, simulation " << simulationMs << "ms, render " << renderMs << "ms ("
+		<< (renderBusy ? "busy" : "waiting") << "), " << draws << " draws per packet, "
+		<< std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	// One thread: simulate, then render.
+	{
+		FramePacket packet;
+		FrameTimes times;
+		times.reserve(frames);
+		bool intact = true;
+		for (int frame = 0; frame < frames; ++frame) {
+			BenchClock clock;
+			fillPacket(packet, frame + 1, draws);
+			spinFor(simulationMs);
+			intact = checkPacket(packet) && intact;
+			render();
+			times.add(clock.elapsedMs());
+		}
+		times.report("serial     ");
+		if (!intact)
+			std::cout << "  FAILED: damaged packet" << std::endl;
+	}
+
+	// Two threads: the main thread simulates frame N + 1 while the render thread draws frame N.
+	{
+		FrameExchange<FramePacket> exchange;
+		std::atomic<bool> quitting(false);
+		bool intact = true, ordered = true;
+
+		std::thread renderThread([&]() {
+			uint64_t last = 0;
+			while (exchange.waitForPacket(quitting)) {
+				const FramePacket& packet = exchange.readSlot();
+				intact = checkPacket(packet) && intact;
+				ordered = packet.Frame == last + 1 && ordered;
+				last = packet.Frame;
+				render();
+			}
+		});
+
+		FrameTimes times;
+		times.reserve(frames);
+		for (int frame = 0; frame < frames; ++frame) {
+			BenchClock clock;
+			fillPacket(exchange.writeSlot(), frame + 1, draws);
+			spinFor(simulationMs);
+			exchange.publish();
+			exchange.waitUntilTaken(quitting); // At most one frame ahead, like Main.cpp.
+			times.add(clock.elapsedMs());
+		}
+		quitting = true;
+		renderThread.join();
+
+		times.report("pipelined  ");
+		std::cout << std::fixed << std::setprecision(3) << "  expected: serial " << simulationMs + renderMs << "ms, pipelined "
+			<< std::max(simulationMs, renderMs) << "ms; " << exchange.Published << " published, " << exchange.Acquired
+			<< " acquired, " << exchange.Dropped << " dropped" << std::endl;
+		if (!intact || !ordered || exchange.Acquired != exchange.Published) {
+			std::cout << "  FAILED: " << (intact ? "" : "damaged packet ") << (ordered ? "" : "packets out of order ")
+				<< (exchange.Acquired == exchange.Published ? "" : "packets lost") << std::endl;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+// A few hundred nanoseconds of arithmetic that depends on i, so it can't be hoisted out of the loop.
+static float jobWork(int i)
+{
+	float x = (float)i * 0.001f;
+	for (int k = 0; k < 32; ++k)
+		x = x * 0.99f + std::sqrt(x + 1.0f);
+	return x;
+}
+
+static void emptyJob(void*, int, int)
+{
+}
+
+// Dependency test: every job of stage s checks that all jobs of stage s - 1 have finished.
+struct StageTest
+{
+	std::atomic<int> Finished[4];
+	std::atomic<bool> Ordered;
+	int JobsPerStage;
+};
+
+template <int Stage>
+static void stageJob(void* data, int begin, int)
+{
+	StageTest* test = (StageTest*)data;
+	if (Stage > 0 && test->Finished[Stage - 1].load() != test->JobsPerStage)
+		test->Ordered = false;
+	volatile float sink = jobWork(begin); // Some work, so a stage is still running while the next one is submitted.
+	(void)sink;
+	test->Finished[Stage].fetch_add(1);
+}
+
+
+// ------------------------JOBS------------------------
+// The JobSystem of Source/JobSystem.h with 1 to 64 threads: the cost of submitting and running empty jobs, one at a time
+// from one thread and split by parallelFor, and the speedup of a parallelFor over a million small items, next to
+// TileWorkers running the same chunks on its own threads. Then checks dependencies between counters, parallelFors
+// nested in jobs (waiting by helping), and jobs submitted by a thread outside the system.
+int runJobsBench(int argc, char** argv)
+{
+	const int jobCount = argInt(argc, argv, "--jobs", 100000);
+	const int items = argInt(argc, argv, "--items", 1 << 20);
+	const int grain = argInt(argc, argv, "--grain", 1024);
+	const int maxThreads = argInt(argc, argv, "--max-threads", 64);
+	bool failed = false;
+
+	std::vector<float> serialResults(items), results(items);
+	BenchClock serialClock;
+	for (int i = 0; i < items; ++i)
+		serialResults[i] = jobWork(i);
+	const double serialMs = serialClock.elapsedMs();
+	std::cout << std::fixed << std::setprecision(2) << std::thread::hardware_concurrency() << " hardware threads; " << items
+		<< " items in " << serialMs << "ms on one thread without jobs" << std::endl;
+
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		JobSystem jobs((unsigned int)threads);
+
+		// Empty jobs submitted one by one from this thread.
+		JobCounter counter;
+		BenchClock clock;
+		for (int i = 0; i < jobCount; ++i)
+			jobs.submit(&emptyJob, NULL, 0, 1, &counter);
+		jobs.wait(counter);
+		double submitNs = clock.elapsedMs() * 1e6 / jobCount;
+
+		// Empty items, one per job, split recursively.
+		clock.restart();
+		jobs.parallelFor(jobCount, 1, [](int) {});
+		double splitNs = clock.elapsedMs() * 1e6 / jobCount;
+
+		// Real items, `grain` per job.
+		std::fill(results.begin(), results.end(), 0.0f);
+		clock.restart();
+		jobs.parallelFor(items, grain, [&](int i) { results[i] = jobWork(i); });
+		double parallelMs = clock.elapsedMs();
+		if (results != serialResults) {
+			std::cout << "  FAILED: parallelFor results differ" << std::endl;
+			failed = true;
+		}
+
+		// The same chunks on TileWorkers' own threads.
+		double tileMs;
+		{
+			TileWorkers tiles((unsigned int)threads);
+			const int chunks = (items + grain - 1) / grain;
+			clock.restart();
+			tiles.run(chunks, [&](int chunk) {
+				for (int i = chunk * grain; i < std::min(items, (chunk + 1) * grain); ++i)
+					results[i] = jobWork(i);
+			});
+			tileMs = clock.elapsedMs();
+		}
+
+		std::cout << std::setw(3) << threads << " threads: submit " << std::setw(7) << submitNs << "ns/job, parallelFor "
+			<< std::setw(7) << splitNs << "ns/job, " << items << " items " << std::setw(8) << parallelMs << "ms ("
+			<< serialMs / parallelMs << "x), TileWorkers " << std::setw(8) << tileMs << "ms, " << jobs.jobsStolen() << " stolen" << std::endl;
+	}
+
+	// Correctness with all threads.
+	JobSystem jobs((unsigned int)std::min(maxThreads, 8));
+	{
+		StageTest test;
+		for (std::atomic<int>& finished : test.Finished)
+			finished = 0;
+		test.Ordered = true;
+		test.JobsPerStage = 256;
+		JobCounter stages[4];
+		uint64_t parkedBefore = jobs.jobsParked();
+		// In dependency order: a stage's counter must count all of its jobs before the next stage is submitted against
+		// it. Jobs of a stage that finished before the next one is submitted aren't parked, they just start.
+		for (int i = 0; i < test.JobsPerStage; ++i)
+			jobs.submit(&stageJob<0>, &test, i, i + 1, &stages[0]);
+		for (int i = 0; i < test.JobsPerStage; ++i)
+			jobs.submit(&stageJob<1>, &test, i, i + 1, &stages[1], &stages[0]);
+		for (int i = 0; i < test.JobsPerStage; ++i)
+			jobs.submit(&stageJob<2>, &test, i, i + 1, &stages[2], &stages[1]);
+		for (int i = 0; i < test.JobsPerStage; ++i)
+			jobs.submit(&stageJob<3>, &test, i, i + 1, &stages[3], &stages[2]);
+		for (JobCounter& stage : stages) // Every stage, so no job still uses `test` once it goes out of scope.
+			jobs.wait(stage);
+		bool ok = test.Ordered && test.Finished[3] == test.JobsPerStage;
+		std::cout << "Dependencies: 4 stages of " << test.JobsPerStage << " jobs " << (ok ? "ran in order" : "FAILED") << ", "
+			<< jobs.jobsParked() - parkedBefore << " parked" << std::endl;
+		failed = failed || !ok;
+	}
+	{
+		std::atomic<int> total(0);
+		jobs.parallelFor(64, 1, [&](int) {
+			jobs.parallelFor(1000, 10, [&](int) { total.fetch_add(1, std::memory_order_relaxed); });
+		});
+		bool ok = total == 64 * 1000;
+		std::cout << "Nested parallelFor: " << (ok ? "ok" : "FAILED") << std::endl;
+		failed = failed || !ok;
+	}
+	{
+		std::atomic<int> total(0);
+		std::thread outside([&]() {
+			jobs.parallelFor(10000, 100, [&](int) { total.fetch_add(1, std::memory_order_relaxed); });
+		});
+		outside.join();
+		bool ok = total == 10000;
+		std::cout << "Jobs from an outside thread: " << (ok ? "ok" : "FAILED") << std::endl;
+		failed = failed || !ok;
+	}
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "../Source/FixedTimestep.h"
+#include "Bench.h"
+
+
+// ------------------------TIMESTEP------------------------
+// The fixed-step scheduler of Main.cpp (Source/FixedTimestep.h) on a virtual clock, so the results don't depend on this
+// machine. No GL needed.
+//
+// First an object moving at the camera's speed, drawn at 30 to 240 frames per second with jittered frame times. With
+// interpolation the drawn position is exactly where the object was one step earlier, at any frame rate. Drawing the
+// latest step instead stutters by up to a step's movement. The simulation runs the same number of steps per second
+// at every frame rate; with a variable timestep it would run once per frame.
+//
+// Then steps that cost more real time than they simulate: without the catch-up cap every frame is longer than the last.
+int runTimestepBench(int argc, char** argv)
+{
+	const double seconds = argInt(argc, argv, "--seconds", 10);
+	const double hz = argInt(argc, argv, "--sim-hz", 60);
+	const int maxSteps = argInt(argc, argv, "--max-steps", 5);
+	const double stepCostMs = argInt(argc, argv, "--step-cost-us", 20000) / 1000.0;
+	const double speed = 12.5; // Camera SPEED, units per second.
+
+	std::cout << std::fixed << std::setprecision(3) << "Simulation at " << hz << " Hz, " << seconds << "s per frame rate" << std::endl;
+	const double frameRates[] = { 30.0, 60.0, 144.0, 240.0 };
+	for (double frameRate : frameRates) {
+		std::srand(1234);
+		FixedTimestep timestep(hz, maxSteps);
+		double previous = 0.0, current = 0.0; // Positions after the last two steps.
+		double interpolatedError = 0.0, latestError = 0.0;
+		double clock = 0.0;
+		while (clock < seconds) {
+			double frameSeconds = (1.0 / frameRate) * (0.8 + 0.4 * (double)std::rand() / (double)RAND_MAX); // +-20% jitter
+			clock += frameSeconds;
+			int steps = timestep.advance(frameSeconds);
+			for (int step = 0; step < steps; ++step) {
+				previous = current;
+				current += speed * timestep.StepSeconds;
+			}
+			// Where the object was one step ago: what a smooth drawing shows.
+			double expected = std::max(0.0, clock - timestep.StepSeconds) * speed;
+			double interpolated = previous + (current - previous) * timestep.alpha();
+			if (timestep.Steps > 0) {
+				interpolatedError = std::max(interpolatedError, std::abs(interpolated - expected));
+				latestError = std::max(latestError, std::abs(current - (expected + speed * timestep.StepSeconds)));
+			}
+		}
+		std::cout << std::setprecision(1) << "  " << std::setw(5) << frameRate << " fps: " << timestep.Frames << " frames, "
+			<< (double)timestep.Steps / clock << " steps/s (variable timestep: " << (double)timestep.Frames / clock << " updates/s)"
+			<< std::setprecision(4) << ", drawn position error: interpolated " << interpolatedError << ", latest step "
+			<< latestError << " units" << std::endl;
+	}
+
+	// Steps cost stepCostMs of real time each, frames 2 ms on top. Frame times are virtual, nothing actually waits.
+	std::cout << std::setprecision(1) << "Steps costing " << stepCostMs << "ms of real time each, " << 1000.0 / hz
+		<< "ms simulated:" << std::endl;
+	const int caps[] = { maxSteps, 1000000 };
+	for (int cap : caps) {
+		FixedTimestep timestep(hz, cap);
+		double frameMs = 1000.0 / hz;
+		std::cout << "  " << (cap == maxSteps ? "capped at " + std::to_string(cap) + " steps:" : std::string("uncapped:")) << " frame ms";
+		for (int frame = 1; frame <= 60; ++frame) {
+			int steps = timestep.advance(frameMs / 1000.0);
+			frameMs = 2.0 + steps * stepCostMs;
+			if (frame == 1 || frame == 5 || frame == 10 || frame == 20 || frame == 40 || frame == 60)
+				std::cout << "  #" << frame << "=" << frameMs;
+			if (frameMs > 60000.0) {
+				std::cout << "  #" << frame << "=" << frameMs << " (stopped)";
+				break;
+			}
+		}
+		std::cout << ", " << timestep.DroppedSeconds << "s dropped" << std::endl;
+	}
+	return 0;
+}
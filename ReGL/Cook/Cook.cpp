@@ -0,0 +1,223 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Dependencies/stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../Source/BlockCompression.h"
+#include "../Source/KTX2.h"
+#include "../Source/MeshFile.h"
+#include "../Source/MeshOptimizer.h"
+#include "../Source/Mipmap.h"
+#include "../Source/ObjLoader.h"
+#include "../Source/TileWorkers.h"
+
+// regl_cook: offline texture compression and mesh conversion. Encodes images into BC1 (opaque) or BC3 (with alpha) with
+// the whole mip chain precomputed, and writes them as .ktx2 next to the source image, where loadTexture() and
+// TextureLoader pick them up. Converts .obj meshes into optimized .rmesh files for loadMeshFile().
+// Doesn't need a GL context. Run it from the ReGL directory after changing anything in Textures/:
+//
+//   regl_cook Textures/wall.jpg Textures/awesomeface.png
+//   regl_cook Models/bunny.obj
+//
+// Options (before the files):
+//   --format auto|bc1|bc3   auto (default) picks BC1 when every pixel is opaque, BC3 otherwise.
+//   --mip-filter kaiser|box kaiser (default) is sharper than the runtime's box filter; both are gamma-correct, and
+//                           alpha-weighted for images with transparency.
+//   --positions half|float  half (default) stores mesh positions in 8 bytes instead of 12; use float for large models
+//                           whose coordinates need more than ~3 significant digits.
+
+
+// Peak signal-to-noise ratio of the compressed level against the source, over the channels the format keeps.
+static double psnr(const std::vector<uint8_t>& source, const std::vector<uint8_t>& decoded, int channels)
+{
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < source.size(); i += 4) {
+		for (int c = 0; c < channels; ++c) {
+			double d = (double)source[i + c] - (double)decoded[i + c];
+			sum += d * d;
+		}
+		count += channels;
+	}
+	double mse = sum / (double)count;
+	return (mse == 0.0) ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+static bool cook(const std::string& path, const std::string& formatName, MipFilter mipFilter, TileWorkers& workers)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true); // Same orientation as the runtime path, stored as KTXorientation "ru".
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4); // Always expand to RGBA8.
+	if (!pixels) {
+		std::cout << "Failed to load texture: " << path << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> level(pixels, pixels + (size_t)width * height * 4);
+	stbi_image_free(pixels);
+
+	bool opaque = true;
+	for (size_t i = 3; i < level.size() && opaque; i += 4)
+		opaque = (level[i] == 255);
+	BlockFormat format = (formatName == "bc1" || (formatName == "auto" && opaque)) ? BLOCK_FORMAT_BC1 : BLOCK_FORMAT_BC3;
+
+	KTX2Image image;
+	image.Format = (format == BLOCK_FORMAT_BC1) ? KTX2_FORMAT_BC1_RGB_UNORM : KTX2_FORMAT_BC3_UNORM;
+	image.Width = width;
+	image.Height = height;
+
+	// The mips are filtered from the uncompressed image, not from the compressed levels, so errors don't add up.
+	MipOptions mipOptions;
+	mipOptions.Filter = mipFilter;
+	mipOptions.Premultiply = !opaque;
+	mipOptions.Workers = &workers;
+	std::vector<MipLevel> mips = generateMipmaps(level.data(), width, height, 4, mipOptions);
+
+	image.Levels.push_back(compressImage(level.data(), width, height, format));
+	double levelZeroPSNR = psnr(level, decompressImage(image.Levels[0].data(), width, height, format), (format == BLOCK_FORMAT_BC1) ? 3 : 4);
+	for (const MipLevel& mip : mips)
+		image.Levels.push_back(compressImage(mip.Pixels.data(), mip.Width, mip.Height, format));
+
+	std::string outPath = cookedTexturePath(path);
+	if (!writeKTX2(outPath, image))
+		return false;
+
+	size_t compressedBytes = 0;
+	for (const std::vector<uint8_t>& data : image.Levels)
+		compressedBytes += data.size();
+	size_t uncompressedBytes = (size_t)width * height * channels * 4 / 3; // What glTexImage2D + glGenerateMipmap would keep, roughly.
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< outPath << "  " << ((format == BLOCK_FORMAT_BC1) ? "BC1" : "BC3")
+		<< "  " << width << "x" << height << "  " << image.Levels.size() << " levels"
+		<< "  " << compressedBytes / 1024 << " KiB (uncompressed " << uncompressedBytes / 1024 << " KiB)"
+		<< "  PSNR " << levelZeroPSNR << " dB"
+		<< "  " << ms << "ms" << std::endl;
+	return true;
+}
+
+// Convert an OBJ into a .rmesh: optimized triangle and vertex order, compact attributes, 16-bit indices when possible.
+static bool cookMesh(const std::string& path, VertexFormat positionFormat)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	ObjMesh obj;
+	if (!loadObj(path, obj))
+		return false;
+	if (obj.Indices.empty()) {
+		std::cout << "No triangles in " << path << std::endl;
+		return false;
+	}
+	size_t vertexCount = obj.Vertices.size() / obj.Stride;
+	VertexCacheStats before = analyzeVertexCache(obj.Indices.data(), obj.Indices.size(), vertexCount);
+	optimizeMesh(obj.Vertices, obj.Stride, obj.Indices);
+	vertexCount = obj.Vertices.size() / obj.Stride;
+	VertexCacheStats after = analyzeVertexCache(obj.Indices.data(), obj.Indices.size(), vertexCount);
+
+	float boundsMin[3] = { 1e30f, 1e30f, 1e30f }, boundsMax[3] = { -1e30f, -1e30f, -1e30f };
+	bool unitTexCoords = true; // Every uv in [0, 1]: unorm16 keeps more precision than half floats.
+	const size_t uvOffset = 3 + (obj.HasColors ? 3 : 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		const float* vertex = &obj.Vertices[v * obj.Stride];
+		for (int k = 0; k < 3; ++k) {
+			boundsMin[k] = std::min(boundsMin[k], vertex[k]);
+			boundsMax[k] = std::max(boundsMax[k], vertex[k]);
+		}
+		if (obj.HasTexCoords)
+			unitTexCoords = unitTexCoords && vertex[uvOffset] >= 0.0f && vertex[uvOffset] <= 1.0f && vertex[uvOffset + 1] >= 0.0f && vertex[uvOffset + 1] <= 1.0f;
+	}
+
+	VertexLayout layout;
+	layout.add(MESH_POSITION_LOCATION, 3, positionFormat);
+	if (obj.HasColors)
+		layout.add(MESH_COLOR_LOCATION, 3, VERTEX_UNORM8);
+	if (obj.HasTexCoords)
+		layout.add(MESH_TEXCOORD_LOCATION, 2, unitTexCoords ? VERTEX_UNORM16 : VERTEX_HALF);
+	if (obj.HasNormals)
+		layout.add(MESH_NORMAL_LOCATION, 3, VERTEX_OCT_SNORM16);
+	std::vector<uint8_t> encoded = encodeVertices(layout, obj.Vertices.data(), obj.Stride, vertexCount);
+
+	std::string outPath = cookedMeshPath(path);
+	if (!writeMeshFile(outPath, layout, encoded, vertexCount, obj.Indices, boundsMin, boundsMax))
+		return false;
+
+	size_t bytes = encoded.size() + indexSize(indexTypeFor(vertexCount)) * obj.Indices.size();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::fixed << std::setprecision(2)
+		<< outPath << "  " << vertexCount << " vertices, " << obj.Indices.size() / 3 << " triangles"
+		<< "  " << layout.Stride << " bytes per vertex, " << indexSize(indexTypeFor(vertexCount)) * 8 << "-bit indices"
+		<< "  " << bytes / 1024 << " KiB"
+		<< "  ACMR " << before.ACMR << " -> " << after.ACMR
+		<< "  " << ms << "ms" << std::endl;
+	return true;
+}
+
+// True if the path ends with the extension (".obj"), in any case.
+static bool hasExtension(const std::string& path, const char* extension)
+{
+	size_t length = std::strlen(extension);
+	if (path.size() < length)
+		return false;
+	for (size_t i = 0; i < length; ++i)
+		if (std::tolower((unsigned char)path[path.size() - length + i]) != extension[i])
+			return false;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::string format = "auto";
+	MipFilter mipFilter = MIP_FILTER_KAISER;
+	VertexFormat positionFormat = VERTEX_HALF;
+	TileWorkers workers; // Mip levels are split across every hardware thread.
+	int cooked = 0, failed = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			format = argv[++i];
+			if (format != "auto" && format != "bc1" && format != "bc3") {
+				std::cout << "Unknown format: " << format << " (auto, bc1 or bc3)" << std::endl;
+				return -1;
+			}
+			continue;
+		}
+		if (std::strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name != "kaiser" && name != "box") {
+				std::cout << "Unknown mip filter: " << name << " (kaiser or box)" << std::endl;
+				return -1;
+			}
+			mipFilter = (name == "box") ? MIP_FILTER_BOX : MIP_FILTER_KAISER;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--positions") == 0 && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name != "half" && name != "float") {
+				std::cout << "Unknown position format: " << name << " (half or float)" << std::endl;
+				return -1;
+			}
+			positionFormat = (name == "float") ? VERTEX_FLOAT : VERTEX_HALF;
+			continue;
+		}
+		bool ok = hasExtension(argv[i], ".obj") ? cookMesh(argv[i], positionFormat) : cook(argv[i], format, mipFilter, workers);
+		if (ok)
+			cooked++;
+		else
+			failed++;
+	}
+	if (cooked + failed == 0) {
+		std::cout << "Usage: regl_cook [--format auto|bc1|bc3] [--mip-filter kaiser|box] [--positions half|float] images/meshes..." << std::endl;
+		return -1;
+	}
+	return (failed == 0) ? 0 : -1;
+}
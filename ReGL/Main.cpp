@@ -2,7 +2,13 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <thread>
 
 // GLM Mathematics Library
 #include <glm/glm.hpp>
@@ -10,32 +16,81 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Dependencies/stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION // Compile stb_image only once, other headers may include it again.
 #include "Shaders/Shader.h"
+#include "Source/BVH.h"
 #include "Source/Camera.h"
-
-
-void void_framebuffer_size_callback(GLFWwindow* window, int width, int height);	// Whenever the window is resized, this callback function executes. It adjusts the viewport so that the OpenGL renders to the new window size.
+#include "Source/CommandBuffer.h"
+#include "Source/Cube.h"
+#include "Source/FixedTimestep.h"
+#include "Source/FrameExchange.h"
+#include "Source/FramePacket.h"
+#include "Source/FrameUniforms.h"
+#include "Source/GpuTimer.h"
+#include "Source/JobSystem.h"
+#include "Source/MeshFile.h"
+#include "Source/OcclusionCulling.h"
+#include "Source/Profiler.h"
+#include "Source/SoftwareRasterizer.h"
+#include "Source/StateCache.h"
+#include "Source/Texture.h"
+#include "Source/TextureLoader.h"
+#include "Source/TextureResidency.h"
+
+
+void void_framebuffer_size_callback(GLFWwindow* window, int width, int height);	// Whenever the window is resized, this callback function executes. It records the new size for the render thread.
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);				// Whenever the mouse moves, this callback function executes.
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);											// Check if the user has pressed the escape key, if so, close the window.
+void processMovement(GLFWwindow* window, float stepSeconds);					// Move the camera with WASD, once per simulation step.
 
 // Settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT; // Updated by the resize callback, sent to the render thread.
 
 // Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f)); // Create a camera object (starting position is at (0.0f, 0.0f, 3.0f)).
 float lastX = SCR_WIDTH / 2.0f; // Set the last x position of the mouse to the middle of the screen.
 float lastY = SCR_HEIGHT / 2.0f; // Set the last y position of the mouse to the middle of the screen.
 bool firstMouse = true; // Set the first mouse movement to true.
+bool cursorReleased = false; // F7 frees the cursor to pick objects under it; mouse look stops meanwhile.
+bool cursorKeyWasDown = false;
 
 
 // Timing
 float deltaTime = 0.0f; // Time between current frame and last frame.
 float lastFrame = 0.0f; // Time of last frame.
 
-
-int main() {
+// Profiler
+bool traceKeyWasDown = false; // F9 writes a Chrome trace once per press, not once per frame while it is held.
+
+// Occlusion culling
+bool showOcclusionBuffer = false; // F8 shows the occlusion buffer in the bottom left corner.
+bool occlusionKeyWasDown = false;
+
+
+int main(int argc, char** argv) {
+
+	REGL_PROFILE_THREAD("Main"); // Name of this thread in the profiler's traces.
+
+	// Rendering backend, chosen at startup: OpenGL (default) or the CPU rasterizer with --software.
+	// --mesh FILE draws a cooked .rmesh (see Cook/Cook.cpp) instead of the cube, on the OpenGL backend.
+	// --sim-hz N sets the simulation rate (default 60), --max-steps N the most simulation steps per frame (default 5).
+	bool software = false;
+	const char* meshPath = NULL;
+	double simulationHz = 60.0;
+	int maxSteps = 5;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--software") == 0)
+			software = true;
+		else if (std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+			meshPath = argv[++i];
+		else if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc)
+			simulationHz = std::max(1.0, std::atof(argv[++i]));
+		else if (std::strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc)
+			maxSteps = std::max(1, std::atoi(argv[++i]));
+	}
 
 	// Initialize GLFW
 	glfwInit(); // Initialize the GLFW library.
@@ -53,6 +108,7 @@ int main() {
 	}
 	glfwMakeContextCurrent(window); // Make the context of the specified window current on the calling thread.
 	glfwSetFramebufferSizeCallback(window, void_framebuffer_size_callback);// Set the callback function for the window resize event
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight); // In pixels, which can differ from the window size.
 	glfwSetCursorPosCallback(window, mouse_callback); // Set the callback function for the mouse movement event.
 	glfwSetScrollCallback(window, scroll_callback); // Set the callback function for the mouse scroll event.
 
@@ -66,110 +122,39 @@ int main() {
 
 	// -----------------------------
 	// configure global opengl state
-	glEnable(GL_DEPTH_TEST);
+	GLStateCache glState; // Skips binds and enables that would not change anything.
+	glState.enable(GL_DEPTH_TEST);
 
 	// ------------------------SHADERS------------------------
-	Shader myShader("Shaders/Texture.vert", "Shaders/Texture.frag"); // Create a shader object and read the vertex and fragment shader files.
-
-
-	// ------------------------VERTICES------------------------
-	// --------------------------------------
-	// Cube vertices
-	float vertices[] = {
-		// positions			// colors			// texture coords
-		// 4 vertices (front) for the cube
-		 0.5f,  0.5f, 0.5f,		1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-top right
-		 0.5f, -0.5f, 0.5f,		0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-bottom right
-		-0.5f, -0.5f, 0.5f,		0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-bottom left
-		-0.5f,  0.5f, 0.5f,		1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-top left 
-		// 4 vertices (right) for the cube
-		 0.5f,  0.5f,  0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-top right
-		 0.5f, -0.5f,  0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-bottom right
-		 0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom right
-		 0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top right
-		// 4 vertices (left) for the cube
-		-0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top left
-		-0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom left
-		-0.5f, -0.5f,  0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-bottom left
-		-0.5f,  0.5f,  0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-top left		
-		// 4 vertices (back) for the cube		 
-		 0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top right
-		 0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom right
-		-0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom left
-		-0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top left
-		// 4 vertices (top) for the cube
-		 0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top right
-		 0.5f,  0.5f,  0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-top right
-		-0.5f,  0.5f,  0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-top left
-		-0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top left
-		 // 4 vertices (bottom) for the cube
-		 0.5f, -0.5f,  0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-bottom right
-		 0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom right
-		-0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom left
-		-0.5f, -0.5f,  0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-bottom left
-	};
-	
-
-	unsigned int indices[] = {	// Instead of drawing the rectangle with 6 vertices, we can draw it with 2 triangles using 4 vertices.
-		// Front
-		0, 3, 1, // First tri
-		1, 3, 2, // Second tri
-		// Right
-		4, 7, 5, // First tri
-		5, 7, 6, // Second tri
-		// Left
-		8, 11, 9, // First tri
-		9, 11, 10, // Second tri
-		// Back
-		12, 15, 13, // First tri
-		13, 15, 14, // Second tri
-		// Top
-		16, 19, 17, // First tri
-		17, 19, 18, // Second tri
-		// Bottom
-		20, 23, 21, // First tri
-		21, 23, 22, // Second tri
-		};
-
-
-	// -------------------VBO & VAO & EBO-------------------	
-	// Vertex Buffer Object (VBO) can store a large number of vertices in the GPU's memory so we can render a large object quickly.
-	// Vertex Array Object (VAO) can store the configuration of vertex attributes (like pointers to vertex attributes in the VBO) and which VBO to use.
-	// Element Buffer Object (EBO) is a buffer, just like a vertex buffer object, that stores indices that OpenGL uses to decide what vertices to draw.
-	unsigned int VAO, VBO, EBO; // Create a VBO, VAO, and EBO.
-	glGenVertexArrays(1, &VAO); // Generate 1 vertex array object and store the resulting identifier in VAO.
-	glGenBuffers(1, &VBO); // Generate 1 buffer and store the resulting identifier in VBO.
-	glGenBuffers(1, &EBO); // Generate 1 buffer and store the resulting identifier in EBO.
-
-	glBindVertexArray(VAO); // Bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW); // Send the data to the buffer.
-	/*The fourth parameter specifies how we want the graphics card to manage the given data. This can take 3 forms:
-	GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
-	GL_STATIC_DRAW : the data is set only once and used many times.
-	GL_DYNAMIC_DRAW : the data is changed a lot and used many times.
-	*/
-
-	// Bind the EBO and send the data to the buffer.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // Bind the EBO.
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); // Send the data to the buffer.
-
-	// Specify how OpenGL should interpret the vertex data before rendering.
-	// Position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0); // Specify the vertex attributes using glVertexAttribPointer.
-	glEnableVertexAttribArray(0); // Enable the vertex attribute at location 0.
-	
-	// Color attribute
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float))); // Specify the vertex color attributes using glVertexAttribPointer.
-	glEnableVertexAttribArray(1); // Enable the vertex attribute at location 1.
-
-	// Texture attribute
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float))); // Specify the vertex texture attributes using glVertexAttribPointer.
-	glEnableVertexAttribArray(2); // Enable the vertex attribute at location 2.
-
-	// Unbind the VBO and VAO. This is good practice so we don't accidentally modify the VBO and VAO while we're not using them.
-	glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind the VBO.
-	glBindVertexArray(0); // Unbind the VAO.
+	ProgramCache programCache; // Linked program binaries from previous launches, in ShaderCache/.
+	programCache.init((GLADloadproc)glfwGetProcAddress);
+
+	// OBJECT_BLOCK: the model matrix comes from the per-draw ObjectData block of the command buffers (Source/CommandBuffer.h).
+	Shader myShader("Shaders/Texture.vert", "Shaders/Texture.frag", &programCache, "#define OBJECT_BLOCK\n"); // Create a shader object and read the vertex and fragment shader files.
+	programCache.printStats(); // Startup timing: how many programs came from the cache and how long the builds took.
+
+
+	// ------------------------CUBE------------------------
+	// The cube's vertices, indices and VBO/VAO/EBO setup live in Source/Cube.h so the benchmarks can draw the same scene.
+	// It is a Mesh (Source/Mesh.h) stored with half-float positions, 8-bit colors and 16-bit texture coordinates and indices.
+	Cube cube;
+
+	// A mesh cooked by regl_cook, mapped from disk and uploaded as it is (Source/MeshFile.h).
+	Mesh loadedMesh;
+	float meshMin[3] = { -0.5f, -0.5f, -0.5f }, meshMax[3] = { 0.5f, 0.5f, 0.5f }; // The cube's bounds unless a mesh replaces it.
+	bool drawLoadedMesh = meshPath != NULL && loadMeshFile(meshPath, loadedMesh, meshMin, meshMax);
+	if (meshPath != NULL && !drawLoadedMesh)
+		std::cout << "Failed to load mesh: " << meshPath << std::endl;
+
+	// Scene queries (Source/BVH.h): the drawn object's bounds, refit with its model matrix every frame. The draw is
+	// skipped while the camera looks away from it, and a left click picks what is under the crosshair with a ray.
+	const glm::vec3 boundsMin(meshMin[0], meshMin[1], meshMin[2]), boundsMax(meshMax[0], meshMax[1], meshMax[2]);
+	const glm::vec3 meshCenter = (boundsMin + boundsMax) * 0.5f, meshExtent = (boundsMax - boundsMin) * 0.5f;
+	const unsigned int meshObject = 0;
+	BVH sceneTree;
+	sceneTree.build(std::vector<AABB>(1, AABB::fromCenterExtent(meshCenter, meshExtent)));
+	std::vector<unsigned int> visibleObjects;
+	bool mouseWasDown = false;
 
 
 	// Wireframe & Fill modes
@@ -183,60 +168,14 @@ int main() {
 
 
 	// -------------------TEXTURE-------------------
-	// Texture 1
-	unsigned int texture1, texture2;
-	glGenTextures(1, &texture1); // Generate 1 texture and store the resulting identifier in texture.
-	glBindTexture(GL_TEXTURE_2D, texture1); // Bind the texture so that all subsequent texture commands will configure the currently bound texture.
-
-	// Texture Wrapping S,T,R (x, y, z)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // GL_REPEAT - S
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // GL_REPEAT - T
-	//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT); // GL_REPEAT - R
-	
-
-	// Texture Filtering
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // Use nearest neighbor filtering for minifying the texture.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // Use mipmaps for minifying the texture.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Use linear filtering for magnifying the texture. Mipmaps are not useful here.
-
-
-	// Load and generate the texture
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // Tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data = stbi_load("Textures/wall.jpg", &width, &height, &nrChannels, 0);
-	if (data) { // If the data is not null
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data); // Generate a 2D texture image.
-		glGenerateMipmap(GL_TEXTURE_2D); // Generate mipmaps for the currently bound texture.
-	}
-	else {
-		std::cout << "Failed to load texture1" << std::endl;
-	}
-	stbi_image_free(data); // Free the image memory.
-
-	//------------
-	// Texture 2
-	glGenTextures(1, &texture2); // Generate the second texture.
-	glBindTexture(GL_TEXTURE_2D, texture2); // Bind the second texture so subsequent texture commands will configure only the second texture.
-
-	// Texture Wrapping S,T,R (x, y, z)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // GL_REPEAT - S
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // GL_REPEAT - T
-	//glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT); // GL_REPEAT - R
-	
-	// Texture Filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // GL_LINEAR is better for downscaling.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // GL_LINEAR is better for upscaling.
-
-	// Load and generate the texture2
-	data = stbi_load("Textures/awesomeface.png", &width, &height, &nrChannels, 0);
-	if (data) {
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data); // Generate a 2D texture image.
-			glGenerateMipmap(GL_TEXTURE_2D); // Generate mipmaps for the currently bound texture.
-		}
-	else {
-		std::cout << "Failed to load texture2" << std::endl;
-	}
-	stbi_image_free(data); // Free the image memory.
+	// Images are decoded on worker threads. Until they are uploaded the textures show a grey placeholder.
+	// The decoded pixels are streamed through PBOs, at most TextureStreamer::BudgetBytes per frame.
+	TextureStreamer textureStreamer;
+	TextureLoader textureLoader(0, &textureStreamer);
+	// Textures are kept under a VRAM budget: the finest mips of textures that go unused are evicted and reloaded when needed.
+	TextureResidency textureResidency(textureLoader, 256u << 20);
+	unsigned int texture1 = textureResidency.load("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR); // Use mipmaps for minifying the texture.
+	unsigned int texture2 = textureResidency.load("Textures/awesomeface.png", GL_LINEAR); // GL_LINEAR is better for downscaling.
 
 	// Tell OpenGL for each sampler to which texture unit it belongs to (only has to be done once)
 	myShader.use(); // Use the shader program.
@@ -250,63 +189,349 @@ int main() {
 	transform = glm::rotate(transform, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate the transformation matrix by 45 degrees on the z-axis.
 	transform = glm::scale(transform, glm::vec3(0.5f, 0.5f, 0.5f)); // Scale the transformation matrix.
 
+	// Per-frame uniform buffer (view, projection, camera position, time), shared by every program that declares the FrameData block.
+	FrameUniforms frameUniforms;
+	myShader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+
+	// Draws are recorded as command buffers on the job system, sorted by key, and replayed on the render thread.
+	CommandExecutor commandExecutor;
+	myShader.bindUniformBlock("ObjectData", OBJECT_UNIFORMS_BINDING);
+	const uint32_t objectStride = commandExecutor.uniformStride(sizeof(ObjectData));
+	CommandRecorder commandRecorder; // Chunk buffers and sort memory, reused every frame.
+
+	// GPU time per pass (clear, uniforms, draw, swap), read back a few frames late so it never stalls. Printed on exit.
+	GpuTimer gpuTimer;
+
+	// Job system (Source/JobSystem.h): the threads the CPU-side frame work runs on, the main thread included. The occlusion
+	// buffer and the software rasterizer split their tiles across it; the render thread submits as an outside thread.
+	JobSystem jobs;
+
+	// Software backend: the same scene drawn on the CPU, then copied into a texture and blitted to the window.
+	SoftwareRasterizer* rasterizer = NULL;
+	SoftwareTexture softwareTexture1, softwareTexture2;
+	unsigned int presentTexture = 0, presentFBO = 0;
+	if (software) {
+		softwareTexture1.load("Textures/wall.jpg", true); // Mipmapped, like texture1.
+		softwareTexture2.load("Textures/awesomeface.png", false);
+		rasterizer = new SoftwareRasterizer(SCR_WIDTH, SCR_HEIGHT, jobs);
+		std::cout << "Software rasterizer: " << rasterizer->threadCount() << " threads" << std::endl;
+
+		glGenTextures(1, &presentTexture);
+		glBindTexture(GL_TEXTURE_2D, presentTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // No mipmaps: the texture would be incomplete otherwise.
+		glGenFramebuffers(1, &presentFBO);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, presentFBO);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, presentTexture, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glState.invalidate(); // We bound a texture behind the state cache's back.
+	}
 
-	//----------------------------------------------------
-	// RENDER LOOP
-	while (!glfwWindowShouldClose(window)) { // Check if the window should close, if not, render the next frame.
+	// Occlusion culling (Source/OcclusionCulling.h): occluders are drawn into a small CPU depth buffer every frame, and
+	// objects whose boxes are behind it are not drawn. The cube is its own occluder (a box is never hidden by what it
+	// contains); a loaded mesh has no CPU copy of its triangles, so it only gets tested.
+	OcclusionBuffer occlusion(256, 128, jobs);
+	unsigned int occlusionTexture = 0, occlusionFBO = 0; // The F8 debug view, blitted like the software backend's frames.
+	glGenTextures(1, &occlusionTexture);
+	glBindTexture(GL_TEXTURE_2D, occlusionTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, occlusion.Width, occlusion.Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glGenFramebuffers(1, &occlusionFBO);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, occlusionFBO);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, occlusionTexture, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glState.invalidate();
 
-		// Per-frame time logic
-		float currentFrame = static_cast<float>(glfwGetTime()); // Get the current time as seconds.
-		deltaTime = currentFrame - lastFrame; // Calculate the time difference between the current frame and the last frame.
-		lastFrame = currentFrame; // Set the lastFrame to the currentFrame.
 
-		// Input
-		processInput(window); // Check if the user has pressed the escape key, if so, close the window.
+	//----------------------------------------------------
+	// RENDER THREAD
+	// The main thread polls GLFW, moves the camera, culls, and describes each frame in a FramePacket (Source/FramePacket.h).
+	// The render thread owns the GL context and turns the packets into GL calls and buffer swaps. A slow swap (waiting for
+	// vsync) no longer delays input, and a frame costs max(simulation, render) instead of their sum: the main thread
+	// prepares frame N + 1 while the render thread draws frame N.
+	FrameExchange<FramePacket> frames; // Lock-free handoff of the packets.
+	std::atomic<bool> quitting(false);
+	double renderMs = 0.0; // Render thread only, read after it joined.
+
+	glfwMakeContextCurrent(NULL); // A context is current on one thread at a time: give it to the render thread.
+	std::thread renderThread([&]() {
+		REGL_PROFILE_THREAD("Render");
+		glfwMakeContextCurrent(window);
+		int viewportWidth = 0, viewportHeight = 0;
+
+		while (frames.waitForPacket(quitting)) {
+			REGL_PROFILE_ZONE("Frame");
+			uint64_t start = Profiler::steadyNanoseconds();
+			const FramePacket& packet = frames.readSlot();
+			gpuTimer.beginFrame();
+
+			if (packet.ViewportWidth != viewportWidth || packet.ViewportHeight != viewportHeight) {
+				viewportWidth = packet.ViewportWidth;
+				viewportHeight = packet.ViewportHeight;
+				glViewport(0, 0, viewportWidth, viewportHeight);
+			}
+
+			// Upload the textures the loader threads have finished decoding (this invalidates the state cache if it binds anything).
+			{
+				REGL_PROFILE_ZONE("Texture uploads");
+				textureLoader.pump(&glState);
+				textureResidency.update(&glState); // Evict or reload mips to stay within the budget.
+			}
+
+			// --software: draw the cube on the CPU, then copy the image to the window.
+			if (rasterizer) {
+				{
+					REGL_PROFILE_ZONE("Software render");
+					rasterizer->beginFrame(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+					for (const FrameDraw& draw : packet.Draws) {
+						glm::mat4 mvp = packet.Projection * packet.View * draw.Model;
+						rasterizer->drawTextured(CUBE_VERTICES, 8, 0, 6, CUBE_INDICES, cube.IndexCount, mvp, softwareTexture1, softwareTexture2, 0.25f);
+					}
+					rasterizer->endFrame();
+				}
+				{
+					REGL_GPU_ZONE(gpuTimer, "Present");
+					glBindTexture(GL_TEXTURE_2D, presentTexture);
+					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, rasterizer->Color.data()); // Rows are bottom first, like GL's.
+					glBindFramebuffer(GL_READ_FRAMEBUFFER, presentFBO);
+					glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, viewportWidth, viewportHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+					glState.invalidate();
+				}
+			}
+			else {
+				// Render
+				{
+					REGL_GPU_ZONE(gpuTimer, "Clear");
+					glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Set the color to clear the screen with.
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the screen's color and depth buffer.
+				}
+
+				// The commands bind the textures; this keeps them resident.
+				textureResidency.use(texture1);
+				textureResidency.use(texture2);
+
+
+				// Camera data (view, projection, position, time) goes into the shared uniform buffer once per frame.
+				{
+					REGL_GPU_ZONE(gpuTimer, "Uniforms");
+					frameUniforms.update(packet.View, packet.Projection, packet.CameraPosition, packet.Time, &glState);
+				}
+
+
+				// Render what survived culling: replay the commands the main thread recorded.
+				if (!packet.Commands.Commands.empty()) {
+					REGL_GPU_ZONE(gpuTimer, "Draw");
+					commandExecutor.execute(packet.Commands, glState);
+				}
+			}
+
+			// F8: the occlusion buffer, twice its size, over the bottom left corner.
+			if (packet.ShowOcclusionBuffer) {
+				REGL_GPU_ZONE(gpuTimer, "Occlusion debug view");
+				glBindTexture(GL_TEXTURE_2D, occlusionTexture);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, packet.OcclusionWidth, packet.OcclusionHeight, GL_RGBA, GL_UNSIGNED_BYTE, packet.OcclusionImage.data());
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, occlusionFBO);
+				glBlitFramebuffer(0, 0, packet.OcclusionWidth, packet.OcclusionHeight, 0, 0, packet.OcclusionWidth * 2, packet.OcclusionHeight * 2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+				glState.invalidate();
+			}
+
+			renderMs += (double)(Profiler::steadyNanoseconds() - start) / 1e6; // Without waiting for packets, with the swap.
+			{
+				REGL_GPU_ZONE(gpuTimer, "SwapBuffers"); // The CPU side includes waiting for the GPU and for vsync.
+				glfwSwapBuffers(window); // Swap the front and back buffers so the user can see the output.
+			}
+			gpuTimer.endFrame();
+		}
+		glfwMakeContextCurrent(NULL);
+	});
 
-		// Render
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Set the color to clear the screen with.
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the screen's color and depth buffer.
 
-		// Bind the textures
-		glActiveTexture(GL_TEXTURE0); // Activate the texture unit first before binding the texture.
-		glBindTexture(GL_TEXTURE_2D, texture1); // Bind the texture so that all subsequent texture commands will configure the currently bound texture.
-		glActiveTexture(GL_TEXTURE1); // Activate the texture unit first before binding the texture.
-		glBindTexture(GL_TEXTURE_2D, texture2); // Bind the texture so that all subsequent texture commands will configure the currently bound texture.
+	//----------------------------------------------------
+	// SIMULATION
+	// Camera movement and the cube's rotation advance in fixed steps (Source/FixedTimestep.h), so they behave the same at
+	// any frame rate. Frames are drawn between the last two steps: the camera position and the rotation angle are
+	// interpolated. Mouse look and zoom are not simulated: they apply as soon as the events arrive, to not lag behind.
+	struct SimulationState
+	{
+		glm::vec3 CameraPosition;
+		float ModelAngle; // Radians around (0.5, 1, 0).
+	};
+	FixedTimestep timestep(simulationHz, maxSteps);
+	SimulationState currentState = { camera.Position, 0.0f };
+	SimulationState previousState = currentState;
 
 
-		// Draw the rectangle
-		myShader.use(); // Use the shader program.
+	//----------------------------------------------------
+	// MAIN LOOP
+	double simulationMs = 0.0;
+	uint64_t frameNumber = 0;
+	lastFrame = static_cast<float>(glfwGetTime()); // Loading time is not simulated.
+	while (!glfwWindowShouldClose(window)) { // Check if the window should close, if not, prepare the next frame.
+
+		REGL_PROFILE_ZONE("Frame"); // CPU time of the whole iteration, the zones below split it up.
+		uint64_t frameStart = Profiler::steadyNanoseconds();
+		{
+			REGL_PROFILE_ZONE("PollEvents");
+			glfwPollEvents(); // Check if any events are triggered (like keyboard input or mouse movement events).
+		}
 
+		// Per-frame time logic
+		float currentFrame = static_cast<float>(glfwGetTime()); // Get the current time as seconds.
+		deltaTime = currentFrame - lastFrame; // Calculate the time difference between the current frame and the last frame.
+		lastFrame = currentFrame; // Set the lastFrame to the currentFrame.
 
-		// Projection matrix
-		glm::mat4 projectin = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f); // Create a projection matrix.
-		myShader.setMat4("projection", projectin); // Set the projection matrix in the shader.
-		// Camera/view	formation
-		glm::mat4 view = camera.GetViewMatrix(); // Create a view matrix.
-		myShader.setMat4("view", view); // Set the view matrix in the shader.
+		// Simulation steps due this frame, then the state to draw, in between the last two.
+		{
+			REGL_PROFILE_ZONE("Simulation");
+			int steps = timestep.advance(deltaTime);
+			for (int step = 0; step < steps; ++step) {
+				previousState = currentState;
+				camera.Position = currentState.CameraPosition;
+				processMovement(window, (float)timestep.StepSeconds);
+				currentState.CameraPosition = camera.Position;
+				currentState.ModelAngle += (float)timestep.StepSeconds * glm::radians(50.0f);
+			}
+			camera.Position = glm::mix(previousState.CameraPosition, currentState.CameraPosition, timestep.alpha());
+		}
+		const float alpha = timestep.alpha();
+		const float drawTime = (float)(timestep.time() - (1.0 - alpha) * timestep.StepSeconds); // Simulated time of the drawn state.
+
+		// Input
+		{
+			REGL_PROFILE_ZONE("Input");
+			processInput(window); // Check if the user has pressed the escape key, if so, close the window.
+
+			// Picking: through the cursor when it is released (F7), else through the screen center, along Front.
+			bool mouseDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+			if (mouseDown && !mouseWasDown) {
+				glm::vec3 direction = camera.Front;
+				int windowWidth, windowHeight;
+				glfwGetWindowSize(window, &windowWidth, &windowHeight); // Cursor positions are in window coordinates, not pixels.
+				if (cursorReleased && windowWidth > 0 && windowHeight > 0) {
+					double cursorX, cursorY;
+					glfwGetCursorPos(window, &cursorX, &cursorY);
+					direction = camera.GetRayDirection((float)cursorX, (float)cursorY, (float)windowWidth, (float)windowHeight);
+				}
+				RayHit hit;
+				if (sceneTree.raycast(camera.Position, direction, 100.0f, hit))
+					std::cout << "Picked object " << hit.Object << " at distance " << hit.Distance << std::endl;
+			}
+			mouseWasDown = mouseDown;
+		}
 
 		// Model matrix
 		glm::mat4 model = glm::mat4(1.0f); // Initialize the model matrix as the identity matrix.
-		model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f)); // Rotate the model matrix.
-		myShader.setMat4("model", model); // Set the model matrix in the shader.
-
+		float modelAngle = previousState.ModelAngle + (currentState.ModelAngle - previousState.ModelAngle) * alpha;
+		model = glm::rotate(model, modelAngle, glm::vec3(0.5f, 1.0f, 0.0f)); // Rotate the model matrix.
+		const float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+
+		// Move the object's box in the tree, then cull against the camera's cached frustum.
+		{
+			glm::vec3 worldCenter, worldExtent;
+			transformBox(model, meshCenter, meshExtent, worldCenter, worldExtent);
+			sceneTree.update(meshObject, AABB::fromCenterExtent(worldCenter, worldExtent));
+			sceneTree.refit();
+			sceneTree.cullFrustum(camera.GetFrustum(aspect), visibleObjects);
+		}
 
-		// Render
-		glBindVertexArray(VAO); // Bind the VAO.
-		glDrawElements(GL_TRIANGLES, sizeof(indices) / sizeof(indices[0]), GL_UNSIGNED_INT, 0); // Draw the rectangle using the VAO and EBO.
-		glBindVertexArray(0); // Unbind the VAO.
+		// Then drop what is behind the occluders.
+		{
+			occlusion.beginFrame(camera.GetProjectionMatrix(aspect) * camera.GetViewMatrix());
+			if (!drawLoadedMesh)
+				occlusion.addOccluder(CUBE_VERTICES, 8, CUBE_INDICES, cube.IndexCount, model);
+			occlusion.rasterize();
+			occlusion.filter(sceneTree.Bounds, visibleObjects);
+		}
 
+		// Describe the frame for the render thread.
+		{
+			REGL_PROFILE_ZONE("Frame packet");
+			FramePacket& packet = frames.writeSlot();
+			packet.Frame = frameNumber++;
+			packet.Time = drawTime;
+			packet.ViewportWidth = framebufferWidth;
+			packet.ViewportHeight = framebufferHeight;
+			packet.View = camera.GetViewMatrix();
+			packet.Projection = camera.GetProjectionMatrix(aspect);
+			packet.CameraPosition = camera.Position;
+			packet.Draws.clear();
+			for (unsigned int object : visibleObjects) {
+				FrameDraw draw;
+				draw.Object = object;
+				draw.Model = model;
+				packet.Draws.push_back(draw);
+			}
+
+			// Record one draw command per visible object, spread over the job system, into the packet's command buffer.
+			{
+				REGL_PROFILE_ZONE("Record commands");
+				const Mesh* mesh = drawLoadedMesh ? &loadedMesh : &cube;
+				const DrawCommand command = CommandBuffer::meshCommand(0, myShader.ID, *mesh, texture1, texture2);
+				commandRecorder.record(jobs, (int)packet.Draws.size(), objectStride, packet.Commands,
+					[&](int i, CommandBuffer& buffer) {
+						// Opaque, grouped by program and textures, then front to back (100 is the far plane).
+						DrawCommand draw = command;
+						float depth = glm::dot(glm::vec3(packet.Draws[i].Model[3]) - camera.Position, camera.Front) / 100.0f;
+						draw.Key = drawSortKey(0, false, myShader.ID, 0, depth);
+						ObjectData object = { packet.Draws[i].Model };
+						buffer.draw(draw, object);
+					});
+			}
+
+			packet.ShowOcclusionBuffer = showOcclusionBuffer;
+			if (showOcclusionBuffer) {
+				occlusion.debugImage(packet.OcclusionImage);
+				packet.OcclusionWidth = occlusion.Width;
+				packet.OcclusionHeight = occlusion.Height;
+			}
+		}
+		simulationMs += (double)(Profiler::steadyNanoseconds() - frameStart) / 1e6;
 
-		glfwSwapBuffers(window); // Swap the front and back buffers so the user can see the output.
-		glfwPollEvents(); // Check if any events are triggered (like keyboard input or mouse movement events).
-	
+		// Hand it over, and don't get more than one frame ahead: wait until the render thread has started on it.
+		frames.publish();
+		{
+			REGL_PROFILE_ZONE("Wait for render thread");
+			frames.waitUntilTaken(quitting);
+		}
 	}
 
+	quitting = true;
+	renderThread.join();
+	glfwMakeContextCurrent(window); // Back to the main thread for the cleanup.
+
+
+	timestep.printStats();
+	std::cout << std::fixed << std::setprecision(3) << "Threads: " << frames.Acquired << " frames, simulation avg "
+		<< simulationMs / std::max<uint64_t>(frames.Published, 1) << "ms, render avg " << renderMs / std::max<uint64_t>(frames.Acquired, 1)
+		<< "ms, " << frames.Dropped << " packets dropped" << std::endl;
+	glState.printStats(); // How many redundant state changes were skipped over the whole run.
+	gpuTimer.flush();
+	gpuTimer.report("gpu/"); // Average GPU and CPU time per pass.
+	textureResidency.printStats(); // Resident bytes, evictions and reload latency.
+	sceneTree.printStats(); // Objects visible and culled per frame.
+	occlusion.printStats(); // Objects occluded per frame, raster and test time.
+	jobs.printStats();
+	commandExecutor.printStats();
+	commandRecorder.printStats(); // State changes per frame before and after sorting.
 
 	// De-allocate all resources once they've outlived their purpose.
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
+	textureLoader.shutdown(); // Stop the loader threads before the PBOs they write to go away.
+	textureStreamer.cleanup();
+	cube.cleanup();
+	loadedMesh.cleanup();
+	frameUniforms.cleanup();
+	commandExecutor.cleanup();
+	gpuTimer.cleanup();
+	textureResidency.cleanup(); // Deletes texture1 and texture2.
+	glDeleteFramebuffers(1, &occlusionFBO);
+	glDeleteTextures(1, &occlusionTexture);
+	if (rasterizer) {
+		delete rasterizer;
+		glDeleteFramebuffers(1, &presentFBO);
+		glDeleteTextures(1, &presentTexture);
+	}
 
 
 	// Clean up
@@ -322,27 +547,56 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // F9 writes the last frames of every thread's profiler zones as a Chrome trace (open it in chrome://tracing).
+    bool traceKeyDown = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (traceKeyDown && !traceKeyWasDown)
+        Profiler::instance().writeChromeTrace("regl_trace.json");
+    traceKeyWasDown = traceKeyDown;
+
+    // F7 releases the cursor for picking, or captures it again for mouse look.
+    bool cursorKeyDown = glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS;
+    if (cursorKeyDown && !cursorKeyWasDown) {
+        cursorReleased = !cursorReleased;
+        glfwSetInputMode(window, GLFW_CURSOR, cursorReleased ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+        firstMouse = true; // The cursor jumps when it is captured again: don't turn the camera by that.
+    }
+    cursorKeyWasDown = cursorKeyDown;
+
+    // F8 toggles the occlusion buffer debug view.
+    bool occlusionKeyDown = glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS;
+    if (occlusionKeyDown && !occlusionKeyWasDown)
+        showOcclusionBuffer = !showOcclusionBuffer;
+    occlusionKeyWasDown = occlusionKeyDown;
+}
+
+// Camera movement is part of the simulation: it runs once per fixed step, with the step's length, not the frame's.
+void processMovement(GLFWwindow* window, float stepSeconds)
+{
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        camera.ProcessKeyboard(FORWARD, stepSeconds);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        camera.ProcessKeyboard(BACKWARD, stepSeconds);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        camera.ProcessKeyboard(LEFT, stepSeconds);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        camera.ProcessKeyboard(RIGHT, stepSeconds);
 }
 
 //-----------------------------------------------------------
 // CALLBACK FUNCTIONS
 // glfw: Framebuffer size callback
 void void_framebuffer_size_callback(GLFWwindow* window, int width, int height)
-{		// Whenever the window is resized, this callback function executes. It adjusts the viewport so that the OpenGL renders to the new window size.
-		glViewport(0, 0, width, height);
+{		// Whenever the window is resized, this callback function executes. The render thread adjusts the viewport to the new size (FramePacket::ViewportWidth/Height).
+		framebufferWidth = width;
+		framebufferHeight = height;
 }
 
 // glfw: Mouse callback
 void mouse_callback(GLFWwindow* window, double xPos, double yPos)
 {		// Whenever the mouse moves, this callback function executes.
+	if (cursorReleased)
+		return; // The cursor is for picking now, not for looking around.
+
 	float xpos = static_cast<float>(xPos);
 	float ypos = static_cast<float>(yPos);
 
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// GL_ARB_get_program_binary (core in 4.1). Our GLAD loader is generated for gl=3.3 without extensions,
+// so the enums and entry points are declared here and loaded by ProgramCache::init().
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP ReGLGetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ReGLProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ReGLProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of the shader sources, the defines and the driver (vendor, renderer, version),
+// so a driver update or an edited shader simply misses and the Shader falls back to a full compile.
+class ProgramCache
+{
+public:
+	bool Enabled;          // False if the driver does not support program binaries; every lookup then misses.
+	std::string Directory; // Where the binaries are stored, one file per program.
+
+	// Startup statistics
+	unsigned int Hits;
+	unsigned int Misses;
+	double HitMs;  // Total time spent building programs that were loaded from the cache.
+	double MissMs; // Total time spent building programs that had to be compiled.
+
+	ProgramCache(const std::string& directory = "ShaderCache")
+		: Enabled(false), Directory(directory), Hits(0), Misses(0), HitMs(0.0), MissMs(0.0),
+		getProgramBinary(NULL), programBinary(NULL), programParameteri(NULL)
+	{
+	}
+
+	// Load the entry points and check for driver support. Call once after GLAD has been loaded,
+	// with the same loader (glfwGetProcAddress, eglGetProcAddress, ...).
+	bool init(GLADloadproc load)
+	{
+		getProgramBinary = (ReGLGetProgramBinaryProc)load("glGetProgramBinary");
+		programBinary = (ReGLProgramBinaryProc)load("glProgramBinary");
+		programParameteri = (ReGLProgramParameteriProc)load("glProgramParameteri");
+
+		GLint formats = 0;
+		if (getProgramBinary && programBinary && programParameteri)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		Enabled = formats > 0;
+		if (!Enabled) {
+			std::cout << "Program binary cache disabled: no program binary formats supported by the driver" << std::endl;
+			return false;
+		}
+
+		// Everything the driver may change between runs goes into the key.
+		driverId = std::string((const char*)glGetString(GL_VENDOR)) + "|" +
+			(const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+#ifdef _WIN32
+		_mkdir(Directory.c_str());
+#else
+		mkdir(Directory.c_str(), 0755);
+#endif
+		return true;
+	}
+
+	// Key of a program built from these sources and defines with the current driver.
+	uint64_t key(const std::string& vertexCode, const std::string& fragmentCode, const std::string& defines) const
+	{
+		uint64_t hash = 14695981039346656037ULL; // FNV-1a 64
+		hash = fnv1a(hash, driverId);
+		hash = fnv1a(hash, defines);
+		hash = fnv1a(hash, vertexCode);
+		hash = fnv1a(hash, fragmentCode);
+		return hash;
+	}
+
+	// Must be called on a new program before glLinkProgram so the driver keeps a retrievable binary.
+	void prepare(GLuint program) const
+	{
+		if (Enabled)
+			programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Try to load the binary for `key` into `program`. Returns true if the program is now linked and ready to use.
+	// A missing file, a corrupt file or a binary rejected by the driver all count as a miss.
+	bool load(uint64_t key, GLuint program) const
+	{
+		if (!Enabled)
+			return false;
+
+		std::ifstream file(path(key).c_str(), std::ios::binary);
+		if (!file)
+			return false;
+
+		BinaryHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || header.Magic != MAGIC || header.Key != key || header.Length == 0)
+			return false;
+		// The file is the header and exactly Length bytes: check before allocating, a corrupt Length could ask for 4 GiB.
+		std::streamoff start = file.tellg();
+		file.seekg(0, std::ios::end);
+		std::streamoff remaining = file.tellg() - start;
+		if (start < 0 || remaining != (std::streamoff)header.Length)
+			return false;
+		file.seekg(start);
+		std::vector<char> binary(header.Length);
+		if (!file.read(binary.data(), header.Length))
+			return false;
+
+		programBinary(program, header.Format, binary.data(), (GLsizei)header.Length);
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success); // The driver rejects binaries from another driver version.
+		return success == GL_TRUE;
+	}
+
+	// Write the binary of a freshly linked program to disk.
+	void store(uint64_t key, GLuint program) const
+	{
+		if (!Enabled)
+			return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		BinaryHeader header;
+		header.Magic = MAGIC;
+		header.Format = 0;
+		header.Key = key;
+		GLsizei written = 0;
+		getProgramBinary(program, length, &written, &header.Format, binary.data());
+		header.Length = (uint32_t)written;
+
+		std::ofstream file(path(key).c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << path(key) << std::endl;
+			return;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), written);
+	}
+
+	// Called by Shader after every build, to account the time against a hit or a miss.
+	void record(bool hit, double ms)
+	{
+		if (hit) {
+			Hits++;
+			HitMs += ms;
+		}
+		else {
+			Misses++;
+			MissMs += ms;
+		}
+	}
+
+	void printStats() const
+	{
+		std::cout << std::fixed << std::setprecision(3)
+			<< "Program cache: " << Hits << " hits (" << HitMs << " ms), "
+			<< Misses << " misses (" << MissMs << " ms)" << std::endl;
+	}
+
+private:
+	static const uint32_t MAGIC = 0x42474552; // "REGB"
+
+	struct BinaryHeader
+	{
+		uint32_t Magic;
+		GLenum Format;
+		uint64_t Key;
+		uint32_t Length;
+		uint32_t Reserved = 0;
+	};
+
+	std::string driverId;
+	ReGLGetProgramBinaryProc getProgramBinary;
+	ReGLProgramBinaryProc programBinary;
+	ReGLProgramParameteriProc programParameteri;
+
+	static uint64_t fnv1a(uint64_t hash, const std::string& text)
+	{
+		for (size_t i = 0; i < text.size(); ++i) {
+			hash ^= (unsigned char)text[i];
+			hash *= 1099511628211ULL;
+		}
+		hash ^= 0xff; // Separator, so ("ab", "c") and ("a", "bc") hash differently.
+		hash *= 1099511628211ULL;
+		return hash;
+	}
+
+	std::string path(uint64_t key) const
+	{
+		std::ostringstream name;
+		name << Directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+		return name.str();
+	}
+};
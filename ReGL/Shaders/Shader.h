@@ -1,11 +1,17 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+#include "ProgramCache.h"
 
 
 class Shader
@@ -14,9 +20,13 @@ public:
 	// The program ID
 	unsigned int ID;
 
-	// The constructor reads and builds the shader
-	Shader(const char* vertexPath, const char* fragmentPath) // Shader constructor that reads and builds the shader.
+	// The constructor reads and builds the shader.
+	// cache (optional) loads a previously linked binary instead of compiling, and stores the result on a miss.
+	// defines (optional) is GLSL inserted right after the #version line of both stages, e.g. "#define INSTANCED\n".
+	Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache = NULL, const std::string& defines = "") // Shader constructor that reads and builds the shader.
 	{
+		std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+
 		// 1. Retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
@@ -48,35 +58,28 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-
-		// 2. Compile shaders
-		unsigned int vertex, fragment;
-
-		// Vertex Shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL); // Attach the vertex shader source code to the vertex shader object
-		glCompileShader(vertex); // Compile the shader
-		checkCompileErrors(vertex, "VERTEX");
+		vertexCode = injectDefines(vertexCode, defines);
+		fragmentCode = injectDefines(fragmentCode, defines);
 
-		// Fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL); // Attach the fragment shader source code to the fragment shader object
-		glCompileShader(fragment); // Compile the shader
-		checkCompileErrors(fragment, "FRAGMENT");
-
-		// Shader Program
+		// 2. Try the program binary cache first
 		ID = glCreateProgram(); // Create a shader program
-		glAttachShader(ID, vertex); // Attach the vertex shader to the shader program
-		glAttachShader(ID, fragment); // Attach the fragment shader to the shader program
-		glLinkProgram(ID); // Link the shader program
-		checkCompileErrors(ID, "PROGRAM");
+		uint64_t cacheKey = 0;
+		bool cached = false;
+		if (cache != NULL)
+		{
+			cacheKey = cache->key(vertexCode, fragmentCode, defines);
+			cached = cache->load(cacheKey, ID);
+		}
 
-		// Delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
+		// 3. Cache miss: compile and link from source
+		if (!cached)
+			compileAndLink(vertexCode, fragmentCode, cache, cacheKey);
+
+		if (cache != NULL)
+			cache->record(cached, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count());
 
+		// Look up every active uniform once, so setting uniforms never has to ask the driver again.
+		reflectUniforms();
 	}
 
 	// /activate the shader
@@ -86,25 +89,65 @@ public:
 	}
 
 
+	// Connect a uniform block of this program (e.g. "FrameData") to a uniform buffer binding point.
+	// Does nothing if the program does not use the block. GLSL 3.30 has no layout(binding), so this is done from the CPU side.
+	void bindUniformBlock(const char* blockName, unsigned int binding) const
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, blockIndex, binding);
+	}
+
+	// Returns the location of an active uniform from the table built after linking, or -1 if the program has no such uniform.
+	// Fetch locations once (outside the render loop) and pass them to the location-based setters below.
+	GLint getUniformLocation(const std::string& name) const
+	{
+		std::unordered_map<std::string, GLint>::const_iterator it = uniformLocations.find(name);
+		return (it != uniformLocations.end()) ? it->second : -1; // -1 is silently ignored by glUniform*, just like an unknown name.
+	}
+
+
 	// Utility uniform functions{
+	// Location-based setters. These go straight to glUniform* without any lookup.
+	void setBool(GLint location, bool value) const
+	{
+		glUniform1i(location, (int)value);
+	}
+
+	void setInt(GLint location, int value) const
+	{
+		glUniform1i(location, value);
+	}
+
+	void setFloat(GLint location, float value) const
+	{
+		glUniform1f(location, value);
+	}
+
+	void setMat4(GLint location, const glm::mat4& mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	// Name-based setters. These look the location up in the cached table instead of calling glGetUniformLocation.
 	void setBool(const std::string& name, bool value) const // This function is used to set a boolean uniform in the shader.
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		setBool(getUniformLocation(name), value);
 	}
 
 	void setInt(const std::string &name, int value) const // This function is used to set an integer uniform in the shader.
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(getUniformLocation(name), value);
 	}
 	void setFloat(const std::string &name, float value) const // This function is used to set a float uniform in the shader.
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(getUniformLocation(name), value);
 	}
 
 	// This function is used to set a 4x4 matrix uniform in the shader.
 	void setMat4(const std::string& name, const glm::mat4& mat) const 
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat4(getUniformLocation(name), mat);
 	}
 
 
@@ -113,12 +156,95 @@ public:
 // 2. The use() function is used to set the current shader program to be the one that is used.
 // 3. The setBool(), setInt(), and setFloat() functions are used to set a boolean, integer, and float uniform in the shader, respectively. 
 //	  We do this because we cannot directly modify the uniforms in the shader. We have to use these functions to do so./
+// 4. All uniform locations are queried once after linking (reflectUniforms). Use getUniformLocation() to get a location
+//	  and the setters that take a GLint in hot loops; the std::string setters only do a hash table lookup.
+// 5. With a ProgramCache, the linked program binary is saved to disk and reloaded on the next launch, skipping compilation.
 
 // we need set functions to set the values of the uniforms in the shader.
 // These uniforms are used to pass data from the CPU to the GPU.
 
 
 private: 
+	std::unordered_map<std::string, GLint> uniformLocations; // Uniform name -> location, filled once after linking.
+
+	// Query all active uniforms of the linked program (glGetActiveUniform) and store their locations.
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::string name(maxLength > 0 ? maxLength : 1, '\0');
+		for (GLint i = 0; i < count; ++i)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			std::string uniformName(name.data(), length);
+
+			GLint location = glGetUniformLocation(ID, uniformName.c_str());
+			if (location < 0)
+				continue; // Uniforms inside uniform blocks have no location.
+			uniformLocations[uniformName] = location;
+
+			// Arrays are reported as "name[0]", but should also be reachable as "name".
+			size_t bracket = uniformName.find('[');
+			if (bracket != std::string::npos)
+				uniformLocations[uniformName.substr(0, bracket)] = location;
+		}
+	}
+
+	// Compile both stages and link them into ID.
+	void compileAndLink(const std::string& vertexCode, const std::string& fragmentCode, ProgramCache* cache, uint64_t cacheKey)
+	{
+		const char* vShaderCode = vertexCode.c_str();
+		const char* fShaderCode = fragmentCode.c_str();
+
+		unsigned int vertex, fragment;
+
+		// Vertex Shader
+		vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL); // Attach the vertex shader source code to the vertex shader object
+		glCompileShader(vertex); // Compile the shader
+		checkCompileErrors(vertex, "VERTEX");
+
+		// Fragment Shader
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL); // Attach the fragment shader source code to the fragment shader object
+		glCompileShader(fragment); // Compile the shader
+		checkCompileErrors(fragment, "FRAGMENT");
+
+		// Shader Program
+		if (cache != NULL)
+			cache->prepare(ID); // Ask the driver to keep a retrievable binary.
+		glAttachShader(ID, vertex); // Attach the vertex shader to the shader program
+		glAttachShader(ID, fragment); // Attach the fragment shader to the shader program
+		glLinkProgram(ID); // Link the shader program
+		checkCompileErrors(ID, "PROGRAM");
+
+		// Delete the shaders as they're linked into our program now and no longer necessary
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+
+		// Save the linked binary for the next launch
+		GLint linked = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+		if (cache != NULL && linked)
+			cache->store(cacheKey, ID);
+	}
+
+	// Insert the defines after the first line of the source (the #version directive must stay first).
+	static std::string injectDefines(const std::string& code, const std::string& defines)
+	{
+		if (defines.empty())
+			return code;
+		size_t lineEnd = code.find('\n');
+		if (lineEnd == std::string::npos)
+			return code + "\n" + defines;
+		return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+	}
+
 	// Utility function for checking shader compilation/linking errors.
 	void checkCompileErrors(GLuint shader, std::string type)
 	{
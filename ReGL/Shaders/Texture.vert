@@ -2,19 +2,45 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
+#ifdef INSTANCED
+layout (location = 3) in mat4 aInstanceModel; // Per-instance model matrix (locations 3-6), see Source/InstanceBuffer.h.
+#endif
 
 out vec3 myColor;
 out vec2 TexCoord;
 
+// Per-frame camera data, shared by all programs (see Source/FrameUniforms.h).
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+#ifdef OBJECT_BLOCK
+// Per-draw data, a range of one buffer holding every draw's block (see Source/CommandBuffer.h).
+layout (std140) uniform ObjectData
+{
+    mat4 objectModel;
+};
+#endif
+
 uniform mat4 transform;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 modelMatrix = aInstanceModel;
+#elif defined(OBJECT_BLOCK)
+    mat4 modelMatrix = objectModel;
+#else
+    mat4 modelMatrix = model;
+#endif
     gl_Position = transform * vec4(aPos, 1.0);
-    gl_Position += projection * view * model * vec4(aPos, 1.0);
+    gl_Position += viewProjection * modelMatrix * vec4(aPos, 1.0);
     myColor = aColor;
     TexCoord = vec2(aTexCoord.x, aTexCoord.y);
 }
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "Frustum.h"
+#include "Profiler.h"
+
+
+// Bounding volume hierarchy over object bounding boxes, for the queries the render loop and the game need on many
+// objects: frustum culling, ray casts (picking) and box overlap.
+//
+// build() sorts the objects into a binary tree with the surface area heuristic. Objects that move call update() with
+// their new box and refit() grows or shrinks the boxes on the path from their leaf to the root, which is much cheaper
+// than a rebuild but keeps the tree's shape: once objects have moved far, the boxes overlap more and queries slow down.
+// sahCost() / BuildCost says how much; rebuild when it gets large (1.5 or so).
+//
+//   BVH tree;
+//   tree.build(boxes);
+//   ...
+//   tree.update(cube, cubeBoxThisFrame);
+//   tree.refit();
+//   tree.cullFrustum(camera.GetFrustum(aspect), visible);
+//
+// The objects under any node are a contiguous range of Objects, so a node entirely inside the frustum (or the query box)
+// adds its whole range without looking at its children.
+
+const unsigned int BVH_MAX_LEAF_SIZE = 8; // Leaves never hold more objects than this.
+const int BVH_SAH_BINS = 16;              // Candidate split planes per axis during the build.
+const float BVH_TRAVERSAL_COST = 1.0f;    // Cost of visiting a node, relative to testing one object.
+
+struct AABB
+{
+	glm::vec3 Min, Max;
+
+	AABB() : Min(FLT_MAX), Max(-FLT_MAX) {} // Empty: growing it by anything gives that thing.
+	AABB(const glm::vec3& min, const glm::vec3& max) : Min(min), Max(max) {}
+
+	static AABB fromCenterExtent(const glm::vec3& center, const glm::vec3& extent) { return AABB(center - extent, center + extent); }
+
+	void grow(const AABB& other) { Min = glm::min(Min, other.Min); Max = glm::max(Max, other.Max); }
+	void grow(const glm::vec3& point) { Min = glm::min(Min, point); Max = glm::max(Max, point); }
+
+	glm::vec3 center() const { return (Min + Max) * 0.5f; }
+	glm::vec3 extent() const { return (Max - Min) * 0.5f; }
+
+	float surfaceArea() const
+	{
+		glm::vec3 size = Max - Min;
+		return (size.x < 0.0f) ? 0.0f : 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool overlaps(const AABB& other) const
+	{
+		return Min.x <= other.Max.x && Max.x >= other.Min.x && Min.y <= other.Max.y && Max.y >= other.Min.y
+			&& Min.z <= other.Max.z && Max.z >= other.Min.z;
+	}
+
+	bool contains(const AABB& other) const
+	{
+		return Min.x <= other.Min.x && Max.x >= other.Max.x && Min.y <= other.Min.y && Max.y >= other.Max.y
+			&& Min.z <= other.Min.z && Max.z >= other.Max.z;
+	}
+
+	bool operator==(const AABB& other) const { return Min == other.Min && Max == other.Max; }
+};
+
+struct BVHNode
+{
+	AABB Bounds;
+	int Left;                   // First child, the second one is Left + 1. -1 for a leaf.
+	int Parent;                 // -1 for the root.
+	unsigned int First, Count;  // The range of Objects under this node.
+
+	bool isLeaf() const { return Left < 0; }
+};
+
+// The closest object a ray hit.
+struct RayHit
+{
+	unsigned int Object;
+	float Distance; // Along the ray direction, in units of its length, to the object's box.
+};
+
+// What one query did.
+struct BVHStats
+{
+	size_t NodesVisited = 0, ObjectsTested = 0, Results = 0;
+	double Ms = 0.0;
+};
+
+class BVH
+{
+public:
+	std::vector<BVHNode> Nodes;        // Nodes[0] is the root.
+	std::vector<unsigned int> Objects; // Object indices, in leaf order.
+	std::vector<AABB> Bounds;          // Per object, as given to build() and update().
+	float BuildCost = 0.0f;            // sahCost() right after build().
+
+	// The last cullFrustum(), and totals over all of them, for printStats().
+	BVHStats Last;
+	uint64_t Frames = 0, TotalVisible = 0, TotalNodesVisited = 0;
+	double TotalMs = 0.0;
+
+	size_t objectCount() const { return Bounds.size(); }
+
+	// Build the tree over `bounds` (object i is bounds[i]) with binned SAH splits. Replaces everything.
+	void build(const std::vector<AABB>& bounds)
+	{
+		REGL_PROFILE_ZONE("BVH build");
+		Bounds = bounds;
+		const unsigned int count = (unsigned int)Bounds.size();
+		Objects.resize(count);
+		for (unsigned int i = 0; i < count; ++i)
+			Objects[i] = i;
+		leafOf.assign(count, 0);
+		Nodes.clear();
+		dirtyLeaves.clear();
+		dirty.clear();
+		BuildCost = 0.0f;
+		if (count == 0)
+			return;
+
+		Nodes.reserve(2 * (count / 2 + 1));
+		std::vector<glm::vec3> centers(count);
+		for (unsigned int i = 0; i < count; ++i)
+			centers[i] = Bounds[i].center();
+
+		BVHNode root;
+		root.Left = -1;
+		root.Parent = -1;
+		root.First = 0;
+		root.Count = count;
+		Nodes.push_back(root);
+
+		std::vector<int> pending(1, 0);
+		while (!pending.empty()) {
+			int index = pending.back();
+			pending.pop_back();
+			unsigned int first = Nodes[index].First, nodeCount = Nodes[index].Count;
+
+			AABB nodeBounds, centerBounds;
+			for (unsigned int i = first; i < first + nodeCount; ++i) {
+				nodeBounds.grow(Bounds[Objects[i]]);
+				centerBounds.grow(centers[Objects[i]]);
+			}
+			Nodes[index].Bounds = nodeBounds;
+			if (nodeCount == 1)
+				continue;
+
+			// Best split plane: bin the object centers along each axis and sweep the bins from both sides.
+			int bestAxis = -1, bestBin = 0;
+			float bestCost = FLT_MAX;
+			for (int axis = 0; axis < 3; ++axis) {
+				float low = centerBounds.Min[axis], high = centerBounds.Max[axis];
+				if (high <= low)
+					continue;
+				float scale = BVH_SAH_BINS / (high - low);
+				AABB binBounds[BVH_SAH_BINS];
+				unsigned int binCount[BVH_SAH_BINS] = {};
+				for (unsigned int i = first; i < first + nodeCount; ++i) {
+					int bin = std::min((int)((centers[Objects[i]][axis] - low) * scale), BVH_SAH_BINS - 1);
+					binBounds[bin].grow(Bounds[Objects[i]]);
+					binCount[bin]++;
+				}
+				float rightArea[BVH_SAH_BINS];
+				unsigned int rightCount[BVH_SAH_BINS];
+				AABB right;
+				unsigned int rightTotal = 0;
+				for (int bin = BVH_SAH_BINS - 1; bin > 0; --bin) {
+					right.grow(binBounds[bin]);
+					rightTotal += binCount[bin];
+					rightArea[bin] = right.surfaceArea();
+					rightCount[bin] = rightTotal;
+				}
+				AABB left;
+				unsigned int leftTotal = 0;
+				for (int bin = 1; bin < BVH_SAH_BINS; ++bin) { // Split between bin - 1 and bin.
+					left.grow(binBounds[bin - 1]);
+					leftTotal += binCount[bin - 1];
+					if (leftTotal == 0 || rightCount[bin] == 0)
+						continue;
+					float cost = left.surfaceArea() * leftTotal + rightArea[bin] * rightCount[bin];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = bin;
+					}
+				}
+			}
+
+			// Keep a leaf when splitting doesn't pay for the extra node, unless it is too big.
+			float leafCost = nodeBounds.surfaceArea() * nodeCount;
+			float splitCost = nodeBounds.surfaceArea() * BVH_TRAVERSAL_COST + bestCost;
+			if (nodeCount <= BVH_MAX_LEAF_SIZE && (bestAxis < 0 || splitCost >= leafCost))
+				continue;
+
+			unsigned int* begin = &Objects[first];
+			unsigned int* end = begin + nodeCount;
+			unsigned int* middle;
+			if (bestAxis >= 0) {
+				float low = centerBounds.Min[bestAxis];
+				float scale = BVH_SAH_BINS / (centerBounds.Max[bestAxis] - low);
+				middle = std::partition(begin, end, [&](unsigned int object) {
+					return std::min((int)((centers[object][bestAxis] - low) * scale), BVH_SAH_BINS - 1) < bestBin;
+				});
+			}
+			else { // All centers in the same spot: any split is as good, halve by count.
+				middle = begin + nodeCount / 2;
+			}
+
+			int left = (int)Nodes.size();
+			BVHNode child;
+			child.Left = -1;
+			child.Parent = index;
+			child.First = first;
+			child.Count = (unsigned int)(middle - begin);
+			Nodes.push_back(child);
+			child.First = first + child.Count;
+			child.Count = nodeCount - child.Count;
+			Nodes.push_back(child);
+			Nodes[index].Left = left;
+			pending.push_back(left);
+			pending.push_back(left + 1);
+		}
+
+		for (int i = 0; i < (int)Nodes.size(); ++i)
+			if (Nodes[i].isLeaf())
+				for (unsigned int j = Nodes[i].First; j < Nodes[i].First + Nodes[i].Count; ++j)
+					leafOf[Objects[j]] = i;
+		dirty.assign(Nodes.size(), false);
+		BuildCost = sahCost();
+	}
+
+	// Give an object its new box. The tree is only correct again after refit().
+	void update(unsigned int object, const AABB& bounds)
+	{
+		Bounds[object] = bounds;
+		int leaf = leafOf[object];
+		if (!dirty[leaf]) {
+			dirty[leaf] = true;
+			dirtyLeaves.push_back(leaf);
+		}
+	}
+
+	// Recompute the boxes of the leaves touched by update() and of their ancestors. A walk up stops at the first
+	// ancestor whose box didn't change, so objects moving inside their parents' boxes cost almost nothing. When many
+	// leaves changed, one pass over all the nodes is cheaper than the walks: children always come after their parent
+	// in Nodes, so going backwards sees every child before its parent.
+	void refit()
+	{
+		REGL_PROFILE_ZONE("BVH refit");
+		if (dirtyLeaves.size() > Nodes.size() / 16) {
+			for (int index = (int)Nodes.size() - 1; index >= 0; --index) {
+				BVHNode& node = Nodes[index];
+				if (!node.isLeaf()) {
+					node.Bounds = Nodes[node.Left].Bounds;
+					node.Bounds.grow(Nodes[node.Left + 1].Bounds);
+				}
+				else if (dirty[index])
+					node.Bounds = leafBounds(node);
+			}
+			for (int leaf : dirtyLeaves)
+				dirty[leaf] = false;
+			dirtyLeaves.clear();
+			return;
+		}
+
+		for (int leaf : dirtyLeaves) {
+			dirty[leaf] = false;
+			BVHNode& node = Nodes[leaf];
+			AABB bounds = leafBounds(node);
+			if (bounds == node.Bounds)
+				continue;
+			node.Bounds = bounds;
+			for (int parent = node.Parent; parent >= 0; parent = Nodes[parent].Parent) {
+				AABB merged = Nodes[Nodes[parent].Left].Bounds;
+				merged.grow(Nodes[Nodes[parent].Left + 1].Bounds);
+				if (merged == Nodes[parent].Bounds)
+					break;
+				Nodes[parent].Bounds = merged;
+			}
+		}
+		dirtyLeaves.clear();
+	}
+
+	// Expected cost of a query, in object tests, relative to the root box: every node's area weighted by what it costs
+	// to enter it. Grows as refits loosen the boxes.
+	float sahCost() const
+	{
+		if (Nodes.empty() || Nodes[0].Bounds.surfaceArea() <= 0.0f)
+			return 0.0f;
+		float cost = 0.0f;
+		for (const BVHNode& node : Nodes)
+			cost += node.Bounds.surfaceArea() * (node.isLeaf() ? (float)node.Count : BVH_TRAVERSAL_COST);
+		return cost / Nodes[0].Bounds.surfaceArea();
+	}
+
+	// Replace `visible` with the objects whose boxes pass Frustum::intersectsBox, in tree order. A node inside a plane
+	// isn't tested against it again below, and a node inside all six adds its objects untested.
+	const BVHStats& cullFrustum(const Frustum& frustum, std::vector<unsigned int>& visible)
+	{
+		REGL_PROFILE_ZONE("BVH cull");
+		uint64_t start = Profiler::steadyNanoseconds();
+		Last = BVHStats();
+		visible.clear();
+
+		glm::vec3 absNormal[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; ++p)
+			absNormal[p] = glm::vec3(std::fabs(frustum.Planes[p].x), std::fabs(frustum.Planes[p].y), std::fabs(frustum.Planes[p].z));
+
+		const int allPlanes = (1 << FRUSTUM_PLANE_COUNT) - 1;
+		stack.clear();
+		if (!Nodes.empty())
+			stack.push_back(std::make_pair(0, allPlanes));
+		while (!stack.empty()) {
+			int index = stack.back().first, planes = stack.back().second;
+			stack.pop_back();
+			const BVHNode& node = Nodes[index];
+			Last.NodesVisited++;
+
+			glm::vec3 center = node.Bounds.center(), extent = node.Bounds.extent();
+			bool outside = false;
+			for (int p = 0; p < FRUSTUM_PLANE_COUNT && !outside; ++p) {
+				if (!(planes & (1 << p)))
+					continue;
+				float distance = glm::dot(glm::vec3(frustum.Planes[p]), center) + frustum.Planes[p].w;
+				float reach = glm::dot(absNormal[p], extent);
+				if (distance + reach < 0.0f)
+					outside = true;
+				else if (distance - reach >= 0.0f)
+					planes &= ~(1 << p);
+			}
+			if (outside)
+				continue;
+			if (planes == 0)
+				visible.insert(visible.end(), Objects.begin() + node.First, Objects.begin() + node.First + node.Count);
+			else if (node.isLeaf()) {
+				for (unsigned int i = node.First; i < node.First + node.Count; ++i) {
+					const AABB& bounds = Bounds[Objects[i]];
+					Last.ObjectsTested++;
+					if (frustum.intersectsBox(bounds.center(), bounds.extent()))
+						visible.push_back(Objects[i]);
+				}
+			}
+			else {
+				stack.push_back(std::make_pair(node.Left + 1, planes));
+				stack.push_back(std::make_pair(node.Left, planes));
+			}
+		}
+
+		Last.Results = visible.size();
+		Last.Ms = (double)(Profiler::steadyNanoseconds() - start) / 1e6;
+		Frames++;
+		TotalVisible += Last.Results;
+		TotalNodesVisited += Last.NodesVisited;
+		TotalMs += Last.Ms;
+		return Last;
+	}
+
+	// The closest object whose box the ray origin + t * direction crosses for 0 <= t <= maxDistance. Children are
+	// visited nearest first and skipped once they start beyond the best hit so far.
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit, BVHStats* stats = NULL) const
+	{
+		BVHStats local;
+		BVHStats& counters = stats ? *stats : local;
+		const glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		float best = maxDistance;
+		bool found = false;
+
+		std::vector<int> pending;
+		float entry;
+		if (!Nodes.empty() && rayEntry(Nodes[0].Bounds, origin, inverse, best, entry))
+			pending.push_back(0);
+		while (!pending.empty()) {
+			const BVHNode& node = Nodes[pending.back()];
+			pending.pop_back();
+			counters.NodesVisited++;
+			if (!rayEntry(node.Bounds, origin, inverse, best, entry)) // best may have shrunk since it was pushed.
+				continue;
+			if (node.isLeaf()) {
+				for (unsigned int i = node.First; i < node.First + node.Count; ++i) {
+					counters.ObjectsTested++;
+					if (rayEntry(Bounds[Objects[i]], origin, inverse, best, entry)) {
+						best = entry;
+						hit.Object = Objects[i];
+						hit.Distance = entry;
+						found = true;
+					}
+				}
+				continue;
+			}
+			float leftEntry, rightEntry;
+			bool left = rayEntry(Nodes[node.Left].Bounds, origin, inverse, best, leftEntry);
+			bool right = rayEntry(Nodes[node.Left + 1].Bounds, origin, inverse, best, rightEntry);
+			if (left && right) {
+				bool leftFirst = leftEntry <= rightEntry;
+				pending.push_back(leftFirst ? node.Left + 1 : node.Left); // Popped last.
+				pending.push_back(leftFirst ? node.Left : node.Left + 1);
+			}
+			else if (left)
+				pending.push_back(node.Left);
+			else if (right)
+				pending.push_back(node.Left + 1);
+		}
+		counters.Results = found ? 1 : 0;
+		return found;
+	}
+
+	// Append the objects whose boxes overlap `box`.
+	void queryBox(const AABB& box, std::vector<unsigned int>& overlapping, BVHStats* stats = NULL) const
+	{
+		BVHStats local;
+		BVHStats& counters = stats ? *stats : local;
+		size_t before = overlapping.size();
+		std::vector<int> pending;
+		if (!Nodes.empty())
+			pending.push_back(0);
+		while (!pending.empty()) {
+			const BVHNode& node = Nodes[pending.back()];
+			pending.pop_back();
+			counters.NodesVisited++;
+			if (!box.overlaps(node.Bounds))
+				continue;
+			if (box.contains(node.Bounds))
+				overlapping.insert(overlapping.end(), Objects.begin() + node.First, Objects.begin() + node.First + node.Count);
+			else if (node.isLeaf()) {
+				for (unsigned int i = node.First; i < node.First + node.Count; ++i) {
+					counters.ObjectsTested++;
+					if (box.overlaps(Bounds[Objects[i]]))
+						overlapping.push_back(Objects[i]);
+				}
+			}
+			else {
+				pending.push_back(node.Left + 1);
+				pending.push_back(node.Left);
+			}
+		}
+		counters.Results = overlapping.size() - before;
+	}
+
+	void printStats() const
+	{
+		double frames = Frames ? (double)Frames : 1.0;
+		std::cout << std::fixed << std::setprecision(3)
+			<< "BVH culling: " << objectCount() << " objects, " << Nodes.size() << " nodes, " << Frames << " frames, per frame "
+			<< TotalNodesVisited / frames << " nodes visited, " << TotalVisible / frames << " visible, "
+			<< objectCount() - TotalVisible / frames << " culled (avg " << TotalMs / frames << "ms)" << std::endl;
+	}
+
+private:
+	std::vector<int> leafOf;                     // Per object, the leaf holding it.
+	std::vector<bool> dirty;                     // Per node, true for leaves waiting in dirtyLeaves.
+	std::vector<int> dirtyLeaves;
+	std::vector<std::pair<int, int>> stack;      // cullFrustum's pending nodes and the planes they still need testing against.
+
+	AABB leafBounds(const BVHNode& leaf) const
+	{
+		AABB bounds;
+		for (unsigned int i = leaf.First; i < leaf.First + leaf.Count; ++i)
+			bounds.grow(Bounds[Objects[i]]);
+		return bounds;
+	}
+
+	// Slab test: where the ray enters `bounds`, if it does before `maxDistance`. Starting inside counts as entering at 0.
+	static bool rayEntry(const AABB& bounds, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, float& entry)
+	{
+		float enter = 0.0f, exit = maxDistance;
+		for (int axis = 0; axis < 3; ++axis) {
+			float t0 = (bounds.Min[axis] - origin[axis]) * inverse[axis];
+			float t1 = (bounds.Max[axis] - origin[axis]) * inverse[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		entry = enter;
+		return enter <= exit;
+	}
+};
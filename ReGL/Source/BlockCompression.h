@@ -0,0 +1,369 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// CPU encoders for the S3TC block formats, used by the texture cook step (see Cook/Cook.cpp and KTX2.h).
+//
+// Both formats work on 4x4 pixel blocks. BC1 stores two RGB565 endpoints and a 2-bit index per pixel into the
+// 4-color palette between them (8 bytes per block, 6x smaller than RGB8). BC3 adds a BC4-style alpha block in front:
+// two 8-bit endpoints and a 3-bit index per pixel (16 bytes per block, 4x smaller than RGBA8).
+//
+// All functions take and return RGBA8 pixels, whatever the source image had.
+
+enum BlockFormat
+{
+	BLOCK_FORMAT_BC1, // Opaque RGB.
+	BLOCK_FORMAT_BC3  // RGB + smooth alpha.
+};
+
+inline unsigned int blockBytes(BlockFormat format)
+{
+	return (format == BLOCK_FORMAT_BC1) ? 8 : 16;
+}
+
+// Size of one compressed mip level.
+inline size_t compressedSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * blockBytes(format);
+}
+
+
+// ----BC1 COLOR----
+
+inline uint16_t packRGB565(const int* rgb)
+{
+	int r = (rgb[0] * 31 + 127) / 255;
+	int g = (rgb[1] * 63 + 127) / 255;
+	int b = (rgb[2] * 31 + 127) / 255;
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// Expand with bit replication, which is what the hardware does.
+inline void unpackRGB565(uint16_t color, int* rgb)
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Pick the nearest palette entry for every pixel of the block. Returns the 32 index bits and the summed squared error.
+inline uint32_t bc1Indices(const uint8_t* block, uint16_t c0, uint16_t c1, int& error)
+{
+	int palette[4][3];
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; ++c) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	uint32_t indices = 0;
+	error = 0;
+	for (int i = 0; i < 16; ++i) {
+		int best = 0, bestError = 0x7FFFFFFF;
+		for (int p = 0; p < 4; ++p) {
+			int dr = block[i * 4 + 0] - palette[p][0];
+			int dg = block[i * 4 + 1] - palette[p][1];
+			int db = block[i * 4 + 2] - palette[p][2];
+			int e = dr * dr + dg * dg + db * db;
+			if (e < bestError) {
+				bestError = e;
+				best = p;
+			}
+		}
+		indices |= (uint32_t)best << (2 * i);
+		error += bestError;
+	}
+	return indices;
+}
+
+// Least-squares endpoints for the given indices: every pixel is a known blend of the two endpoints, solve for them.
+// Returns false if the system is singular (all pixels on one index).
+inline bool bc1RefineEndpoints(const uint8_t* block, uint32_t indices, int* endpoint0, int* endpoint1)
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; // Weight of endpoint 0 per index.
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i) {
+		float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < 3; ++c) {
+			ax[c] += a * block[i * 4 + c];
+			bx[c] += b * block[i * 4 + c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (determinant < 1e-6f)
+		return false;
+	for (int c = 0; c < 3; ++c) {
+		float e0 = (ax[c] * bb - bx[c] * ab) / determinant;
+		float e1 = (bx[c] * aa - ax[c] * ab) / determinant;
+		endpoint0[c] = (e0 < 0.0f) ? 0 : (e0 > 255.0f) ? 255 : (int)(e0 + 0.5f);
+		endpoint1[c] = (e1 < 0.0f) ? 0 : (e1 > 255.0f) ? 255 : (int)(e1 + 0.5f);
+	}
+	return true;
+}
+
+// Encode one 4x4 block of RGBA8 pixels (alpha ignored) into 8 bytes of BC1, always in the opaque 4-color mode.
+inline void encodeBC1Block(const uint8_t* block, uint8_t* out)
+{
+	// Endpoints along the principal axis of the colors: the mean plus the direction of largest variance.
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c)
+			mean[c] += block[i * 4 + c] / 16.0f;
+
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr, rg, rb, gg, gb, bb
+	for (int i = 0; i < 16; ++i) {
+		float r = block[i * 4 + 0] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration) { // Power iteration converges fast for 3x3.
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = x * x + y * y + z * z;
+		if (length < 1e-12f)
+			break; // Flat block, any axis will do.
+		float scale = 1.0f / sqrtf(length);
+		axis[0] = x * scale;
+		axis[1] = y * scale;
+		axis[2] = z * scale;
+	}
+
+	float minDot = 1e30f, maxDot = -1e30f;
+	int minPixel = 0, maxPixel = 0;
+	for (int i = 0; i < 16; ++i) {
+		float dot = block[i * 4 + 0] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+		if (dot < minDot) { minDot = dot; minPixel = i; }
+		if (dot > maxDot) { maxDot = dot; maxPixel = i; }
+	}
+
+	int endpoint0[3], endpoint1[3];
+	for (int c = 0; c < 3; ++c) {
+		endpoint0[c] = block[maxPixel * 4 + c];
+		endpoint1[c] = block[minPixel * 4 + c];
+	}
+	uint16_t c0 = packRGB565(endpoint0), c1 = packRGB565(endpoint1);
+	int error;
+	uint32_t indices = bc1Indices(block, c0, c1, error);
+
+	// One least-squares pass usually shaves a good part of the error off; keep it only if it does.
+	int refined0[3], refined1[3];
+	if (error > 0 && bc1RefineEndpoints(block, indices, refined0, refined1)) {
+		uint16_t r0 = packRGB565(refined0), r1 = packRGB565(refined1);
+		int refinedError;
+		uint32_t refinedIndices = bc1Indices(block, r0, r1, refinedError);
+		if (refinedError < error) {
+			c0 = r0;
+			c1 = r1;
+			indices = refinedIndices;
+		}
+	}
+
+	// c0 > c1 selects the 4-color mode. Swapping the endpoints maps index 0<->1 and 2<->3.
+	if (c0 < c1) {
+		uint16_t swap = c0;
+		c0 = c1;
+		c1 = swap;
+		indices ^= 0x55555555u;
+	}
+	else if (c0 == c1) {
+		indices = 0; // Would be the 3-color mode; every pixel is exactly c0 anyway.
+	}
+
+	out[0] = (uint8_t)(c0 & 0xFF);
+	out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)(c1 & 0xFF);
+	out[3] = (uint8_t)(c1 >> 8);
+	std::memcpy(out + 4, &indices, 4); // Little-endian, like the format.
+}
+
+
+// ----BC3 ALPHA----
+
+// Alpha palette for the two modes: a0 > a1 interpolates 6 values in between, a0 <= a1 interpolates 4 and adds 0 and 255.
+inline void alphaPalette(int a0, int a1, int* palette)
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (int i = 1; i < 7; ++i)
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	}
+	else {
+		for (int i = 1; i < 5; ++i)
+			palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+inline uint64_t alphaIndices(const uint8_t* block, int a0, int a1, int& error)
+{
+	int palette[8];
+	alphaPalette(a0, a1, palette);
+	uint64_t indices = 0;
+	error = 0;
+	for (int i = 0; i < 16; ++i) {
+		int alpha = block[i * 4 + 3];
+		int best = 0, bestError = 0x7FFFFFFF;
+		for (int p = 0; p < 8; ++p) {
+			int e = (alpha - palette[p]) * (alpha - palette[p]);
+			if (e < bestError) {
+				bestError = e;
+				best = p;
+			}
+		}
+		indices |= (uint64_t)best << (3 * i);
+		error += bestError;
+	}
+	return indices;
+}
+
+// Encode the alpha channel of a 4x4 RGBA8 block into 8 bytes.
+inline void encodeAlphaBlock(const uint8_t* block, uint8_t* out)
+{
+	int minAlpha = 255, maxAlpha = 0;           // Over all pixels, for the 8-value mode.
+	int minInner = 255, maxInner = 0;           // Ignoring 0 and 255, for the 6-value mode which has those for free.
+	for (int i = 0; i < 16; ++i) {
+		int alpha = block[i * 4 + 3];
+		minAlpha = (alpha < minAlpha) ? alpha : minAlpha;
+		maxAlpha = (alpha > maxAlpha) ? alpha : maxAlpha;
+		if (alpha != 0 && alpha != 255) {
+			minInner = (alpha < minInner) ? alpha : minInner;
+			maxInner = (alpha > maxInner) ? alpha : maxInner;
+		}
+	}
+
+	int a0 = maxAlpha, a1 = minAlpha, error;
+	uint64_t indices = alphaIndices(block, a0, a1, error);
+
+	// Anti-aliased cut-out edges (mostly 0 and 255 with a few values in between) do better in the 6-value mode.
+	if (error > 0 && minInner <= maxInner) {
+		int innerError;
+		uint64_t innerIndices = alphaIndices(block, minInner, maxInner, innerError);
+		if (innerError < error) {
+			a0 = minInner;
+			a1 = maxInner;
+			indices = innerIndices;
+		}
+	}
+
+	out[0] = (uint8_t)a0;
+	out[1] = (uint8_t)a1;
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+// Encode one 4x4 RGBA8 block into 16 bytes of BC3: alpha block, then a BC1 color block.
+inline void encodeBC3Block(const uint8_t* block, uint8_t* out)
+{
+	encodeAlphaBlock(block, out);
+	encodeBC1Block(block, out + 8);
+}
+
+
+// ----DECODING----
+// Only the cook step uses these, to report the error it introduced.
+
+inline void decodeBC1Block(const uint8_t* in, uint8_t* block)
+{
+	uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8)), c1 = (uint16_t)(in[2] | (in[3] << 8));
+	int palette[4][4];
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (int c = 0; c < 3; ++c) {
+		if (c0 > c1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if (c0 <= c1)
+		palette[3][3] = 0; // Transparent black.
+
+	uint32_t indices;
+	std::memcpy(&indices, in + 4, 4);
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 4; ++c)
+			block[i * 4 + c] = (uint8_t)palette[(indices >> (2 * i)) & 3][c];
+}
+
+inline void decodeBC3Block(const uint8_t* in, uint8_t* block)
+{
+	decodeBC1Block(in + 8, block);
+	int palette[8];
+	alphaPalette(in[0], in[1], palette);
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i)
+		indices |= (uint64_t)in[2 + i] << (8 * i);
+	for (int i = 0; i < 16; ++i)
+		block[i * 4 + 3] = (uint8_t)palette[(indices >> (3 * i)) & 7];
+}
+
+
+// ----IMAGES----
+
+// Compress a whole RGBA8 image. Blocks hanging over the right or bottom edge repeat the last column/row.
+inline std::vector<uint8_t> compressImage(const uint8_t* rgba, int width, int height, BlockFormat format)
+{
+	std::vector<uint8_t> out(compressedSize(format, width, height));
+	uint8_t* write = out.data();
+	uint8_t block[64];
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			for (int y = 0; y < 4; ++y) {
+				int sy = (by + y < height) ? by + y : height - 1;
+				for (int x = 0; x < 4; ++x) {
+					int sx = (bx + x < width) ? bx + x : width - 1;
+					std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+				}
+			}
+			if (format == BLOCK_FORMAT_BC1)
+				encodeBC1Block(block, write);
+			else
+				encodeBC3Block(block, write);
+			write += blockBytes(format);
+		}
+	}
+	return out;
+}
+
+// Decompress a whole image back to RGBA8.
+inline std::vector<uint8_t> decompressImage(const uint8_t* blocks, int width, int height, BlockFormat format)
+{
+	std::vector<uint8_t> rgba((size_t)width * height * 4);
+	uint8_t block[64];
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			if (format == BLOCK_FORMAT_BC1)
+				decodeBC1Block(blocks, block);
+			else
+				decodeBC3Block(blocks, block);
+			blocks += blockBytes(format);
+			for (int y = 0; y < 4 && by + y < height; ++y)
+				for (int x = 0; x < 4 && bx + x < width; ++x)
+					std::memcpy(&rgba[((size_t)(by + y) * width + bx + x) * 4], block + (y * 4 + x) * 4, 4);
+		}
+	}
+	return rgba;
+}
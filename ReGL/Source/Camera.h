@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Frustum.h"
+
 // Some basic directions for the camera
 enum Camera_Movement { 
 	FORWARD,
@@ -42,7 +44,7 @@ public:
 	// Constructor with vectors
 	Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f),
 		float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED),
-		MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+		MouseSensitivity(SENSITIVITY), Zoom(ZOOM), frustumValid(false)
 	{
 		Position = position;
 		WorldUp = up;
@@ -54,7 +56,7 @@ public:
 
 	// Constructor with scalar values
 	Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)),
-		MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+		MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), frustumValid(false)
 	{
 		Position = glm::vec3(posX, posY, posZ);
 		WorldUp = glm::vec3(upX, upY, upZ);
@@ -63,11 +65,47 @@ public:
 		updateCameraVectors();
 	}
 
-	glm::mat4 GetViewMatrix()
+	glm::mat4 GetViewMatrix() const
 	{
 		return glm::lookAt(Position, Position + Front, Up);
 	}
 
+	// Perspective projection using the camera's Zoom as the vertical field of view.
+	glm::mat4 GetProjectionMatrix(float aspect, float nearPlane = 0.1f, float farPlane = 100.0f) const
+	{
+		return glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+	}
+
+	// Direction of the ray from Position through a point of the screen, given in pixels from the top left corner of a
+	// width x height viewport. For picking: cast it into the scene (BVH::raycast). The screen center gives Front.
+	glm::vec3 GetRayDirection(float x, float y, float width, float height) const
+	{
+		float tanHalfFov = tan(glm::radians(Zoom) * 0.5f);
+		float ndcX = 2.0f * x / width - 1.0f;
+		float ndcY = 1.0f - 2.0f * y / height;
+		return glm::normalize(Front + Right * (ndcX * tanHalfFov * width / height) + Up * (ndcY * tanHalfFov));
+	}
+
+	// World space frustum of GetProjectionMatrix() * GetViewMatrix(). Cached: the planes are only extracted again when
+	// Position, Front, Up, Zoom or the arguments changed since the last call, so calling this every frame is free
+	// while the camera stands still.
+	const Frustum& GetFrustum(float aspect, float nearPlane = 0.1f, float farPlane = 100.0f)
+	{
+		if (!frustumValid || Position != frustumPosition || Front != frustumFront || Up != frustumUp || Zoom != frustumZoom
+			|| aspect != frustumAspect || nearPlane != frustumNear || farPlane != frustumFar) {
+			frustum = Frustum::fromMatrix(GetProjectionMatrix(aspect, nearPlane, farPlane) * GetViewMatrix());
+			frustumPosition = Position;
+			frustumFront = Front;
+			frustumUp = Up;
+			frustumZoom = Zoom;
+			frustumAspect = aspect;
+			frustumNear = nearPlane;
+			frustumFar = farPlane;
+			frustumValid = true;
+		}
+		return frustum;
+	}
+
 	//
 	void ProcessKeyboard(Camera_Movement direction, float deltaTime)
 	{
@@ -114,6 +152,12 @@ public:
 
 
 private:
+	// GetFrustum's cache, and what it was built from.
+	Frustum frustum;
+	bool frustumValid;
+	glm::vec3 frustumPosition, frustumFront, frustumUp;
+	float frustumZoom, frustumAspect, frustumNear, frustumFar;
+
 	void updateCameraVectors() //Calculate the new Front, Right and Up vectors
 	{
 		// Calculate the new Front vector
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "RadixSort.h"
+#include "StateCache.h"
+
+
+// Binding point of the per-draw uniform block. Programs built with OBJECT_BLOCK declare "ObjectData" and are bound to it.
+const unsigned int OBJECT_UNIFORMS_BINDING = 1;
+
+// CPU mirror of the std140 "ObjectData" block in Shaders/Texture.vert.
+struct ObjectData
+{
+	glm::mat4 Model;
+};
+static_assert(sizeof(ObjectData) == 64, "ObjectData must match the std140 layout of the ObjectData uniform block");
+
+// Draws per recording chunk in CommandRecorder::record(): large enough that a chunk costs far more than a job.
+const int COMMAND_CHUNK = 1024;
+
+
+// One draw, described by GL object names and numbers only: no GL calls happen while recording, so any thread can record.
+struct DrawCommand
+{
+	uint64_t Key;           // Commands are replayed in increasing Key order (see drawSortKey()); equal keys keep their recording order.
+	uint32_t Program;
+	uint32_t VertexArray;
+	uint32_t Textures[2];   // Texture units 0 and 1; 0 leaves the unit as it is.
+	uint32_t UniformOffset; // Byte offset of the draw's ObjectData in the buffer's Uniforms.
+	uint32_t IndexCount;
+	uint32_t FirstIndex;
+	uint32_t IndexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+};
+
+// Draw commands and their per-draw uniform blocks, recorded by one thread. Each block takes UniformStride bytes: the
+// block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so the replay can bind any of them with glBindBufferRange.
+class CommandBuffer
+{
+public:
+	std::vector<DrawCommand> Commands;
+	std::vector<uint8_t> Uniforms;
+	uint32_t UniformStride;
+
+	CommandBuffer() : UniformStride(256) {}
+
+	// Forget the commands, keep the memory.
+	void reset(uint32_t uniformStride)
+	{
+		Commands.clear();
+		Uniforms.clear();
+		UniformStride = uniformStride;
+	}
+
+	// A command drawing `mesh` (all of its indices) with its VAO.
+	static DrawCommand meshCommand(uint64_t key, uint32_t program, const Mesh& mesh, uint32_t texture0 = 0, uint32_t texture1 = 0)
+	{
+		DrawCommand command;
+		command.Key = key;
+		command.Program = program;
+		command.VertexArray = mesh.VAO;
+		command.Textures[0] = texture0;
+		command.Textures[1] = texture1;
+		command.UniformOffset = 0;
+		command.IndexCount = mesh.IndexCount;
+		command.FirstIndex = 0;
+		command.IndexType = mesh.IndexType;
+		return command;
+	}
+
+	// Append a draw and a copy of its uniform block (at most UniformStride bytes).
+	void draw(const DrawCommand& command, const void* uniforms, size_t bytes)
+	{
+		size_t offset = Uniforms.size();
+		Uniforms.resize(offset + UniformStride);
+		std::memcpy(&Uniforms[offset], uniforms, std::min<size_t>(bytes, UniformStride));
+		Commands.push_back(command);
+		Commands.back().UniformOffset = (uint32_t)offset;
+	}
+
+	void draw(const DrawCommand& command, const ObjectData& object)
+	{
+		draw(command, &object, sizeof(ObjectData));
+	}
+
+	size_t size() const
+	{
+		return Commands.size();
+	}
+};
+
+
+// ------------------------SORT KEYS------------------------
+// A draw's Key orders the replay. From the top bit down:
+//
+//   opaque:  pass (4) | 0 | program (16) | texture set (16) | depth (27), near first
+//   blended: pass (4) | 1 | depth (27), far first | program (16) | texture set (16)
+//
+// Passes run in order, and in a pass the opaque draws come before the blended ones. Opaque draws are grouped by program,
+// then by textures, which is what makes state changes rare; within a group they go front to back, so the depth test
+// rejects hidden fragments before they are shaded. Blended draws have to go back to front to blend correctly, so depth
+// comes before state for them. Program names and texture sets are cut to 16 bits: two that share their low bits only
+// lose some grouping.
+const int SORT_KEY_DEPTH_BITS = 27;
+
+// `depth` is the distance along the view direction divided by the far plane, clamped to [0, 1]. `textureSet` is any
+// small number that is the same for draws binding the same textures.
+inline uint64_t drawSortKey(unsigned int pass, bool blended, uint32_t program, uint32_t textureSet, float depth)
+{
+	const uint64_t depthMax = (1ull << SORT_KEY_DEPTH_BITS) - 1;
+	uint64_t quantized = (uint64_t)((double)std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+	uint64_t state = ((uint64_t)(program & 0xFFFF) << 16) | (textureSet & 0xFFFF);
+	uint64_t key = ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)blended << 59);
+	if (blended)
+		return key | ((depthMax - quantized) << 32) | state;
+	return key | (state << SORT_KEY_DEPTH_BITS) | quantized;
+}
+
+
+// Program, VAO and texture binds a list of commands costs when replayed in order, starting from nothing bound: what
+// sorting the keys is for.
+struct StateChanges
+{
+	uint64_t Programs = 0, VertexArrays = 0, Textures = 0;
+
+	uint64_t total() const
+	{
+		return Programs + VertexArrays + Textures;
+	}
+};
+
+inline StateChanges countStateChanges(const std::vector<DrawCommand>& commands)
+{
+	StateChanges changes;
+	uint32_t program = 0, vertexArray = 0, textures[2] = { 0, 0 };
+	for (const DrawCommand& command : commands) {
+		changes.Programs += command.Program != program;
+		changes.VertexArrays += command.VertexArray != vertexArray;
+		program = command.Program;
+		vertexArray = command.VertexArray;
+		for (int unit = 0; unit < 2; ++unit)
+			if (command.Textures[unit] != 0 && command.Textures[unit] != textures[unit]) {
+				changes.Textures++;
+				textures[unit] = command.Textures[unit];
+			}
+	}
+	return changes;
+}
+
+
+// ------------------------RECORDING------------------------
+// Records draws on a job system into one CommandBuffer per chunk of COMMAND_CHUNK draws, then merges the chunks in order
+// and sorts the commands by key with a parallel radix sort (Source/RadixSort.h). The sort is stable and the chunks are
+// taken in index order, so the result only depends on what was recorded, not on which thread recorded which chunk.
+// The chunk buffers and the sort memory are kept from frame to frame.
+class CommandRecorder
+{
+public:
+	std::vector<CommandBuffer> Chunks;
+
+	// Per-frame totals: draws, and state changes in recording order and in key order.
+	uint64_t Frames, Draws;
+	StateChanges Unsorted, Sorted;
+
+	CommandRecorder() : Frames(0), Draws(0) {}
+
+	// Record `count` draws into `merged`: record(i, buffer) appends draw i to the buffer of its chunk.
+	template <typename Record>
+	void record(JobSystem& jobs, int count, uint32_t uniformStride, CommandBuffer& merged, const Record& record)
+	{
+		int chunkCount = (count + COMMAND_CHUNK - 1) / COMMAND_CHUNK;
+		if ((int)Chunks.size() < chunkCount)
+			Chunks.resize(chunkCount);
+		jobs.parallelFor(chunkCount, 1, [&](int chunk) {
+			CommandBuffer& buffer = Chunks[chunk];
+			buffer.reset(uniformStride);
+			int end = std::min(count, (chunk + 1) * COMMAND_CHUNK);
+			for (int i = chunk * COMMAND_CHUNK; i < end; ++i)
+				record(i, buffer);
+		});
+		merge(chunkCount, merged, &jobs);
+	}
+
+	// Concatenate the first `count` chunks in order into `merged`, then sort the commands by key. The uniform blocks
+	// stay in recording order; the offsets are rebased and follow their commands.
+	void merge(int count, CommandBuffer& merged, JobSystem* jobs = NULL)
+	{
+		size_t uniformBytes = 0;
+		unsorted.clear();
+		for (int i = 0; i < count; ++i)
+			uniformBytes += Chunks[i].Uniforms.size();
+		merged.reset(count > 0 ? Chunks[0].UniformStride : merged.UniformStride);
+		merged.Uniforms.resize(uniformBytes);
+
+		size_t base = 0;
+		for (int i = 0; i < count; ++i) {
+			const CommandBuffer& buffer = Chunks[i];
+			for (DrawCommand command : buffer.Commands) {
+				command.UniformOffset += (uint32_t)base;
+				unsorted.push_back(command);
+			}
+			if (!buffer.Uniforms.empty())
+				std::memcpy(&merged.Uniforms[base], buffer.Uniforms.data(), buffer.Uniforms.size());
+			base += buffer.Uniforms.size();
+		}
+
+		keys.resize(unsorted.size());
+		for (size_t i = 0; i < unsorted.size(); ++i)
+			keys[i] = SortItem{ unsorted[i].Key, (uint32_t)i };
+		sorter.sort(keys, jobs);
+		merged.Commands.resize(unsorted.size());
+		for (size_t i = 0; i < keys.size(); ++i)
+			merged.Commands[i] = unsorted[keys[i].Index];
+
+		addChanges(Unsorted, countStateChanges(unsorted));
+		addChanges(Sorted, countStateChanges(merged.Commands));
+		Draws += merged.Commands.size();
+		Frames++;
+	}
+
+	void printStats() const
+	{
+		double frames = Frames ? (double)Frames : 1.0;
+		std::cout << "Draw sorting: " << Draws / frames << " draws per frame; state changes per frame "
+			<< Unsorted.total() / frames << " in recording order (programs " << Unsorted.Programs / frames << ", VAOs "
+			<< Unsorted.VertexArrays / frames << ", textures " << Unsorted.Textures / frames << "), " << Sorted.total() / frames
+			<< " sorted (programs " << Sorted.Programs / frames << ", VAOs " << Sorted.VertexArrays / frames << ", textures "
+			<< Sorted.Textures / frames << ")" << std::endl;
+	}
+
+private:
+	std::vector<DrawCommand> unsorted;
+	std::vector<SortItem> keys;
+	RadixSorter sorter;
+
+	static void addChanges(StateChanges& total, const StateChanges& frame)
+	{
+		total.Programs += frame.Programs;
+		total.VertexArrays += frame.VertexArrays;
+		total.Textures += frame.Textures;
+	}
+};
+
+
+// Replays merged command buffers on the GL thread. The uniform blocks of a frame are uploaded in one call into a buffer
+// that is orphaned first, so the driver doesn't wait for the previous frame's draws; each draw then binds its block with
+// glBindBufferRange. Program, VAO and texture changes go through the state cache, so runs of draws sharing state (which
+// is what sorting by key produces) cost one bind.
+class CommandExecutor
+{
+public:
+	GLuint UBO;
+	GLint UniformAlignment; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+	size_t Capacity;
+
+	// The last execute(), and totals over all of them.
+	uint64_t Draws, Frames, TotalDraws;
+
+	CommandExecutor() : UBO(0), UniformAlignment(256), Capacity(0), Draws(0), Frames(0), TotalDraws(0)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &UniformAlignment);
+		if (UniformAlignment <= 0)
+			UniformAlignment = 256;
+		glGenBuffers(1, &UBO);
+	}
+
+	// Bytes per uniform block of `blockBytes` in command buffers replayed here.
+	uint32_t uniformStride(size_t blockBytes) const
+	{
+		return (uint32_t)((blockBytes + UniformAlignment - 1) / UniformAlignment * UniformAlignment);
+	}
+
+	void execute(const CommandBuffer& commands, GLStateCache& state)
+	{
+		Draws = commands.Commands.size();
+		Frames++;
+		TotalDraws += Draws;
+		if (commands.Commands.empty())
+			return;
+
+		state.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+		if (commands.Uniforms.size() > Capacity)
+			Capacity = commands.Uniforms.size() + commands.Uniforms.size() / 2; // Grow with headroom.
+		glBufferData(GL_UNIFORM_BUFFER, Capacity, NULL, GL_STREAM_DRAW); // Orphan: new storage, no wait.
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, commands.Uniforms.size(), commands.Uniforms.data());
+
+		for (const DrawCommand& command : commands.Commands) {
+			state.useProgram(command.Program);
+			state.bindVertexArray(command.VertexArray);
+			for (unsigned int unit = 0; unit < 2; ++unit)
+				if (command.Textures[unit] != 0)
+					state.bindTexture2D(unit, command.Textures[unit]);
+			// Also binds the UBO to GL_UNIFORM_BUFFER, which the cache already knows.
+			glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORMS_BINDING, UBO, command.UniformOffset, commands.UniformStride);
+			glDrawElements(GL_TRIANGLES, command.IndexCount, command.IndexType,
+				(const void*)(uintptr_t)(command.FirstIndex * indexSize(command.IndexType)));
+		}
+	}
+
+	void printStats() const
+	{
+		std::cout << "Command buffers: " << (Frames ? (double)TotalDraws / Frames : 0.0) << " draws per frame on average" << std::endl;
+	}
+
+	// De-allocate the buffer. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		glDeleteBuffers(1, &UBO);
+		UBO = 0;
+	}
+};
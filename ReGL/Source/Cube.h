@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Mesh.h"
+
+
+// Cube vertices
+const float CUBE_VERTICES[] = {
+	// positions			// colors			// texture coords
+	// 4 vertices (front) for the cube
+	 0.5f,  0.5f, 0.5f,		1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-top right
+	 0.5f, -0.5f, 0.5f,		0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-bottom right
+	-0.5f, -0.5f, 0.5f,		0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-bottom left
+	-0.5f,  0.5f, 0.5f,		1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-top left
+	// 4 vertices (right) for the cube
+	 0.5f,  0.5f,  0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-top right
+	 0.5f, -0.5f,  0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-bottom right
+	 0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom right
+	 0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top right
+	// 4 vertices (left) for the cube
+	-0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top left
+	-0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom left
+	-0.5f, -0.5f,  0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-bottom left
+	-0.5f,  0.5f,  0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-top left
+	// 4 vertices (back) for the cube
+	 0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top right
+	 0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom right
+	-0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom left
+	-0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top left
+	// 4 vertices (top) for the cube
+	 0.5f,  0.5f, -0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// back-top right
+	 0.5f,  0.5f,  0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// front-top right
+	-0.5f,  0.5f,  0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// front-top left
+	-0.5f,  0.5f, -0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// back-top left
+	 // 4 vertices (bottom) for the cube
+	 0.5f, -0.5f,  0.5f,	1.0f, 0.0f, 0.0f,   1.0f, 1.0f,	// front-bottom right
+	 0.5f, -0.5f, -0.5f,	0.0f, 1.0f, 0.0f,   1.0f, 0.0f,	// back-bottom right
+	-0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 1.0f,   0.0f, 0.0f,	// back-bottom left
+	-0.5f, -0.5f,  0.5f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f,	// front-bottom left
+};
+
+
+const unsigned int CUBE_INDICES[] = {	// Instead of drawing the rectangle with 6 vertices, we can draw it with 2 triangles using 4 vertices.
+	// Front
+	0, 3, 1, // First tri
+	1, 3, 2, // Second tri
+	// Right
+	4, 7, 5, // First tri
+	5, 7, 6, // Second tri
+	// Left
+	8, 11, 9, // First tri
+	9, 11, 10, // Second tri
+	// Back
+	12, 15, 13, // First tri
+	13, 15, 14, // Second tri
+	// Top
+	16, 19, 17, // First tri
+	17, 19, 18, // Second tri
+	// Bottom
+	20, 23, 21, // First tri
+	21, 23, 22, // Second tri
+};
+
+
+// Layout of the cube on the GPU: 16 bytes per vertex instead of the 32 of CUBE_VERTICES. Every value in the cube is a
+// half, 0 or 1, so the encoding is exact.
+inline VertexLayout cubeVertexLayout()
+{
+	VertexLayout layout;
+	layout.add(0, 3, VERTEX_HALF)     // Position attribute
+		.add(1, 3, VERTEX_UNORM8)     // Color attribute
+		.add(2, 2, VERTEX_UNORM16);   // Texture attribute
+	return layout;
+}
+
+
+// The textured cube used by the application and the benchmarks. Owns its VAO, VBO and EBO.
+class Cube : public Mesh
+{
+public:
+	Cube()
+		: Mesh(cubeVertexLayout(), CUBE_VERTICES, 8, sizeof(CUBE_VERTICES) / sizeof(CUBE_VERTICES[0]) / 8,
+			CUBE_INDICES, sizeof(CUBE_INDICES) / sizeof(CUBE_INDICES[0]))
+	{
+	}
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Float4.h"
+#include "Frustum.h"
+#include "Profiler.h"
+#include "TileWorkers.h"
+
+
+// Frustum culling of many objects at once.
+//
+// The bounds live in structure-of-arrays form: one array per coordinate, so four objects are one SIMD load per
+// coordinate and a plane test is a handful of multiply-adds for four objects at a time. Large sets are split into
+// CULLING_CHUNK objects per task and culled in parallel on TileWorkers; each chunk writes its own list and the lists are
+// joined in chunk order, so the visible indices always come out sorted, whatever the thread count.
+//
+//   CullingSet objects;
+//   unsigned int tree = objects.add(treeCenter, treeExtent);
+//   ...
+//   std::vector<unsigned int> visible;
+//   objects.cull(camera.GetFrustum(aspect), visible);
+//   for (unsigned int index : visible)
+//       draw(index);
+//
+// Both tests are conservative (see Frustum::intersectsBox): what is culled is really outside, what passes may not be.
+enum CullShape {
+	CULL_BOXES,   // Axis-aligned boxes, tighter for most objects.
+	CULL_SPHERES  // Bounding spheres, a little cheaper.
+};
+
+const size_t CULLING_CHUNK = 4096; // Objects per task when culling in parallel.
+
+// What one cull() call did.
+struct CullStats
+{
+	size_t Tested = 0, Visible = 0, Culled = 0;
+	double Ms = 0.0;
+};
+
+class CullingSet
+{
+public:
+	// World space bounds, one entry per object: box center, box half size and the radius of the sphere around the box.
+	std::vector<float> CenterX, CenterY, CenterZ;
+	std::vector<float> ExtentX, ExtentY, ExtentZ;
+	std::vector<float> Radius;
+
+	// The last frame, and totals over every cull() call, for printStats().
+	CullStats Last;
+	uint64_t Frames = 0, TotalTested = 0, TotalVisible = 0;
+	double TotalMs = 0.0;
+
+	size_t size() const { return CenterX.size(); }
+
+	// Returns the object's index, which is what cull() reports.
+	unsigned int add(const glm::vec3& center, const glm::vec3& extent)
+	{
+		CenterX.push_back(0.0f); CenterY.push_back(0.0f); CenterZ.push_back(0.0f);
+		ExtentX.push_back(0.0f); ExtentY.push_back(0.0f); ExtentZ.push_back(0.0f);
+		Radius.push_back(0.0f);
+		unsigned int index = (unsigned int)size() - 1;
+		set(index, center, extent);
+		return index;
+	}
+
+	// Move an object, e.g. with the result of transformBox() after its model matrix changed.
+	void set(unsigned int index, const glm::vec3& center, const glm::vec3& extent)
+	{
+		CenterX[index] = center.x; CenterY[index] = center.y; CenterZ[index] = center.z;
+		ExtentX[index] = extent.x; ExtentY[index] = extent.y; ExtentZ[index] = extent.z;
+		Radius[index] = glm::length(extent);
+	}
+
+	void clear()
+	{
+		CenterX.clear(); CenterY.clear(); CenterZ.clear();
+		ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+		Radius.clear();
+	}
+
+	// Replace `visible` with the indices of the objects inside the frustum, in increasing order. With `workers`, sets
+	// larger than one chunk are culled in parallel.
+	const CullStats& cull(const Frustum& frustum, std::vector<unsigned int>& visible, CullShape shape = CULL_BOXES, TileWorkers* workers = NULL)
+	{
+		REGL_PROFILE_ZONE("Cull");
+		uint64_t start = Profiler::steadyNanoseconds();
+
+		visible.clear();
+		size_t count = size();
+		size_t chunkCount = (count + CULLING_CHUNK - 1) / CULLING_CHUNK;
+		if (workers == NULL || workers->threadCount() < 2 || chunkCount < 2)
+			cullRange(frustum, shape, 0, count, visible);
+		else {
+			if (chunkVisible.size() < chunkCount)
+				chunkVisible.resize(chunkCount);
+			workers->run((int)chunkCount, [&](int chunk) {
+				size_t begin = (size_t)chunk * CULLING_CHUNK;
+				size_t end = (begin + CULLING_CHUNK < count) ? begin + CULLING_CHUNK : count;
+				chunkVisible[chunk].clear();
+				cullRange(frustum, shape, begin, end, chunkVisible[chunk]);
+			});
+			size_t total = 0;
+			for (size_t i = 0; i < chunkCount; ++i)
+				total += chunkVisible[i].size();
+			visible.reserve(total);
+			for (size_t i = 0; i < chunkCount; ++i)
+				visible.insert(visible.end(), chunkVisible[i].begin(), chunkVisible[i].end());
+		}
+
+		Last.Tested = count;
+		Last.Visible = visible.size();
+		Last.Culled = count - visible.size();
+		Last.Ms = (double)(Profiler::steadyNanoseconds() - start) / 1e6;
+		Frames++;
+		TotalTested += Last.Tested;
+		TotalVisible += Last.Visible;
+		TotalMs += Last.Ms;
+		return Last;
+	}
+
+	void printStats() const
+	{
+		double frames = Frames ? (double)Frames : 1.0;
+		std::cout << std::fixed << std::setprecision(3)
+			<< "Culling: " << Frames << " frames, per frame " << TotalTested / frames << " tested, " << TotalVisible / frames << " visible, "
+			<< (TotalTested - TotalVisible) / frames << " culled (avg " << TotalMs / frames << "ms)" << std::endl;
+	}
+
+private:
+	std::vector<std::vector<unsigned int>> chunkVisible; // Per-task output, kept between frames to reuse the memory.
+
+	// Append the visible objects of [begin, end) to `out`: four at a time, then one at a time for the rest.
+	void cullRange(const Frustum& frustum, CullShape shape, size_t begin, size_t end, std::vector<unsigned int>& out) const
+	{
+		// The planes, each component broadcast to four lanes, and for boxes the absolute normal that turns a half size
+		// into the distance the box reaches towards the plane.
+		Float4 normalX[FRUSTUM_PLANE_COUNT], normalY[FRUSTUM_PLANE_COUNT], normalZ[FRUSTUM_PLANE_COUNT], distance[FRUSTUM_PLANE_COUNT];
+		Float4 absX[FRUSTUM_PLANE_COUNT], absY[FRUSTUM_PLANE_COUNT], absZ[FRUSTUM_PLANE_COUNT];
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; ++p) {
+			const glm::vec4& plane = frustum.Planes[p];
+			normalX[p] = splat4(plane.x); normalY[p] = splat4(plane.y); normalZ[p] = splat4(plane.z);
+			distance[p] = splat4(plane.w);
+			absX[p] = splat4(std::fabs(plane.x)); absY[p] = splat4(std::fabs(plane.y)); absZ[p] = splat4(std::fabs(plane.z));
+		}
+		const Float4 zero = splat4(0.0f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			Float4 x = load4u(&CenterX[i]), y = load4u(&CenterY[i]), z = load4u(&CenterZ[i]);
+			Float4 outside = maskAll4(false);
+			if (shape == CULL_BOXES) {
+				Float4 ex = load4u(&ExtentX[i]), ey = load4u(&ExtentY[i]), ez = load4u(&ExtentZ[i]);
+				for (int p = 0; p < FRUSTUM_PLANE_COUNT; ++p) {
+					Float4 reach = absX[p] * ex + absY[p] * ey + absZ[p] * ez;
+					Float4 signedDistance = normalX[p] * x + normalY[p] * y + normalZ[p] * z + distance[p];
+					outside = outside | less4(signedDistance + reach, zero);
+				}
+			}
+			else {
+				Float4 radius = load4u(&Radius[i]);
+				for (int p = 0; p < FRUSTUM_PLANE_COUNT; ++p) {
+					Float4 signedDistance = normalX[p] * x + normalY[p] * y + normalZ[p] * z + distance[p];
+					outside = outside | less4(signedDistance + radius, zero);
+				}
+			}
+			int inside = ~laneMask4(outside) & 0xF;
+			for (int lane = 0; lane < 4; ++lane)
+				if (inside & (1 << lane))
+					out.push_back((unsigned int)(i + lane));
+		}
+		for (; i < end; ++i) {
+			glm::vec3 center(CenterX[i], CenterY[i], CenterZ[i]);
+			bool inside = (shape == CULL_BOXES) ? frustum.intersectsBox(center, glm::vec3(ExtentX[i], ExtentY[i], ExtentZ[i]))
+				: frustum.intersectsSphere(center, Radius[i]);
+			if (inside)
+				out.push_back((unsigned int)i);
+		}
+	}
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+
+// Runs the simulation in steps of a fixed length, however fast frames are rendered. Each frame adds its real duration
+// to an accumulator and runs as many whole steps as fit; what is left over becomes alpha(), how far the frame is
+// between the last two simulated states.
+//
+//   int steps = timestep.advance(frameSeconds);
+//   for (int i = 0; i < steps; ++i) {
+//       previous = current;
+//       simulate(current, timestep.StepSeconds);
+//   }
+//   draw(interpolate(previous, current, timestep.alpha()));
+//
+// Movement then no longer depends on the frame rate, and the simulation can run at 60 Hz while frames are drawn at
+// 144 Hz or more. The drawn state lags the simulation by up to one step, which is what makes interpolating (instead of
+// extrapolating) possible.
+//
+// If a frame takes so long that more than MaxSteps would be due (a breakpoint, the window being dragged, or steps
+// costing more than they simulate), only MaxSteps run and the rest of the time is dropped. Without that cap, a slow
+// frame would queue more steps, making the next frame slower still: the spiral of death.
+class FixedTimestep
+{
+public:
+	double StepSeconds; // Simulated time per step.
+	int MaxSteps;       // Catch-up cap: most steps run in one frame.
+
+	uint64_t Steps, Frames;
+	uint64_t CappedFrames;  // Frames that hit MaxSteps.
+	double DroppedSeconds;  // Real time never simulated because of the cap.
+
+	FixedTimestep(double hz = 60.0, int maxSteps = 5)
+		: StepSeconds(1.0 / hz), MaxSteps(maxSteps), Steps(0), Frames(0), CappedFrames(0), DroppedSeconds(0.0), accumulator(0.0) {}
+
+	double rate() const { return 1.0 / StepSeconds; }
+
+	// Add a frame's real duration, return the number of steps to run now.
+	int advance(double frameSeconds)
+	{
+		Frames++;
+		accumulator += frameSeconds > 0.0 ? frameSeconds : 0.0;
+		int steps = (int)(accumulator / StepSeconds);
+		if (steps > MaxSteps) {
+			CappedFrames++;
+			DroppedSeconds += accumulator - MaxSteps * StepSeconds;
+			accumulator = MaxSteps * StepSeconds; // Keep less than a step after running them.
+			steps = MaxSteps;
+		}
+		accumulator -= steps * StepSeconds;
+		Steps += steps;
+		return steps;
+	}
+
+	// Position of the frame between the previous (0) and the current (1) simulated state.
+	float alpha() const { return (float)(accumulator / StepSeconds); }
+
+	// Simulated time: the end of the last step.
+	double time() const { return Steps * StepSeconds; }
+
+	void printStats() const
+	{
+		std::cout << std::fixed << std::setprecision(1) << "Simulation: " << Steps << " steps at " << rate() << " Hz over "
+			<< Frames << " frames (" << (Frames ? (double)Steps / Frames : 0.0) << std::setprecision(3) << " per frame), "
+			<< CappedFrames << " frames hit the cap of " << MaxSteps << " steps, " << DroppedSeconds << "s dropped" << std::endl;
+	}
+
+private:
+	double accumulator; // Real time not simulated yet, less than one step between frames.
+};
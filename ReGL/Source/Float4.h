@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGL_SSE2
+#endif
+
+
+// Four floats, or four lane masks. SSE2 on x86, plain arrays elsewhere. Used by the software rasterizer
+// (SoftwareRasterizer.h), frustum culling (Culling.h) and the occlusion buffer (OcclusionCulling.h).
+struct Float4
+{
+#ifdef REGL_SSE2
+	__m128 V;
+#else
+	float V[4];
+#endif
+};
+
+#ifdef REGL_SSE2
+inline Float4 float4(__m128 v) { Float4 r; r.V = v; return r; }
+inline Float4 splat4(float x) { return float4(_mm_set1_ps(x)); }
+inline Float4 float4(float a, float b, float c, float d) { return float4(_mm_setr_ps(a, b, c, d)); }
+inline Float4 load4(const float* p) { return float4(_mm_load_ps(p)); }
+inline Float4 load4u(const float* p) { return float4(_mm_loadu_ps(p)); } // No alignment needed
+inline void store4(float* p, Float4 a) { _mm_store_ps(p, a.V); }
+inline void store4u(float* p, Float4 a) { _mm_storeu_ps(p, a.V); }
+inline Float4 operator+(Float4 a, Float4 b) { return float4(_mm_add_ps(a.V, b.V)); }
+inline Float4 operator-(Float4 a, Float4 b) { return float4(_mm_sub_ps(a.V, b.V)); }
+inline Float4 operator*(Float4 a, Float4 b) { return float4(_mm_mul_ps(a.V, b.V)); }
+inline Float4 operator/(Float4 a, Float4 b) { return float4(_mm_div_ps(a.V, b.V)); }
+inline Float4 operator&(Float4 a, Float4 b) { return float4(_mm_and_ps(a.V, b.V)); }
+inline Float4 operator|(Float4 a, Float4 b) { return float4(_mm_or_ps(a.V, b.V)); }
+inline Float4 greater4(Float4 a, Float4 b) { return float4(_mm_cmpgt_ps(a.V, b.V)); }
+inline Float4 less4(Float4 a, Float4 b) { return float4(_mm_cmplt_ps(a.V, b.V)); }
+inline Float4 lessEqual4(Float4 a, Float4 b) { return float4(_mm_cmple_ps(a.V, b.V)); }
+inline Float4 equal4(Float4 a, Float4 b) { return float4(_mm_cmpeq_ps(a.V, b.V)); }
+inline Float4 select4(Float4 mask, Float4 a, Float4 b) { return float4(_mm_or_ps(_mm_and_ps(mask.V, a.V), _mm_andnot_ps(mask.V, b.V))); }
+inline int laneMask4(Float4 mask) { return _mm_movemask_ps(mask.V); }
+inline Float4 maskAll4(bool on) { return float4(_mm_castsi128_ps(_mm_set1_epi32(on ? -1 : 0))); }
+#else
+inline Float4 float4(float a, float b, float c, float d) { Float4 r; r.V[0] = a; r.V[1] = b; r.V[2] = c; r.V[3] = d; return r; }
+inline Float4 splat4(float x) { return float4(x, x, x, x); }
+inline Float4 load4(const float* p) { return float4(p[0], p[1], p[2], p[3]); }
+inline Float4 load4u(const float* p) { return load4(p); }
+inline void store4(float* p, Float4 a) { std::memcpy(p, a.V, sizeof(a.V)); }
+inline void store4u(float* p, Float4 a) { store4(p, a); }
+#define REGL_FLOAT4_OP(name, expression) \
+	inline Float4 name(Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; ++i) { float x = a.V[i], y = b.V[i]; r.V[i] = (expression); } return r; }
+inline float maskBits(bool on) { uint32_t bits = on ? 0xFFFFFFFFu : 0u; float f; std::memcpy(&f, &bits, 4); return f; }
+inline uint32_t floatBits(float f) { uint32_t bits; std::memcpy(&bits, &f, 4); return bits; }
+inline float bitsFloat(uint32_t bits) { float f; std::memcpy(&f, &bits, 4); return f; }
+REGL_FLOAT4_OP(operator+, x + y)
+REGL_FLOAT4_OP(operator-, x - y)
+REGL_FLOAT4_OP(operator*, x * y)
+REGL_FLOAT4_OP(operator/, x / y)
+REGL_FLOAT4_OP(operator&, bitsFloat(floatBits(x) & floatBits(y)))
+REGL_FLOAT4_OP(operator|, bitsFloat(floatBits(x) | floatBits(y)))
+REGL_FLOAT4_OP(greater4, maskBits(x > y))
+REGL_FLOAT4_OP(less4, maskBits(x < y))
+REGL_FLOAT4_OP(lessEqual4, maskBits(x <= y))
+REGL_FLOAT4_OP(equal4, maskBits(x == y))
+#undef REGL_FLOAT4_OP
+inline Float4 select4(Float4 mask, Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; ++i) r.V[i] = floatBits(mask.V[i]) ? a.V[i] : b.V[i]; return r; }
+inline int laneMask4(Float4 mask) { int bits = 0; for (int i = 0; i < 4; ++i) bits |= (floatBits(mask.V[i]) >> 31) << i; return bits; }
+inline Float4 maskAll4(bool on) { return splat4(maskBits(on)); }
+#endif
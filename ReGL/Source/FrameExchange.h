@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+
+// Hands frames from one producer thread to one consumer thread without locks: the main thread fills a packet with
+// everything a frame needs (camera matrices, draw list), publishes it, and the render thread picks it up.
+//
+// Three slots: the one the producer writes, the one the consumer reads, and the latest published one in between. Publishing
+// and acquiring each swap a slot with the one in between in a single atomic exchange, so neither side ever waits for the
+// other to finish with a slot, and a slot is only ever touched by one thread at a time.
+//
+//   // Main thread                              // Render thread
+//   FramePacket& packet = frames.writeSlot();    while (frames.waitForPacket(quitting)) {
+//   ...fill packet...                                const FramePacket& packet = frames.readSlot();
+//   frames.publish();                                ...draw it...
+//                                                }
+//
+// A packet published before the previous one was acquired replaces it (Dropped counts those). Producers that must not
+// drop frames call waitUntilTaken() before publishing, which keeps them at most one frame ahead of the consumer.
+template <typename T>
+class FrameExchange
+{
+public:
+	uint64_t Published, Acquired, Dropped; // Each only written by one side; read them once both are done.
+
+	FrameExchange() : Published(0), Acquired(0), Dropped(0), writeIndex(0), readIndex(2), middle(1) {}
+
+	FrameExchange(const FrameExchange&) = delete;
+	FrameExchange& operator=(const FrameExchange&) = delete;
+
+	// Producer: the slot to fill. It holds an old packet, reuse its memory.
+	T& writeSlot() { return slots[writeIndex]; }
+
+	// Producer: make the write slot the latest packet.
+	void publish()
+	{
+		uint32_t previous = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+		if (previous & FRESH)
+			Dropped++;
+		writeIndex = previous & INDEX_MASK;
+		Published++;
+	}
+
+	// Producer: true while the last published packet has not been acquired yet.
+	bool pending() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+	// Producer: wait until the consumer took the last packet, or `quitting` is set.
+	void waitUntilTaken(const std::atomic<bool>& quitting) const
+	{
+		waitUntil([&]() { return !pending() || quitting.load(std::memory_order_relaxed); });
+	}
+
+	// Consumer: take the latest packet if there is a new one. It stays in readSlot() until the next acquire.
+	bool acquire()
+	{
+		if (!pending())
+			return false;
+		uint32_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+		readIndex = previous & INDEX_MASK;
+		Acquired++;
+		return true;
+	}
+
+	// Consumer: wait for a new packet and acquire it. Returns false once `quitting` is set and nothing is left.
+	bool waitForPacket(const std::atomic<bool>& quitting)
+	{
+		waitUntil([&]() { return pending() || quitting.load(std::memory_order_relaxed); });
+		return acquire();
+	}
+
+	// Consumer: the packet of the last acquire().
+	const T& readSlot() const { return slots[readIndex]; }
+
+private:
+	static const uint32_t FRESH = 4;      // Set in `middle` while its packet hasn't been acquired.
+	static const uint32_t INDEX_MASK = 3;
+
+	T slots[3];
+	uint32_t writeIndex;          // Producer only.
+	uint32_t readIndex;           // Consumer only.
+	std::atomic<uint32_t> middle; // Slot index of the latest packet, plus FRESH.
+
+	// Spin briefly (the other side is usually about to finish), then sleep in short steps so a thread waiting on vsync
+	// doesn't burn a core.
+	template <typename Condition>
+	static void waitUntil(Condition condition)
+	{
+		for (int spin = 0; !condition(); ++spin) {
+			if (spin < 64)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+};
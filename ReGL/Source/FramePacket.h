@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "CommandBuffer.h"
+
+// One object to draw, and where.
+struct FrameDraw
+{
+	unsigned int Object; // Scene object index (the BVH's).
+	glm::mat4 Model;
+};
+
+// Everything the render thread needs to draw one frame, built by the main thread and handed over through a
+// FrameExchange (Source/FrameExchange.h). The render thread never looks at the Camera or the scene directly.
+struct FramePacket
+{
+	uint64_t Frame = 0;
+	float Time = 0.0f;                 // Seconds since start, for the FrameData block.
+	int ViewportWidth = 0, ViewportHeight = 0;
+	glm::mat4 View, Projection;
+	glm::vec3 CameraPosition;
+	std::vector<FrameDraw> Draws;      // What survived culling.
+	CommandBuffer Commands;            // The same draws, recorded for the GL backend, in replay order.
+
+	// The occlusion buffer debug view (F8), RGBA8, only filled while it is shown.
+	bool ShowOcclusionBuffer = false;
+	int OcclusionWidth = 0, OcclusionHeight = 0;
+	std::vector<uint8_t> OcclusionImage;
+};
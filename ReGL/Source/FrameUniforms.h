@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "StateCache.h"
+
+
+// Binding point of the per-frame uniform block. Every program that declares "FrameData" is bound to it.
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
+
+// CPU mirror of the std140 "FrameData" block in the shaders. Only mat4/vec4/float members, so std140 adds no hidden padding
+// besides the explicit tail that rounds the block up to a multiple of 16 bytes.
+struct FrameData
+{
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::mat4 ViewProjection;
+	glm::vec4 CameraPosition; // xyz = camera position, w = 1.
+	float Time;               // Seconds since start.
+	float Padding[3];
+};
+static_assert(sizeof(FrameData) == 224, "FrameData must match the std140 layout of the FrameData uniform block");
+
+
+// Uniform Buffer Object holding the per-frame camera data.
+// It is updated once per frame and shared by all programs, instead of uploading view/projection to every program separately.
+class FrameUniforms
+{
+public:
+	unsigned int UBO;
+	FrameData Data;
+
+	FrameUniforms()
+	{
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW); // Rewritten every frame.
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, UBO); // Attach the whole buffer to the fixed binding point.
+	}
+
+	// Fill the block from the camera and upload it in one call. aspect is the width/height of the render target.
+	// With a state cache the buffer is bound through it and stays bound; without one, GL_UNIFORM_BUFFER is reset to 0.
+	void update(const Camera& camera, float aspect, float time, GLStateCache* state = NULL)
+	{
+		update(camera.GetViewMatrix(), camera.GetProjectionMatrix(aspect), camera.Position, time, state);
+	}
+
+	// The same from matrices, for a thread that doesn't own the Camera (see FramePacket.h).
+	void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float time,
+		GLStateCache* state = NULL)
+	{
+		Data.View = view;
+		Data.Projection = projection;
+		Data.ViewProjection = Data.Projection * Data.View;
+		Data.CameraPosition = glm::vec4(cameraPosition, 1.0f);
+		Data.Time = time;
+		Data.Padding[0] = Data.Padding[1] = Data.Padding[2] = 0.0f;
+
+		if (state != NULL) {
+			state->bindBuffer(GL_UNIFORM_BUFFER, UBO);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &Data);
+			return;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &Data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// De-allocate the buffer. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		glDeleteBuffers(1, &UBO);
+	}
+};
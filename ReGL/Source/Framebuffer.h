@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <iostream>
+#include <vector>
+
+
+// Offscreen render target: an RGBA8 color texture plus a depth renderbuffer.
+// Used to render without a window (headless runs, benchmarks, golden-image tests).
+class Framebuffer
+{
+public:
+	unsigned int ID;
+	unsigned int ColorTexture;
+	unsigned int DepthRenderbuffer;
+	int Width;
+	int Height;
+
+	Framebuffer(int width, int height) : Width(width), Height(height)
+	{
+		glGenFramebuffers(1, &ID);
+		glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+		// Color attachment
+		glGenTextures(1, &ColorTexture);
+		glBindTexture(GL_TEXTURE_2D, ColorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ColorTexture, 0);
+
+		// Depth attachment. We never sample it, so a renderbuffer is enough.
+		glGenRenderbuffers(1, &DepthRenderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, DepthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, DepthRenderbuffer);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER::NOT_COMPLETE" << std::endl;
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// Render into this framebuffer and set the viewport to cover it.
+	void bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, ID);
+		glViewport(0, 0, Width, Height);
+	}
+
+	// Go back to the default framebuffer (the window, if there is one).
+	void unbind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// Read the color attachment back as tightly packed RGBA8 rows, bottom row first.
+	void readPixels(std::vector<unsigned char>& pixels) const
+	{
+		pixels.resize((size_t)Width * Height * 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+
+	// De-allocate all resources. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		glDeleteFramebuffers(1, &ID);
+		glDeleteTextures(1, &ColorTexture);
+		glDeleteRenderbuffers(1, &DepthRenderbuffer);
+	}
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+
+// The six planes of a view frustum, in world space when built from projection * view.
+//
+// Each plane is (normal, distance) with the normal pointing into the frustum, so a point p is inside a plane when
+// dot(normal, p) + distance >= 0 and inside the frustum when it is inside all six. Culling many objects at once is
+// Culling.h's job; the tests here are the scalar reference for one object.
+enum FrustumPlane {
+	FRUSTUM_LEFT,
+	FRUSTUM_RIGHT,
+	FRUSTUM_BOTTOM,
+	FRUSTUM_TOP,
+	FRUSTUM_NEAR,
+	FRUSTUM_FAR,
+	FRUSTUM_PLANE_COUNT
+};
+
+struct Frustum
+{
+	glm::vec4 Planes[FRUSTUM_PLANE_COUNT];
+
+	// Gribb & Hartmann: a clip space point is inside when -w <= x, y, z <= w, and each of those six inequalities is a
+	// plane made of two rows of the matrix. Normalized so distances are in world units (sphere radii need that).
+	static Frustum fromMatrix(const glm::mat4& viewProjection)
+	{
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; ++i)
+			row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.Planes[FRUSTUM_LEFT] = row[3] + row[0];
+		frustum.Planes[FRUSTUM_RIGHT] = row[3] - row[0];
+		frustum.Planes[FRUSTUM_BOTTOM] = row[3] + row[1];
+		frustum.Planes[FRUSTUM_TOP] = row[3] - row[1];
+		frustum.Planes[FRUSTUM_NEAR] = row[3] + row[2];
+		frustum.Planes[FRUSTUM_FAR] = row[3] - row[2];
+		for (glm::vec4& plane : frustum.Planes)
+			plane /= glm::length(glm::vec3(plane));
+		return frustum;
+	}
+
+	bool intersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : Planes)
+			if (glm::dot(glm::vec3(plane), center) + plane.w + radius < 0.0f)
+				return false;
+		return true;
+	}
+
+	// Box given by its center and half size. Conservative: a box near a frustum corner can pass while being outside,
+	// which only costs a draw.
+	bool intersectsBox(const glm::vec3& center, const glm::vec3& extent) const
+	{
+		for (const glm::vec4& plane : Planes) {
+			glm::vec3 normal(plane);
+			float reach = std::fabs(normal.x) * extent.x + std::fabs(normal.y) * extent.y + std::fabs(normal.z) * extent.z;
+			if (glm::dot(normal, center) + plane.w + reach < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+
+// The world space bounding box of a box transformed by `model` (Arvo): the center moves with the matrix, the half size
+// is the absolute value of the rotation and scale applied to it.
+inline void transformBox(const glm::mat4& model, const glm::vec3& center, const glm::vec3& extent, glm::vec3& worldCenter, glm::vec3& worldExtent)
+{
+	worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+	for (int i = 0; i < 3; ++i)
+		worldExtent[i] = std::fabs(model[0][i]) * extent.x + std::fabs(model[1][i]) * extent.y + std::fabs(model[2][i]) * extent.z;
+}
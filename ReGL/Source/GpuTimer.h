@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Profiler.h"
+
+
+// GPU time per named render pass, measured with timestamp queries (GL_TIMESTAMP, core since 3.3), next to the CPU
+// time spent submitting the same pass.
+//
+//   gpuTimer.beginFrame();
+//   {
+//       REGL_GPU_ZONE(gpuTimer, "Draw"); // GPU + CPU time of the scope, and a CPU profiler zone of the same name.
+//       cube.draw(glState);
+//   }
+//   gpuTimer.endFrame();
+//
+// Results arrive a few frames late: every frame has its own set of queries in a ring of GPU_TIMER_FRAMES, and
+// beginFrame() only reads back the oldest set, whose frame the GPU has normally finished by then. If it has not, that
+// frame's results are dropped instead of stalling the pipeline (see Dropped).
+//
+// Timestamps are used rather than GL_TIME_ELAPSED because those queries cannot nest or overlap.
+
+const unsigned int GPU_TIMER_FRAMES = 4;  // Frames in flight before a query set is reused.
+const unsigned int GPU_TIMER_PASSES = 16; // Passes per frame; further passes in a frame are not timed.
+
+class GpuTimer
+{
+public:
+	// Totals per pass name, over every frame read back so far.
+	struct PassStats
+	{
+		std::string Name;
+		double GpuMs = 0.0;   // GPU time from the pass's first to its last command.
+		double CpuMs = 0.0;   // CPU time spent issuing the pass.
+		double LastGpuMs = 0.0;
+		unsigned int Count = 0;
+	};
+
+	std::vector<PassStats> Passes; // In order of first appearance.
+	unsigned int FramesMeasured;
+	unsigned int Dropped;          // Frames whose queries were not ready when their slot came around again.
+	double FrameGpuMs;             // Sum over measured frames, first pass begin to last pass end.
+
+	GpuTimer() : FramesMeasured(0), Dropped(0), FrameGpuMs(0.0), frame(0), inFrame(false)
+	{
+		for (FrameQueries& queries : frames) {
+			glGenQueries(GPU_TIMER_PASSES * 2, queries.Queries);
+			queries.PassCount = 0;
+			queries.Pending = false;
+		}
+	}
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	// Start a frame: collect the results of the frame that last used this slot, if the GPU is done with it.
+	void beginFrame()
+	{
+		FrameQueries& queries = frames[frame % GPU_TIMER_FRAMES];
+		if (queries.Pending)
+			collect(queries);
+		queries.PassCount = 0;
+		queries.Pending = false;
+		inFrame = true;
+	}
+
+	void endFrame()
+	{
+		frames[frame % GPU_TIMER_FRAMES].Pending = frames[frame % GPU_TIMER_FRAMES].PassCount > 0;
+		inFrame = false;
+		frame++;
+	}
+
+	// Use through GpuZone / REGL_GPU_ZONE. Returns the pass index, or -1 if this pass is not timed.
+	int beginPass(const char* name)
+	{
+		FrameQueries& queries = frames[frame % GPU_TIMER_FRAMES];
+		if (!inFrame || queries.PassCount == GPU_TIMER_PASSES)
+			return -1;
+		int pass = (int)queries.PassCount++;
+		queries.Names[pass] = name;
+		queries.CpuStart[pass] = Profiler::steadyNanoseconds();
+		glQueryCounter(queries.Queries[pass * 2], GL_TIMESTAMP); // Recorded when the GPU reaches this point.
+		return pass;
+	}
+
+	void endPass(int pass)
+	{
+		if (pass < 0)
+			return;
+		FrameQueries& queries = frames[frame % GPU_TIMER_FRAMES];
+		glQueryCounter(queries.Queries[pass * 2 + 1], GL_TIMESTAMP);
+		queries.CpuEnd[pass] = Profiler::steadyNanoseconds();
+	}
+
+	// Read back every frame still in flight, waiting for the GPU if needed. For the end of a benchmark run.
+	void flush()
+	{
+		for (unsigned int i = 0; i < GPU_TIMER_FRAMES; ++i) {
+			FrameQueries& queries = frames[(frame + i) % GPU_TIMER_FRAMES];
+			if (queries.Pending)
+				collect(queries, true);
+			queries.Pending = false;
+		}
+	}
+
+	// Forget the results collected so far, e.g. those of warm-up frames.
+	void resetStats()
+	{
+		Passes.clear();
+		FramesMeasured = 0;
+		Dropped = 0;
+		FrameGpuMs = 0.0;
+	}
+
+	// One line per pass with the average GPU and CPU time, in the format of the benchmark reports.
+	void report(const std::string& prefix) const
+	{
+		std::cout << std::fixed << std::setprecision(4);
+		for (const PassStats& pass : Passes) {
+			std::cout << prefix << pass.Name
+				<< "  n=" << pass.Count
+				<< "  gpu=" << (pass.Count ? pass.GpuMs / pass.Count : 0.0) << "ms"
+				<< "  cpu=" << (pass.Count ? pass.CpuMs / pass.Count : 0.0) << "ms"
+				<< std::endl;
+		}
+		std::cout << prefix << "frame  n=" << FramesMeasured
+			<< "  gpu=" << (FramesMeasured ? FrameGpuMs / FramesMeasured : 0.0) << "ms"
+			<< "  dropped=" << Dropped << std::endl;
+	}
+
+	// De-allocate the queries. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		for (FrameQueries& queries : frames)
+			glDeleteQueries(GPU_TIMER_PASSES * 2, queries.Queries);
+	}
+
+private:
+	struct FrameQueries
+	{
+		GLuint Queries[GPU_TIMER_PASSES * 2]; // Begin and end timestamp per pass.
+		const char* Names[GPU_TIMER_PASSES];
+		uint64_t CpuStart[GPU_TIMER_PASSES];
+		uint64_t CpuEnd[GPU_TIMER_PASSES];
+		unsigned int PassCount;
+		bool Pending; // Queries issued, results not read yet.
+	};
+
+	FrameQueries frames[GPU_TIMER_FRAMES];
+	uint64_t frame;
+	bool inFrame;
+
+	void collect(FrameQueries& queries, bool wait = false)
+	{
+		// Queries complete in order, so the last one being available means they all are.
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries.Queries[queries.PassCount * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available && !wait) {
+			Dropped++;
+			return;
+		}
+
+		uint64_t frameBegin = UINT64_MAX, frameEnd = 0;
+		for (unsigned int pass = 0; pass < queries.PassCount; ++pass) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(queries.Queries[pass * 2], GL_QUERY_RESULT, &begin); // Nanoseconds.
+			glGetQueryObjectui64v(queries.Queries[pass * 2 + 1], GL_QUERY_RESULT, &end);
+			frameBegin = (begin < frameBegin) ? begin : frameBegin;
+			frameEnd = (end > frameEnd) ? end : frameEnd;
+
+			PassStats& stats = passStats(queries.Names[pass]);
+			stats.LastGpuMs = (end > begin) ? (double)(end - begin) / 1e6 : 0.0;
+			stats.GpuMs += stats.LastGpuMs;
+			stats.CpuMs += (double)(queries.CpuEnd[pass] - queries.CpuStart[pass]) / 1e6;
+			stats.Count++;
+		}
+		FrameGpuMs += (frameEnd > frameBegin) ? (double)(frameEnd - frameBegin) / 1e6 : 0.0;
+		FramesMeasured++;
+	}
+
+	PassStats& passStats(const char* name)
+	{
+		for (PassStats& stats : Passes)
+			if (stats.Name == name)
+				return stats;
+		Passes.push_back(PassStats());
+		Passes.back().Name = name;
+		return Passes.back();
+	}
+};
+
+
+// Times the enclosing scope as one pass. Use through REGL_GPU_ZONE.
+class GpuZone
+{
+public:
+	GpuZone(GpuTimer& timer, const char* name) : timer(timer), pass(timer.beginPass(name)) {}
+	~GpuZone() { timer.endPass(pass); }
+
+	GpuZone(const GpuZone&) = delete;
+	GpuZone& operator=(const GpuZone&) = delete;
+
+private:
+	GpuTimer& timer;
+	int pass;
+};
+
+// GPU pass plus a CPU profiler zone of the same name, so the CPU side also shows up in the Chrome trace.
+#define REGL_GPU_ZONE(timer, name) \
+	REGL_PROFILE_ZONE(name); \
+	GpuZone REGL_PROFILE_CONCAT(gpuZone, __LINE__)(timer, name)
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <iostream>
+
+// Headless OpenGL context.
+// With REGL_HEADLESS_EGL defined (Linux build boxes, Mesa llvmpipe) the context is created through EGL on the
+// surfaceless platform, so neither a display server nor a GPU is required.
+// Without it we fall back to an invisible 1x1 GLFW window, which is enough on desktops with a driver.
+// Either way all rendering is expected to go into a Framebuffer object.
+#ifdef REGL_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+
+class HeadlessContext
+{
+public:
+	bool Valid; // True if the context was created, made current and GLAD was loaded.
+
+	// Creates an OpenGL 3.3 core context and makes it current on the calling thread.
+	HeadlessContext() : Valid(false)
+	{
+#ifdef REGL_HEADLESS_EGL
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+
+		// The surfaceless platform lets us create a display without X11/Wayland.
+		PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (eglGetPlatformDisplayEXT)
+			display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			std::cout << "Failed to initialize EGL" << std::endl;
+			return;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			std::cout << "Failed to bind the OpenGL API to EGL" << std::endl;
+			return;
+		}
+
+		// We want to use OpenGL 3.3 core, just like the windowed application.
+		const EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs); // EGL_KHR_no_config_context: no surface, so no config.
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+			std::cout << "Failed to create a surfaceless EGL context" << std::endl;
+			return;
+		}
+
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return;
+		}
+#else
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // Never show the window, we only need its context.
+
+		window = glfwCreateWindow(1, 1, "ReGL (headless)", NULL, NULL);
+		if (window == NULL) {
+			std::cout << "Failed to create hidden GLFW window" << std::endl;
+			glfwTerminate();
+			return;
+		}
+		glfwMakeContextCurrent(window);
+
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return;
+		}
+#endif
+		Valid = true;
+	}
+
+	~HeadlessContext()
+	{
+#ifdef REGL_HEADLESS_EGL
+		if (display != EGL_NO_DISPLAY) {
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+		}
+#else
+		if (window != NULL)
+			glfwDestroyWindow(window);
+		glfwTerminate();
+#endif
+	}
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// Address of an OpenGL function in the current context. Useful for entry points that GLAD (gl=3.3, no extensions) does not load.
+	static void* getProcAddress(const char* name)
+	{
+#ifdef REGL_HEADLESS_EGL
+		return (void*)eglGetProcAddress(name);
+#else
+		return (void*)glfwGetProcAddress(name);
+#endif
+	}
+
+private:
+#ifdef REGL_HEADLESS_EGL
+	EGLDisplay display;
+	EGLContext context;
+#else
+	GLFWwindow* window = NULL;
+#endif
+};
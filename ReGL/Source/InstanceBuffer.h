@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+
+// First vertex attribute location used by the per-instance model matrix. A mat4 attribute takes four consecutive
+// locations (one per column), so locations 3, 4, 5 and 6 are used. Must match aInstanceModel in Texture.vert.
+const unsigned int INSTANCE_MODEL_LOCATION = 3;
+
+
+// Per-instance attribute buffer holding one model matrix per instance.
+// Attach it to a mesh VAO and draw with glDrawElementsInstanced, using the INSTANCED variant of Texture.vert,
+// to render thousands of copies of the mesh with a single draw call.
+class InstanceBuffer
+{
+public:
+	unsigned int VBO;
+	size_t Capacity; // Number of matrices the buffer can hold without being reallocated.
+	size_t Count;    // Number of matrices uploaded by the last upload().
+
+	InstanceBuffer() : Capacity(0), Count(0)
+	{
+		glGenBuffers(1, &VBO);
+	}
+
+	// Add the instance attributes to a VAO. The VAO keeps pointing at this buffer, even after it grows.
+	void attach(unsigned int VAO) const
+	{
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (unsigned int column = 0; column < 4; ++column) {
+			unsigned int location = INSTANCE_MODEL_LOCATION + column;
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1); // Advance once per instance instead of once per vertex.
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	// Upload the model matrices for the next draws.
+	void upload(const glm::mat4* models, size_t count)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (count > Capacity) {
+			Capacity = count;
+			glBufferData(GL_ARRAY_BUFFER, Capacity * sizeof(glm::mat4), models, GL_DYNAMIC_DRAW);
+		}
+		else {
+			glBufferData(GL_ARRAY_BUFFER, Capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW); // Orphan the old storage so we never wait for draws still reading it.
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), models);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		Count = count;
+	}
+
+	void upload(const std::vector<glm::mat4>& models)
+	{
+		upload(models.data(), models.size());
+	}
+
+	// De-allocate the buffer. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		glDeleteBuffers(1, &VBO);
+	}
+};
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Profiler.h"
+
+
+// A job is a function called on a range of indices: function(data, begin, end).
+typedef void (*JobFunction)(void* data, int begin, int end);
+
+const int JOB_QUEUE_SIZE = 4096; // Jobs in flight per thread (deque slots and pooled jobs). A power of two.
+
+struct Job
+{
+	JobFunction Function;
+	void* Data;
+	int Begin, End;
+	class JobCounter* Counter; // Decremented once the function returned.
+	class JobCounter* After;   // Not started before this counter is zero.
+	std::atomic<bool> Busy;    // Submitted and not finished yet: its pool slot can't be reused.
+	bool Heap;                 // Allocated for a thread outside the system, deleted once done.
+
+	Job() : Function(NULL), Data(NULL), Begin(0), End(0), Counter(NULL), After(NULL), Busy(false), Heap(false) {}
+};
+
+// Number of unfinished jobs submitted with it. JobSystem::wait() returns once it is zero, and jobs submitted with it as
+// their `after` start once it is zero: that is how dependencies are expressed. A job only waits for the jobs the counter
+// already counts when it is submitted, so submit in dependency order: a job submitted with `after` still at zero starts
+// right away. Reusable once zero.
+class JobCounter
+{
+public:
+	JobCounter() : pending(0) {}
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> pending;
+};
+
+
+// Chase-Lev work-stealing deque, fixed size (Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for
+// Weak Memory Models", 2013). The owner thread pushes and pops at the bottom, like a stack, so it works on its newest
+// (cache-warm) jobs. Other threads steal from the top, the oldest jobs, which for split ranges are also the largest.
+// Only a steal racing for the last job needs a compare-exchange; pushes and pops are otherwise plain loads and stores.
+class JobDeque
+{
+public:
+	JobDeque() : top(0), bottom(0)
+	{
+		for (std::atomic<Job*>& slot : slots)
+			slot.store(NULL, std::memory_order_relaxed);
+	}
+
+	// Owner only. False if full.
+	bool push(Job* job)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= JOB_QUEUE_SIZE)
+			return false;
+		slots[b & (JOB_QUEUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release); // Publishes the job's fields to thieves.
+		return true;
+	}
+
+	// Owner only. The newest job, or NULL.
+	Job* pop()
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b) { // Empty.
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return NULL;
+		}
+		Job* job = slots[b & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (t == b) { // The last one: race the thieves for it.
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = NULL;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	// Any thread. The oldest job, or NULL if empty or another thread got it first.
+	Job* steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return NULL;
+		Job* job = slots[t & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NULL;
+		return job;
+	}
+
+	bool empty() const
+	{
+		return bottom.load(std::memory_order_acquire) <= top.load(std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<int64_t> top;    // Thieves' end.
+	char topPadding[56];         // top and bottom on their own cache lines: thieves only write top, the owner bottom.
+	std::atomic<int64_t> bottom; // Owner's end.
+	char bottomPadding[56];
+	std::atomic<Job*> slots[JOB_QUEUE_SIZE];
+};
+
+
+// Runs jobs on a fixed set of threads: one per hardware thread by default, the thread that creates the system included.
+//
+//   JobSystem jobs;
+//   jobs.parallelFor(count, 64, [&](int i) { update(i); }); // Blocks until done, helping meanwhile.
+//
+//   JobCounter transforms, culled;
+//   jobs.submit(updateTransforms, &scene, 0, objectCount, &transforms);
+//   jobs.submit(cullObjects, &scene, 0, objectCount, &culled, &transforms); // Starts after the transforms are done.
+//   jobs.wait(culled);
+//
+// Every thread of the system has its own JobDeque. Jobs go to the submitting thread's deque, idle threads steal from the
+// others. Threads outside the system (the render thread, loader threads) can submit too; their jobs go through a shared
+// queue behind a mutex, and are allocated on the heap instead of from a per-thread pool.
+//
+// wait() never blocks a thread while there is work: it runs jobs (its own first, then stolen ones) until the counter is
+// zero. Jobs can therefore submit jobs and wait for them, without fibers and without tying up a thread. Idle workers spin
+// briefly, then sleep on a condition variable until something is submitted.
+//
+// Jobs must not block on anything but other jobs (a thread waiting on I/O or the GL thread is lost to all of them), which
+// is why the texture loader keeps its own threads.
+class JobSystem
+{
+public:
+	// threads = 0 uses one thread per hardware thread, the caller included.
+	explicit JobSystem(unsigned int threads = 0) : sleeping(0), injectedCount(0), parkedCount(0), parkedTotal(0), stopping(false)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		workerCount = threads;
+		workers.reset(new Worker[threads]);
+		threadSlot() = ThreadSlot{ this, 0 };
+		for (unsigned int i = 1; i < threads; ++i)
+			threadHandles.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	// Destroy it on the thread that created it, after waiting for every job.
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& thread : threadHandles)
+			thread.join();
+		if (threadSlot().System == this)
+			threadSlot() = ThreadSlot{ NULL, -1 };
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int threadCount() const
+	{
+		return workerCount;
+	}
+
+	// Queue function(data, begin, end). `counter` (if any) counts it until it returned. With `after`, the job starts
+	// only once that counter is zero; it must stay alive until then. `after` must already count every job this one
+	// depends on (they were submitted first): if it is zero now, the job is scheduled at once.
+	void submit(JobFunction function, void* data, int begin, int end, JobCounter* counter = NULL, JobCounter* after = NULL)
+	{
+		int self = threadIndex();
+		Job* job = allocate(self);
+		job->Function = function;
+		job->Data = data;
+		job->Begin = begin;
+		job->End = end;
+		job->Counter = counter;
+		job->After = after;
+		job->Busy.store(true, std::memory_order_relaxed);
+		if (counter != NULL)
+			counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+		if (after != NULL && park(job))
+			return;
+		schedule(job, self);
+	}
+
+	// Call work(i) for every i in [0, count) and return once all calls returned. The range is split in halves down to
+	// `grain` indices per job: the halves are pushed for other threads to steal, so no single thread has to submit
+	// count / grain jobs one by one.
+	template <typename Work>
+	void parallelFor(int count, int grain, const Work& work)
+	{
+		if (count <= 0)
+			return;
+		JobCounter counter;
+		RangeTask<Work> task = { this, &work, std::max(grain, 1), &counter };
+		submit(&runRange<Work>, &task, 0, count, &counter);
+		wait(counter);
+	}
+
+	// Run jobs until the counter is zero.
+	void wait(JobCounter& counter)
+	{
+		int self = threadIndex();
+		int idle = 0;
+		while (counter.pending.load(std::memory_order_acquire) > 0) {
+			if (runOne(self))
+				idle = 0;
+			else if (++idle > 64)
+				std::this_thread::yield(); // The last jobs are running on other threads.
+		}
+	}
+
+	// Jobs run and stolen so far by the system's threads (not by threads outside it). Approximate while jobs are running.
+	uint64_t jobsExecuted() const
+	{
+		uint64_t total = 0;
+		for (unsigned int i = 0; i < workerCount; ++i)
+			total += workers[i].Executed;
+		return total;
+	}
+
+	uint64_t jobsStolen() const
+	{
+		uint64_t total = 0;
+		for (unsigned int i = 0; i < workerCount; ++i)
+			total += workers[i].Stolen;
+		return total;
+	}
+
+	// Jobs that had to wait for their `after` counter so far.
+	uint64_t jobsParked() const
+	{
+		return parkedTotal.load(std::memory_order_relaxed);
+	}
+
+	void printStats() const
+	{
+		std::cout << "Jobs: " << workerCount << " threads, " << jobsExecuted() << " jobs run, " << jobsStolen() << " stolen, "
+			<< jobsParked() << " parked" << std::endl;
+	}
+
+private:
+	struct Worker
+	{
+		JobDeque Deque;
+		Job Pool[JOB_QUEUE_SIZE]; // Reused in order.
+		unsigned int PoolNext = 0;
+		uint64_t Executed = 0, Stolen = 0;
+		uint32_t Random = 0;       // Victim choice.
+		char Padding[64];
+	};
+
+	struct ThreadSlot
+	{
+		JobSystem* System;
+		int Index;
+	};
+
+	template <typename Work>
+	struct RangeTask
+	{
+		JobSystem* System;
+		const Work* Function;
+		int Grain;
+		JobCounter* Counter;
+	};
+
+	std::unique_ptr<Worker[]> workers;
+	unsigned int workerCount;
+	std::vector<std::thread> threadHandles;
+	std::mutex mutex;                 // Guards injected and parked, and the sleep/wake handshake.
+	std::condition_variable wake;
+	std::atomic<int> sleeping;        // Workers waiting on `wake`.
+	std::deque<Job*> injected;        // Submitted by threads outside the system.
+	std::atomic<int> injectedCount;
+	std::vector<Job*> parked;         // Waiting for their `After` counter.
+	std::atomic<int> parkedCount;
+	std::atomic<uint64_t> parkedTotal;
+	bool stopping;
+
+	// Which system the calling thread belongs to, and its index there (-1 for none).
+	static ThreadSlot& threadSlot()
+	{
+		thread_local ThreadSlot slot = { NULL, -1 };
+		return slot;
+	}
+
+	int threadIndex() const
+	{
+		const ThreadSlot& slot = threadSlot();
+		return slot.System == this ? slot.Index : -1;
+	}
+
+	// The next slot of the thread's pool. If that job hasn't finished yet (more than JOB_QUEUE_SIZE of the thread's jobs in
+	// flight), a heap allocation instead: waiting for it could deadlock, the job may be one running further up our stack.
+	Job* allocate(int self)
+	{
+		if (self >= 0) {
+			Worker& worker = workers[self];
+			Job& job = worker.Pool[worker.PoolNext & (JOB_QUEUE_SIZE - 1)];
+			if (!job.Busy.load(std::memory_order_acquire)) {
+				worker.PoolNext++;
+				job.Heap = false;
+				return &job;
+			}
+		}
+		Job* job = new Job;
+		job->Heap = true;
+		return job;
+	}
+
+	void schedule(Job* job, int self)
+	{
+		if (self >= 0) {
+			if (!workers[self].Deque.push(job)) {
+				execute(job, self); // Full: run it right here instead.
+				return;
+			}
+		}
+		else {
+			std::lock_guard<std::mutex> lock(mutex);
+			injected.push_back(job);
+			injectedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		// Wake a sleeper. The fence pairs with the one in hasWork(): either the sleeper sees the job, or we see it sleeping.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			wake.notify_one();
+		}
+	}
+
+	// Keep the job aside until its After counter is zero. False if it already is: schedule it now.
+	bool park(Job* job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		parkedCount.fetch_add(1, std::memory_order_seq_cst);
+		if (job->After->pending.load(std::memory_order_seq_cst) == 0) {
+			parkedCount.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+		parked.push_back(job);
+		parkedTotal.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// A counter reached zero: schedule the parked jobs that were waiting for it (or for any other finished counter).
+	// Only the parked jobs' counters are read, which their submitters keep alive; the finished one may be gone already.
+	void releaseParked(int self)
+	{
+		std::vector<Job*> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < parked.size();) {
+				if (parked[i]->After->pending.load(std::memory_order_acquire) == 0) {
+					ready.push_back(parked[i]);
+					parked[i] = parked.back();
+					parked.pop_back();
+					parkedCount.fetch_sub(1, std::memory_order_relaxed);
+				}
+				else {
+					++i;
+				}
+			}
+		}
+		for (Job* job : ready)
+			schedule(job, self);
+	}
+
+	void execute(Job* job, int self)
+	{
+		job->Function(job->Data, job->Begin, job->End);
+		JobCounter* counter = job->Counter;
+		if (job->Heap)
+			delete job;
+		else
+			job->Busy.store(false, std::memory_order_release); // Its owner may reuse the slot from here on.
+		if (self >= 0)
+			workers[self].Executed++;
+		// The decrement is the last access to the counter: a waiter may destroy it right after.
+		if (counter != NULL && counter->pending.fetch_sub(1, std::memory_order_seq_cst) == 1
+			&& parkedCount.load(std::memory_order_seq_cst) > 0)
+			releaseParked(self);
+	}
+
+	// Run one job: the newest of our own, the oldest from outside, or a stolen one. False if there was nothing.
+	bool runOne(int self)
+	{
+		Job* job = self >= 0 ? workers[self].Deque.pop() : NULL;
+		if (job == NULL && injectedCount.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!injected.empty()) {
+				job = injected.front();
+				injected.pop_front();
+				injectedCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (job == NULL)
+			job = steal(self);
+		if (job == NULL)
+			return false;
+		execute(job, self);
+		return true;
+	}
+
+	// Try every other thread once, starting at a random one so thieves spread out.
+	Job* steal(int self)
+	{
+		unsigned int start = 0;
+		if (self >= 0) {
+			uint32_t& x = workers[self].Random;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			start = x % workerCount;
+		}
+		for (unsigned int k = 0; k < workerCount; ++k) {
+			unsigned int victim = (start + k) % workerCount;
+			if ((int)victim == self)
+				continue;
+			if (Job* job = workers[victim].Deque.steal()) {
+				if (self >= 0)
+					workers[self].Stolen++;
+				return job;
+			}
+		}
+		return NULL;
+	}
+
+	bool hasWork()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (injectedCount.load(std::memory_order_relaxed) > 0)
+			return true;
+		for (unsigned int i = 0; i < workerCount; ++i)
+			if (!workers[i].Deque.empty())
+				return true;
+		return false;
+	}
+
+	void workerLoop(unsigned int self)
+	{
+		REGL_PROFILE_THREAD("Jobs");
+		threadSlot() = ThreadSlot{ this, (int)self };
+		workers[self].Random = 2463534242u + self * 2654435761u;
+		int idle = 0;
+		while (true) {
+			if (runOne((int)self)) {
+				idle = 0;
+				continue;
+			}
+			if (++idle < 64) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			sleeping.fetch_add(1, std::memory_order_seq_cst);
+			wake.wait(lock, [this] { return stopping || hasWork(); });
+			sleeping.fetch_sub(1, std::memory_order_relaxed);
+			if (stopping)
+				return;
+			idle = 0;
+		}
+	}
+
+	// Split [begin, end) until it is at most Grain long, leaving the other halves for thieves, then run what is left.
+	template <typename Work>
+	static void runRange(void* data, int begin, int end)
+	{
+		RangeTask<Work>* task = (RangeTask<Work>*)data;
+		while (end - begin > task->Grain) {
+			int middle = begin + (end - begin) / 2;
+			task->System->submit(&runRange<Work>, data, middle, end, task->Counter);
+			end = middle;
+		}
+		for (int i = begin; i < end; ++i)
+			(*task->Function)(i);
+	}
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Reading, writing and uploading of block-compressed textures stored in KTX2 files (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html).
+//
+// The cook step (Cook/Cook.cpp) turns Textures/wall.jpg into Textures/wall.ktx2 with every mip level precomputed, and
+// the texture loaders prefer the .ktx2 next to an image when there is one. Uploading is then a glCompressedTexImage2D
+// per level: no decode, no glGenerateMipmap, and 4-6x less memory and bandwidth than RGB8/RGBA8.
+//
+// Only what ReGL writes is supported: 2D, one layer, one face, no supercompression, BC1/BC3/BC7. The pixels are stored
+// bottom row first like everything uploaded through stb_image here (KTXorientation "ru").
+
+// The S3TC/BPTC enums are not part of the GL 3.3 core header glad was generated for.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT  0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM     0x8E8C
+#endif
+
+// Vulkan format numbers, which is what KTX2 uses to identify the format.
+const uint32_t KTX2_FORMAT_BC1_RGB_UNORM = 131;
+const uint32_t KTX2_FORMAT_BC1_RGBA_UNORM = 133;
+const uint32_t KTX2_FORMAT_BC3_UNORM = 137;
+const uint32_t KTX2_FORMAT_BC7_UNORM = 145;
+
+struct KTX2Image
+{
+	uint32_t Format = 0;                     // One of the KTX2_FORMAT_* values.
+	int Width = 0, Height = 0;               // Of level 0.
+	std::vector<std::vector<uint8_t>> Levels; // Compressed blocks, level 0 (largest) first.
+};
+
+// Bytes per 4x4 block, or 0 if the format is not supported.
+inline unsigned int ktx2BlockBytes(uint32_t format)
+{
+	switch (format) {
+	case KTX2_FORMAT_BC1_RGB_UNORM:
+	case KTX2_FORMAT_BC1_RGBA_UNORM: return 8;
+	case KTX2_FORMAT_BC3_UNORM:
+	case KTX2_FORMAT_BC7_UNORM:      return 16;
+	default:                         return 0;
+	}
+}
+
+inline GLenum ktx2InternalFormat(uint32_t format)
+{
+	switch (format) {
+	case KTX2_FORMAT_BC1_RGB_UNORM:  return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case KTX2_FORMAT_BC1_RGBA_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	case KTX2_FORMAT_BC3_UNORM:      return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case KTX2_FORMAT_BC7_UNORM:      return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default:                         return GL_NONE;
+	}
+}
+
+inline size_t ktx2LevelSize(uint32_t format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * ktx2BlockBytes(format);
+}
+
+// "Textures/wall.jpg" -> "Textures/wall.ktx2"
+inline std::string cookedTexturePath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + ".ktx2";
+	return path.substr(0, dot) + ".ktx2";
+}
+
+
+// Which compressed formats the current context can sample from. Query on the GL thread, then pass the copy around.
+struct CompressedFormats
+{
+	bool S3TC = false; // BC1 - BC3, EXT_texture_compression_s3tc (every desktop driver).
+	bool BPTC = false; // BC7, ARB_texture_compression_bptc (core in GL 4.2).
+
+	bool supports(uint32_t format) const
+	{
+		if (format == KTX2_FORMAT_BC7_UNORM)
+			return BPTC;
+		return S3TC && ktx2BlockBytes(format) != 0;
+	}
+};
+
+inline CompressedFormats queryCompressedFormats()
+{
+	CompressedFormats formats;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+			formats.S3TC = true;
+		else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+			formats.BPTC = true;
+	}
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 2))
+		formats.BPTC = true;
+	return formats;
+}
+
+
+// ----FILE LAYOUT----
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX2Header
+{
+	uint32_t VkFormat;
+	uint32_t TypeSize;
+	uint32_t PixelWidth, PixelHeight, PixelDepth;
+	uint32_t LayerCount, FaceCount, LevelCount;
+	uint32_t SupercompressionScheme;
+	uint32_t DfdByteOffset, DfdByteLength;
+	uint32_t KvdByteOffset, KvdByteLength;
+	uint64_t SgdByteOffset, SgdByteLength;
+};
+
+struct KTX2LevelIndex
+{
+	uint64_t ByteOffset, ByteLength, UncompressedByteLength;
+};
+
+// Files are little-endian, and so is every platform ReGL runs on.
+inline void ktx2Append(std::vector<uint8_t>& out, const void* data, size_t bytes)
+{
+	const uint8_t* begin = (const uint8_t*)data;
+	out.insert(out.end(), begin, begin + bytes);
+}
+
+inline void ktx2AppendU32(std::vector<uint8_t>& out, uint32_t value)
+{
+	ktx2Append(out, &value, 4);
+}
+
+inline void ktx2Align(std::vector<uint8_t>& out, size_t alignment)
+{
+	while (out.size() % alignment != 0)
+		out.push_back(0);
+}
+
+// Basic data format descriptor: tells generic KTX2 tools what the blocks hold. The GL side only needs VkFormat.
+inline void ktx2AppendDFD(std::vector<uint8_t>& out, uint32_t format)
+{
+	bool alpha = (format == KTX2_FORMAT_BC3_UNORM);
+	uint32_t colorModel = (format == KTX2_FORMAT_BC7_UNORM) ? 134 : alpha ? 130 : 128; // KHR_DF_MODEL_BC7 / BC3 / BC1A
+	uint32_t samples = alpha ? 2 : 1;
+	uint32_t blockSize = 24 + 16 * samples;
+
+	ktx2AppendU32(out, 4 + blockSize);                  // dfdTotalSize
+	ktx2AppendU32(out, 0);                              // vendorId = Khronos, descriptorType = basic
+	ktx2AppendU32(out, 2 | (blockSize << 16));          // versionNumber = 2, descriptorBlockSize
+	ktx2AppendU32(out, colorModel | (1 << 8) | (1 << 16)); // colorPrimaries = BT709, transferFunction = linear, flags = 0
+	ktx2AppendU32(out, 3 | (3 << 8));                   // texelBlockDimension: 4x4x1x1, stored minus one
+	ktx2AppendU32(out, ktx2BlockBytes(format));         // bytesPlane0
+	ktx2AppendU32(out, 0);                              // bytesPlane4-7
+	if (alpha) {
+		ktx2AppendU32(out, 0 | (63 << 16) | (15u << 24)); // bitOffset 0, bitLength 64, channel BC3_ALPHA
+		ktx2AppendU32(out, 0);                              // samplePosition
+		ktx2AppendU32(out, 0);                              // sampleLower
+		ktx2AppendU32(out, 0xFFFFFFFFu);                    // sampleUpper
+	}
+	ktx2AppendU32(out, (alpha ? 64 : 0) | (63 << 16) | (0u << 24)); // The color block, channel 0 = COLOR
+	ktx2AppendU32(out, 0);
+	ktx2AppendU32(out, 0);
+	ktx2AppendU32(out, 0xFFFFFFFFu);
+}
+
+// Write a KTX2 file. Returns false (and prints why) if the file could not be written.
+inline bool writeKTX2(const std::string& path, const KTX2Image& image)
+{
+	const uint32_t levelCount = (uint32_t)image.Levels.size();
+	const size_t levelIndexOffset = sizeof(KTX2_IDENTIFIER) + 9 * 4 + 4 * 4 + 2 * 8;
+
+	std::vector<uint8_t> dfd;
+	ktx2AppendDFD(dfd, image.Format);
+
+	std::vector<uint8_t> kvd;
+	const char key[] = "KTXorientation";
+	const char value[] = "ru"; // Rows go up: the first row in the file is the bottom one.
+	ktx2AppendU32(kvd, (uint32_t)(sizeof(key) + sizeof(value)));
+	ktx2Append(kvd, key, sizeof(key));
+	ktx2Append(kvd, value, sizeof(value));
+	ktx2Align(kvd, 4);
+
+	KTX2Header header = {};
+	header.VkFormat = image.Format;
+	header.TypeSize = 1;
+	header.PixelWidth = (uint32_t)image.Width;
+	header.PixelHeight = (uint32_t)image.Height;
+	header.FaceCount = 1;
+	header.LevelCount = levelCount;
+	header.DfdByteOffset = (uint32_t)(levelIndexOffset + levelCount * sizeof(KTX2LevelIndex));
+	header.DfdByteLength = (uint32_t)dfd.size();
+	header.KvdByteOffset = header.DfdByteOffset + header.DfdByteLength;
+	header.KvdByteLength = (uint32_t)kvd.size();
+
+	std::vector<uint8_t> out;
+	ktx2Append(out, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	ktx2Append(out, &header.VkFormat, 9 * 4);
+	ktx2Append(out, &header.DfdByteOffset, 4 * 4);
+	ktx2Append(out, &header.SgdByteOffset, 2 * 8);
+	out.resize(levelIndexOffset + levelCount * sizeof(KTX2LevelIndex)); // Level index, filled in below.
+	ktx2Append(out, dfd.data(), dfd.size());
+	ktx2Append(out, kvd.data(), kvd.size());
+
+	// Level data goes smallest level first, each one aligned to the block size.
+	std::vector<KTX2LevelIndex> levels(levelCount);
+	for (uint32_t level = levelCount; level-- > 0;) {
+		ktx2Align(out, ktx2BlockBytes(image.Format));
+		levels[level].ByteOffset = out.size();
+		levels[level].ByteLength = image.Levels[level].size();
+		levels[level].UncompressedByteLength = image.Levels[level].size();
+		ktx2Append(out, image.Levels[level].data(), image.Levels[level].size());
+	}
+	std::memcpy(&out[levelIndexOffset], levels.data(), levelCount * sizeof(KTX2LevelIndex));
+
+	std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+	file.write((const char*)out.data(), (std::streamsize)out.size());
+	if (!file) {
+		std::cout << "ERROR::KTX2::CANNOT_WRITE " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Read a KTX2 file written by writeKTX2 (or any tool, as long as it fits the limits above).
+// Returns false without printing anything if the file does not exist, so callers can fall back quietly.
+// Safe to call from any thread.
+inline bool readKTX2(const std::string& path, KTX2Image& image)
+{
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	std::vector<uint8_t> data((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)data.data(), (std::streamsize)data.size());
+
+	const size_t levelIndexOffset = sizeof(KTX2_IDENTIFIER) + 9 * 4 + 4 * 4 + 2 * 8;
+	if (!file || data.size() < levelIndexOffset || std::memcmp(data.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+		std::cout << "ERROR::KTX2::NOT_A_KTX2_FILE " << path << std::endl;
+		return false;
+	}
+
+	KTX2Header header;
+	std::memcpy(&header.VkFormat, &data[12], 9 * 4);
+	std::memcpy(&header.DfdByteOffset, &data[48], 4 * 4);
+	std::memcpy(&header.SgdByteOffset, &data[64], 2 * 8);
+	uint32_t levelCount = (header.LevelCount == 0) ? 1 : header.LevelCount; // 0 means "generate the mips", we just use level 0.
+	if (ktx2BlockBytes(header.VkFormat) == 0 || header.PixelDepth != 0 || header.LayerCount > 1 || header.FaceCount != 1
+		|| header.SupercompressionScheme != 0 || header.PixelWidth == 0 || header.PixelHeight == 0
+		|| data.size() < levelIndexOffset + levelCount * sizeof(KTX2LevelIndex)) {
+		std::cout << "ERROR::KTX2::UNSUPPORTED_LAYOUT " << path << std::endl;
+		return false;
+	}
+
+	// Only bottom-up files can be uploaded as they are; the rest would show upside down.
+	std::string orientation = "rd"; // The default when the key is missing.
+	for (size_t at = header.KvdByteOffset; at + 4 <= (size_t)header.KvdByteOffset + header.KvdByteLength && at + 4 <= data.size();) {
+		uint32_t length;
+		std::memcpy(&length, &data[at], 4);
+		if (at + 4 + length > data.size())
+			break;
+		const char* entry = (const char*)&data[at + 4];
+		if (length > 15 && std::strncmp(entry, "KTXorientation", 15) == 0)
+			orientation = std::string(entry + 15, strnlen(entry + 15, length - 15));
+		at += (4 + length + 3) & ~(size_t)3;
+	}
+	if (orientation.size() < 2 || orientation[1] != 'u') {
+		std::cout << "ERROR::KTX2::TOP_DOWN_ORIENTATION_NOT_SUPPORTED " << path << std::endl;
+		return false;
+	}
+
+	image.Format = header.VkFormat;
+	image.Width = (int)header.PixelWidth;
+	image.Height = (int)header.PixelHeight;
+	image.Levels.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		KTX2LevelIndex index;
+		std::memcpy(&index, &data[levelIndexOffset + level * sizeof(KTX2LevelIndex)], sizeof(index));
+		int width = (image.Width >> level) ? image.Width >> level : 1;
+		int height = (image.Height >> level) ? image.Height >> level : 1;
+		if (index.ByteLength != ktx2LevelSize(image.Format, width, height) || index.ByteOffset + index.ByteLength > data.size()) {
+			std::cout << "ERROR::KTX2::BAD_LEVEL " << level << " " << path << std::endl;
+			return false;
+		}
+		image.Levels[level].assign(data.begin() + (size_t)index.ByteOffset, data.begin() + (size_t)(index.ByteOffset + index.ByteLength));
+	}
+	return true;
+}
+
+// Upload every level into the texture bound to GL_TEXTURE_2D. Mipmaps come from the file, so sampling is limited to the
+// levels it has. The caller checks CompressedFormats::supports first.
+inline void uploadCompressedTexture(const KTX2Image& image)
+{
+	GLenum internalFormat = ktx2InternalFormat(image.Format);
+	for (size_t level = 0; level < image.Levels.size(); ++level) {
+		int width = (image.Width >> level) ? image.Width >> level : 1;
+		int height = (image.Height >> level) ? image.Height >> level : 1;
+		glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, width, height, 0, (GLsizei)image.Levels[level].size(), image.Levels[level].data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.Levels.size() - 1);
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "StateCache.h"
+
+
+// How one vertex attribute is stored in the vertex buffer. Everything but VERTEX_FLOAT is converted back to floats by
+// the vertex fetch, so the shaders don't change; only the bytes read per vertex do.
+enum VertexFormat
+{
+	VERTEX_FLOAT,      // 32-bit float per component.
+	VERTEX_HALF,       // 16-bit float per component. Exact for small integers and halves; ~3 decimal digits otherwise.
+	VERTEX_SNORM16,    // [-1, 1] in 16-bit signed integers. Positions must be scaled into [-1, 1] first.
+	VERTEX_UNORM16,    // [0, 1] in 16-bit unsigned integers. Texture coordinates that don't repeat.
+	VERTEX_UNORM8,     // [0, 1] in 8-bit unsigned integers. Colors.
+	VERTEX_OCT_SNORM16 // Unit vector (3 source floats) octahedral-encoded in 2 snorm16 components. Decode with octDecode below.
+};
+
+// GLSL for VERTEX_OCT_SNORM16 attributes, which arrive in the shader as a vec2:
+//
+//   vec3 octDecode(vec2 e)
+//   {
+//       vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//       float t = max(-n.z, 0.0);
+//       n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+//       return normalize(n);
+//   }
+
+
+// One attribute of a VertexLayout.
+struct VertexAttribute
+{
+	GLuint Location;    // Shader attribute location.
+	int Components;     // Components read from the source vertex (3 for VERTEX_OCT_SNORM16).
+	VertexFormat Format;
+	size_t Offset;      // Byte offset in the encoded vertex.
+};
+
+
+// Declarative description of an interleaved vertex. The source vertices are floats, attributes one after the other in
+// the order they were added; the encoded vertex stores each attribute in its format, padded to 4 bytes.
+//
+//   VertexLayout layout;
+//   layout.add(0, 3, VERTEX_HALF)     // position: 8 bytes instead of 12
+//         .add(1, 3, VERTEX_UNORM8)   // color:    4 bytes instead of 12
+//         .add(2, 2, VERTEX_UNORM16); // uv:       4 bytes instead of 8
+class VertexLayout
+{
+public:
+	std::vector<VertexAttribute> Attributes;
+	size_t Stride;           // Bytes per encoded vertex.
+	size_t SourceComponents; // Floats per source vertex.
+
+	VertexLayout() : Stride(0), SourceComponents(0) {}
+
+	VertexLayout& add(GLuint location, int components, VertexFormat format)
+	{
+		VertexAttribute attribute;
+		attribute.Location = location;
+		attribute.Components = components;
+		attribute.Format = format;
+		attribute.Offset = Stride;
+		Attributes.push_back(attribute);
+		Stride += (encodedBytes(attribute) + 3) & ~(size_t)3; // GL reads attributes fastest when they start on 4-byte boundaries.
+		SourceComponents += components;
+		return *this;
+	}
+
+	// Bytes one attribute takes in the encoded vertex, before padding.
+	static size_t encodedBytes(const VertexAttribute& attribute)
+	{
+		switch (attribute.Format) {
+		case VERTEX_FLOAT: return attribute.Components * 4;
+		case VERTEX_UNORM8: return attribute.Components;
+		case VERTEX_OCT_SNORM16: return 2 * 2;
+		default: return attribute.Components * 2;
+		}
+	}
+
+	// Point the attributes of the bound VAO at the bound GL_ARRAY_BUFFER.
+	void apply() const
+	{
+		for (const VertexAttribute& attribute : Attributes) {
+			GLint size = attribute.Components;
+			GLenum type = GL_FLOAT;
+			GLboolean normalized = GL_FALSE;
+			switch (attribute.Format) {
+			case VERTEX_FLOAT: break;
+			case VERTEX_HALF: type = GL_HALF_FLOAT; break;
+			case VERTEX_SNORM16: type = GL_SHORT; normalized = GL_TRUE; break;
+			case VERTEX_UNORM16: type = GL_UNSIGNED_SHORT; normalized = GL_TRUE; break;
+			case VERTEX_UNORM8: type = GL_UNSIGNED_BYTE; normalized = GL_TRUE; break;
+			case VERTEX_OCT_SNORM16: size = 2; type = GL_SHORT; normalized = GL_TRUE; break;
+			}
+			glVertexAttribPointer(attribute.Location, size, type, normalized, (GLsizei)Stride, (void*)attribute.Offset);
+			glEnableVertexAttribArray(attribute.Location);
+		}
+	}
+};
+
+
+// Round a float to the nearest half float (IEEE 754 binary16), ties to even. Out of range values become infinity.
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	if (magnitude >= 0x7F800000) // Infinity or NaN
+		return sign | 0x7C00 | ((magnitude > 0x7F800000) ? 0x200 : 0);
+	if (magnitude >= 0x477FF000) // Rounds to 65536 or more
+		return sign | 0x7C00;
+	if (magnitude < 0x38800000) { // Below the smallest normal half: denormal or zero.
+		if (magnitude < 0x33000000)
+			return sign;
+		uint32_t exponent = magnitude >> 23;
+		uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		uint32_t shift = 126 - exponent; // 14..24
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return sign | (uint16_t)half;
+	}
+	// Normal: rebias the exponent and round the mantissa from 23 to 10 bits. A carry into the exponent is correct.
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	uint32_t rest = magnitude & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return sign | (uint16_t)half;
+}
+
+inline float halfToFloat(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		bits = sign;
+	else { // Denormal: normalize it.
+		exponent = 113;
+		while ((mantissa & 0x400) == 0) {
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Map a unit vector onto the [-1, 1] square: project it on the octahedron |x| + |y| + |z| = 1, then fold the lower
+// half over the diagonals. Two 16-bit components keep normals within ~0.005 degrees.
+inline void octEncode(const float* normal, float* encoded)
+{
+	float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	float x = (length > 0.0f) ? normal[0] / length : 0.0f;
+	float y = (length > 0.0f) ? normal[1] / length : 0.0f;
+	if (length > 0.0f && normal[2] < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = x;
+	encoded[1] = y;
+}
+
+inline int16_t floatToSnorm16(float value)
+{
+	return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+inline uint16_t floatToUnorm16(float value)
+{
+	return (uint16_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f);
+}
+
+inline uint8_t floatToUnorm8(float value)
+{
+	return (uint8_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+}
+
+// Convert float vertices (`sourceStride` floats apart, at least layout.SourceComponents) to the layout's encoding.
+inline std::vector<uint8_t> encodeVertices(const VertexLayout& layout, const float* vertices, size_t sourceStride, size_t vertexCount)
+{
+	std::vector<uint8_t> encoded(layout.Stride * vertexCount, 0); // Padding bytes stay zero.
+	for (size_t v = 0; v < vertexCount; ++v) {
+		const float* source = vertices + v * sourceStride;
+		uint8_t* vertex = encoded.data() + v * layout.Stride;
+		for (const VertexAttribute& attribute : layout.Attributes) {
+			uint8_t* out = vertex + attribute.Offset;
+			switch (attribute.Format) {
+			case VERTEX_FLOAT:
+				std::memcpy(out, source, attribute.Components * sizeof(float));
+				break;
+			case VERTEX_HALF:
+				for (int c = 0; c < attribute.Components; ++c) {
+					uint16_t half = floatToHalf(source[c]);
+					std::memcpy(out + c * 2, &half, 2);
+				}
+				break;
+			case VERTEX_SNORM16:
+				for (int c = 0; c < attribute.Components; ++c) {
+					int16_t snorm = floatToSnorm16(source[c]);
+					std::memcpy(out + c * 2, &snorm, 2);
+				}
+				break;
+			case VERTEX_UNORM16:
+				for (int c = 0; c < attribute.Components; ++c) {
+					uint16_t unorm = floatToUnorm16(source[c]);
+					std::memcpy(out + c * 2, &unorm, 2);
+				}
+				break;
+			case VERTEX_UNORM8:
+				for (int c = 0; c < attribute.Components; ++c)
+					out[c] = floatToUnorm8(source[c]);
+				break;
+			case VERTEX_OCT_SNORM16: {
+				float octahedral[2];
+				octEncode(source, octahedral);
+				int16_t snorm[2] = { floatToSnorm16(octahedral[0]), floatToSnorm16(octahedral[1]) };
+				std::memcpy(out, snorm, sizeof(snorm));
+				break;
+			}
+			}
+			source += attribute.Components;
+		}
+	}
+	return encoded;
+}
+
+// Smallest index type that can address `vertexCount` vertices.
+inline GLenum indexTypeFor(size_t vertexCount)
+{
+	return (vertexCount <= 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline size_t indexSize(GLenum indexType)
+{
+	return (indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
+}
+
+
+// An indexed triangle mesh in GPU buffers, with any VertexLayout. Owns its VAO, VBO and EBO.
+// Indices are stored as GL_UNSIGNED_SHORT whenever the vertex count allows, halving the index buffer.
+class Mesh
+{
+public:
+	unsigned int VAO, VBO, EBO;
+	unsigned int IndexCount;
+	unsigned int VertexCount;
+	GLenum IndexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	VertexLayout Layout;
+
+	Mesh() : VAO(0), VBO(0), EBO(0), IndexCount(0), VertexCount(0), IndexType(GL_UNSIGNED_INT) {}
+
+	// Encode float vertices (`sourceStride` floats apart) with `layout` and upload them with the indices.
+	Mesh(const VertexLayout& layout, const float* vertices, size_t sourceStride, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+		: Mesh()
+	{
+		std::vector<uint8_t> encoded = encodeVertices(layout, vertices, sourceStride, vertexCount);
+		GLenum indexType = indexTypeFor(vertexCount);
+		if (indexType == GL_UNSIGNED_SHORT) {
+			std::vector<uint16_t> shortIndices(indices, indices + indexCount);
+			create(layout, encoded.data(), vertexCount, shortIndices.data(), indexCount, indexType);
+		}
+		else
+			create(layout, encoded.data(), vertexCount, indices, indexCount, indexType);
+	}
+
+	// Upload vertices already encoded with `layout` and indices of `indexType` as they are.
+	Mesh(const VertexLayout& layout, const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, GLenum indexType)
+		: Mesh()
+	{
+		create(layout, vertexData, vertexCount, indexData, indexCount, indexType);
+	}
+
+	size_t vertexBytes() const { return Layout.Stride * VertexCount; }
+	size_t indexBytes() const { return indexSize(IndexType) * IndexCount; }
+
+	// De-allocate all resources once they've outlived their purpose. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+
+	// Draw the mesh using the VAO and EBO.
+	void draw() const
+	{
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, IndexCount, IndexType, 0);
+		glBindVertexArray(0);
+	}
+
+	// Draw through the state cache. The VAO stays bound, so drawing the mesh again costs no extra bind.
+	void draw(GLStateCache& state) const
+	{
+		state.bindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, IndexCount, IndexType, 0);
+	}
+
+	// Draw `count` instances with one draw call. The VAO needs an InstanceBuffer attached.
+	void drawInstanced(GLsizei count) const
+	{
+		glBindVertexArray(VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, IndexCount, IndexType, 0, count);
+		glBindVertexArray(0);
+	}
+
+	void drawInstanced(GLStateCache& state, GLsizei count) const
+	{
+		state.bindVertexArray(VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, IndexCount, IndexType, 0, count);
+	}
+
+private:
+	void create(const VertexLayout& layout, const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, GLenum indexType)
+	{
+		Layout = layout;
+		VertexCount = (unsigned int)vertexCount;
+		IndexCount = (unsigned int)indexCount;
+		IndexType = indexType;
+
+		// Vertex Buffer Object (VBO) can store a large number of vertices in the GPU's memory so we can render a large object quickly.
+		// Vertex Array Object (VAO) can store the configuration of vertex attributes (like pointers to vertex attributes in the VBO) and which VBO to use.
+		// Element Buffer Object (EBO) is a buffer, just like a vertex buffer object, that stores indices that OpenGL uses to decide what vertices to draw.
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glBindVertexArray(VAO); // Bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, layout.Stride * vertexCount, vertexData, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // The EBO binding is recorded in the VAO.
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize(indexType) * indexCount, indexData, GL_STATIC_DRAW);
+		layout.apply(); // Specify how OpenGL should interpret the vertex data before rendering.
+
+		// Unbind the VBO and VAO. This is good practice so we don't accidentally modify the VBO and VAO while we're not using them.
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+};
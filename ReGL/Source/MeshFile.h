@@ -0,0 +1,300 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Mesh.h"
+
+
+// ReGL's binary mesh container (.rmesh), written by the cook step (Cook/Cook.cpp) from OBJ files.
+//
+// A header with the VertexLayout, then the encoded vertices and the indices exactly as glBufferData wants them, each
+// blob aligned to MESH_FILE_ALIGNMENT. Loading maps the file into memory and hands the two blobs straight to
+// glBufferData: no parsing, no intermediate copy, and the OS only reads the pages the upload touches.
+// The triangles are already optimized (Source/MeshOptimizer.h) and the indices 16-bit when they fit.
+//
+//   Mesh mesh;
+//   if (loadMeshFile("Models/bunny.rmesh", mesh))
+//       mesh.draw();
+//
+// Files are little-endian, and so is every platform ReGL runs on.
+
+// Attribute locations of cooked meshes. Positions, colors and uvs use the locations of Texture.vert; normals come after
+// the instance matrix (3-6, see InstanceBuffer.h).
+const GLuint MESH_POSITION_LOCATION = 0;
+const GLuint MESH_COLOR_LOCATION = 1;
+const GLuint MESH_TEXCOORD_LOCATION = 2;
+const GLuint MESH_NORMAL_LOCATION = 7;
+
+static const uint8_t MESH_FILE_IDENTIFIER[8] = { 0xAB, 'R', 'M', 'S', 'H', '\r', '\n', 0x1A };
+const uint32_t MESH_FILE_VERSION = 1;
+const uint32_t MESH_FILE_MAX_ATTRIBUTES = 8;
+const size_t MESH_FILE_ALIGNMENT = 64; // Blobs start on a cache line.
+
+struct MeshFileAttribute
+{
+	uint32_t Location, Components, Format, Offset; // VertexAttribute, Format is a VertexFormat.
+};
+
+struct MeshFileHeader
+{
+	uint8_t Identifier[8];
+	uint32_t Version;
+	uint32_t VertexCount, IndexCount;
+	uint32_t IndexType;              // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	uint32_t Stride, AttributeCount;
+	MeshFileAttribute Attributes[MESH_FILE_MAX_ATTRIBUTES];
+	float BoundsMin[3], BoundsMax[3]; // Of the positions.
+	uint64_t VertexOffset, VertexBytes;
+	uint64_t IndexOffset, IndexBytes;
+};
+static_assert(sizeof(MeshFileHeader) == 216, "MeshFileHeader must match the file layout");
+
+// "Models/bunny.obj" -> "Models/bunny.rmesh"
+inline std::string cookedMeshPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + ".rmesh";
+	return path.substr(0, dot) + ".rmesh";
+}
+
+// Write a mesh file from vertices encoded with `layout` (see encodeVertices) and 32-bit indices, which are stored as
+// 16-bit when the vertex count allows. Returns false (and prints why) if the file could not be written.
+inline bool writeMeshFile(const std::string& path, const VertexLayout& layout, const std::vector<uint8_t>& vertices, size_t vertexCount,
+	const std::vector<unsigned int>& indices, const float* boundsMin, const float* boundsMax)
+{
+	if (layout.Attributes.size() > MESH_FILE_MAX_ATTRIBUTES) {
+		std::cout << "ERROR::MESH_FILE::TOO_MANY_ATTRIBUTES " << path << std::endl;
+		return false;
+	}
+
+	MeshFileHeader header = {};
+	std::memcpy(header.Identifier, MESH_FILE_IDENTIFIER, sizeof(MESH_FILE_IDENTIFIER));
+	header.Version = MESH_FILE_VERSION;
+	header.VertexCount = (uint32_t)vertexCount;
+	header.IndexCount = (uint32_t)indices.size();
+	header.IndexType = indexTypeFor(vertexCount);
+	header.Stride = (uint32_t)layout.Stride;
+	header.AttributeCount = (uint32_t)layout.Attributes.size();
+	for (size_t i = 0; i < layout.Attributes.size(); ++i) {
+		const VertexAttribute& attribute = layout.Attributes[i];
+		header.Attributes[i].Location = attribute.Location;
+		header.Attributes[i].Components = (uint32_t)attribute.Components;
+		header.Attributes[i].Format = (uint32_t)attribute.Format;
+		header.Attributes[i].Offset = (uint32_t)attribute.Offset;
+	}
+	std::memcpy(header.BoundsMin, boundsMin, sizeof(header.BoundsMin));
+	std::memcpy(header.BoundsMax, boundsMax, sizeof(header.BoundsMax));
+
+	auto align = [](uint64_t offset) { return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1); };
+	header.VertexOffset = align(sizeof(MeshFileHeader));
+	header.VertexBytes = layout.Stride * vertexCount;
+	header.IndexOffset = align(header.VertexOffset + header.VertexBytes);
+	header.IndexBytes = indexSize(header.IndexType) * indices.size();
+
+	std::vector<uint8_t> out((size_t)(header.IndexOffset + header.IndexBytes), 0);
+	std::memcpy(out.data(), &header, sizeof(header));
+	std::memcpy(&out[(size_t)header.VertexOffset], vertices.data(), (size_t)header.VertexBytes);
+	if (header.IndexType == GL_UNSIGNED_SHORT) {
+		uint16_t* shortIndices = (uint16_t*)&out[(size_t)header.IndexOffset];
+		for (size_t i = 0; i < indices.size(); ++i)
+			shortIndices[i] = (uint16_t)indices[i];
+	}
+	else
+		std::memcpy(&out[(size_t)header.IndexOffset], indices.data(), (size_t)header.IndexBytes);
+
+	std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+	file.write((const char*)out.data(), (std::streamsize)out.size());
+	if (!file) {
+		std::cout << "ERROR::MESH_FILE::CANNOT_WRITE " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+// A whole file mapped read-only into memory.
+class MappedFile
+{
+public:
+	const uint8_t* Data;
+	size_t Size;
+
+	MappedFile() : Data(NULL), Size(0)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+	{
+	}
+
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false without printing anything if the file does not exist or is empty.
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		Data = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		Size = (size_t)size.QuadPart;
+#else
+		int descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+			::close(descriptor);
+			return false;
+		}
+		void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		::close(descriptor); // The mapping keeps the file open.
+		if (view != MAP_FAILED) {
+			madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL); // Read ahead: all of it goes to the GPU, in order.
+			madvise(view, (size_t)info.st_size, MADV_WILLNEED);
+			Data = (const uint8_t*)view;
+		}
+		Size = (size_t)info.st_size;
+#endif
+		if (Data == NULL) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (Data)
+			UnmapViewOfFile(Data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (Data)
+			munmap((void*)Data, Size);
+#endif
+		Data = NULL;
+		Size = 0;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+
+// A mesh file mapped into memory. The vertex and index pointers point into the mapping and stay valid until close().
+class MeshFile
+{
+public:
+	MeshFileHeader Header;
+
+	// Map the file and check its header. Returns false without printing anything if the file does not exist, so callers
+	// can fall back quietly. Safe to call from any thread.
+	bool open(const std::string& path)
+	{
+		if (!file.open(path))
+			return false;
+
+		if (file.Size < sizeof(MeshFileHeader) || std::memcmp(file.Data, MESH_FILE_IDENTIFIER, sizeof(MESH_FILE_IDENTIFIER)) != 0) {
+			std::cout << "ERROR::MESH_FILE::NOT_A_MESH_FILE " << path << std::endl;
+			file.close();
+			return false;
+		}
+		std::memcpy(&Header, file.Data, sizeof(Header));
+
+		bool valid = Header.Version == MESH_FILE_VERSION && Header.AttributeCount <= MESH_FILE_MAX_ATTRIBUTES
+			&& (Header.IndexType == GL_UNSIGNED_SHORT || Header.IndexType == GL_UNSIGNED_INT)
+			&& Header.VertexBytes == (uint64_t)Header.Stride * Header.VertexCount
+			&& Header.IndexBytes == (uint64_t)indexSize(Header.IndexType) * Header.IndexCount
+			// Offset + Bytes could wrap around with a crafted header: compare against what is left after the offset.
+			&& Header.VertexOffset <= file.Size && Header.VertexBytes <= file.Size - Header.VertexOffset
+			&& Header.IndexOffset <= file.Size && Header.IndexBytes <= file.Size - Header.IndexOffset;
+		for (uint32_t i = 0; valid && i < Header.AttributeCount; ++i)
+			valid = Header.Attributes[i].Format <= VERTEX_OCT_SNORM16 && Header.Attributes[i].Offset < Header.Stride;
+		if (!valid) {
+			std::cout << "ERROR::MESH_FILE::UNSUPPORTED_LAYOUT " << path << std::endl;
+			file.close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() { file.close(); }
+
+	// The layout the vertices were encoded with.
+	VertexLayout layout() const
+	{
+		VertexLayout result;
+		for (uint32_t i = 0; i < Header.AttributeCount; ++i)
+			result.add(Header.Attributes[i].Location, (int)Header.Attributes[i].Components, (VertexFormat)Header.Attributes[i].Format);
+		return result;
+	}
+
+	const void* vertexData() const { return file.Data + Header.VertexOffset; }
+	const void* indexData() const { return file.Data + Header.IndexOffset; }
+	size_t fileBytes() const { return file.Size; }
+
+private:
+	MappedFile file;
+};
+
+// Map a mesh file and upload it into `mesh`. Returns false if the file is missing or invalid.
+// boundsMin/boundsMax, when given, receive the bounding box of the positions (3 floats each).
+inline bool loadMeshFile(const std::string& path, Mesh& mesh, float* boundsMin = NULL, float* boundsMax = NULL)
+{
+	MeshFile file;
+	if (!file.open(path))
+		return false;
+	VertexLayout layout = file.layout();
+	if (layout.Stride != file.Header.Stride) {
+		std::cout << "ERROR::MESH_FILE::UNSUPPORTED_LAYOUT " << path << std::endl;
+		return false;
+	}
+	mesh = Mesh(layout, file.vertexData(), file.Header.VertexCount, file.indexData(), file.Header.IndexCount, file.Header.IndexType);
+	if (boundsMin)
+		std::memcpy(boundsMin, file.Header.BoundsMin, sizeof(file.Header.BoundsMin));
+	if (boundsMax)
+		std::memcpy(boundsMax, file.Header.BoundsMax, sizeof(file.Header.BoundsMax));
+	return true;
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// Reordering passes for indexed triangle meshes, run once when a mesh is imported:
+//
+//   optimizeVertexCache(indices)         Triangle order that reuses recently transformed vertices (Forsyth's algorithm).
+//   optimizeOverdraw(indices, vertices)  Cluster order that draws outward-facing parts first, keeping most of the cache gain.
+//   optimizeVertexFetch(vertices, indices)  Vertex order matching first use, so the fetches walk the buffer forward.
+//
+// optimizeMesh() runs the three in that order. analyzeVertexCache() and analyzeVertexFetch() measure the result.
+// Vertices are float arrays `sourceStride` floats apart whose first three floats are the position, as for Mesh.
+const unsigned int MESH_CACHE_SIZE = 16;          // FIFO post-transform cache simulated by analyzeVertexCache and optimizeOverdraw.
+const int MESH_FORSYTH_CACHE_SIZE = 32;           // LRU cache modelled by the vertex cache optimizer's scores.
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;      // How much worse a cluster's ACMR may get so it can be split and sorted.
+
+
+// Post-transform vertex cache efficiency of an index buffer, with a FIFO cache of `cacheSize` vertices.
+struct VertexCacheStats
+{
+	unsigned int VerticesTransformed; // Cache misses.
+	float ACMR;                       // Average cache miss ratio: transforms per triangle. 3 is worst, ~0.5 is best on regular grids.
+	float ATVR;                       // Average transform to vertex ratio: transforms per vertex. 1 is ideal.
+};
+
+inline VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = MESH_CACHE_SIZE)
+{
+	// Timestamp FIFO: a vertex is in the cache if fewer than cacheSize misses happened since it was last loaded.
+	std::vector<unsigned int> loadedAt(vertexCount, 0);
+	unsigned int misses = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		unsigned int vertex = indices[i];
+		if (loadedAt[vertex] == 0 || misses + 1 - loadedAt[vertex] > cacheSize) {
+			misses++;
+			loadedAt[vertex] = misses;
+		}
+	}
+	VertexCacheStats stats;
+	stats.VerticesTransformed = misses;
+	stats.ACMR = (indexCount > 0) ? misses / (float)(indexCount / 3) : 0.0f;
+	stats.ATVR = (vertexCount > 0) ? misses / (float)vertexCount : 0.0f;
+	return stats;
+}
+
+
+// Memory traffic of the vertex fetches of an index buffer, through a direct-mapped cache of 64-byte lines.
+struct VertexFetchStats
+{
+	size_t BytesFetched;
+	float Overfetch; // BytesFetched over the size of the vertex buffer. 1 is ideal.
+};
+
+inline VertexFetchStats analyzeVertexFetch(const unsigned int* indices, size_t indexCount, size_t vertexCount, size_t vertexSize)
+{
+	const size_t lineSize = 64, lineCount = 512; // 32 KiB, about the size of a GPU's L1 for vertex data.
+	std::vector<size_t> lines(lineCount, (size_t)-1);
+	size_t fetched = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		size_t first = indices[i] * vertexSize / lineSize, last = (indices[i] * vertexSize + vertexSize - 1) / lineSize;
+		for (size_t line = first; line <= last; ++line) {
+			if (lines[line % lineCount] != line) {
+				lines[line % lineCount] = line;
+				fetched += lineSize;
+			}
+		}
+	}
+	VertexFetchStats stats;
+	stats.BytesFetched = fetched;
+	stats.Overfetch = (vertexCount > 0) ? fetched / (float)(vertexCount * vertexSize) : 0.0f;
+	return stats;
+}
+
+
+// ------------------------VERTEX CACHE------------------------
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": every vertex gets a score from its position in a modelled LRU
+// cache (recently used vertices score high, the last triangle's a bit less so the next one doesn't simply flip) and from
+// how many triangles still use it (finishing off nearly done vertices avoids coming back to them later). The next
+// triangle is always the best scoring one among those touching the cache; when none is left, the first unemitted one.
+inline void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Score tables.
+	const int maxValence = 32;
+	float cacheScores[MESH_FORSYTH_CACHE_SIZE], valenceScores[maxValence + 1];
+	for (int position = 0; position < MESH_FORSYTH_CACHE_SIZE; ++position)
+		cacheScores[position] = (position < 3) ? 0.75f
+			: std::pow(1.0f - (position - 3) / (float)(MESH_FORSYTH_CACHE_SIZE - 3), 1.5f);
+	valenceScores[0] = 0.0f;
+	for (int valence = 1; valence <= maxValence; ++valence)
+		valenceScores[valence] = 2.0f / std::sqrt((float)valence);
+
+	// Triangles of every vertex. The first `live[v]` entries are the ones not emitted yet.
+	std::vector<unsigned int> offsets(vertexCount + 1, 0), live(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		live[indices[i]]++;
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(offsets[vertexCount]);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	auto vertexScore = [&](unsigned int v) {
+		if (live[v] == 0)
+			return -1.0f; // Done; its triangles can't be picked anyway.
+		float s = valenceScores[std::min<unsigned int>(live[v], maxValence)];
+		return (cachePosition[v] >= 0) ? s + cacheScores[cachePosition[v]] : s;
+	};
+	for (size_t v = 0; v < vertexCount; ++v)
+		score[v] = vertexScore((unsigned int)v);
+
+	std::vector<unsigned int> source(indices, indices + triangleCount * 3);
+	std::vector<bool> emitted(triangleCount, false);
+	unsigned int cache[MESH_FORSYTH_CACHE_SIZE + 3], newCache[MESH_FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	size_t nextUnemitted = 0;
+	long best = 0;
+
+	for (size_t out = 0; out < triangleCount; ++out) {
+		if (best < 0) { // Dead end: nothing in the cache has triangles left.
+			while (emitted[nextUnemitted])
+				nextUnemitted++;
+			best = (long)nextUnemitted;
+		}
+		const unsigned int* triangle = &source[best * 3];
+		std::memcpy(&indices[out * 3], triangle, 3 * sizeof(unsigned int));
+		emitted[best] = true;
+
+		// Take the triangle out of its vertices' live lists.
+		for (int k = 0; k < 3; ++k) {
+			unsigned int v = triangle[k];
+			unsigned int* list = &adjacency[offsets[v]];
+			for (unsigned int j = 0; j < live[v]; ++j) {
+				if (list[j] == (unsigned int)best) {
+					std::swap(list[j], list[live[v] - 1]);
+					live[v]--;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache, the rest shift back.
+		int newCount = 0;
+		for (int k = 0; k < 3; ++k)
+			if (std::find(newCache, newCache + newCount, triangle[k]) == newCache + newCount)
+				newCache[newCount++] = triangle[k];
+		const int front = newCount;
+		for (int i = 0; i < cacheCount; ++i)
+			if (std::find(newCache, newCache + front, cache[i]) == newCache + front)
+				newCache[newCount++] = cache[i];
+		for (int i = 0; i < newCount; ++i) {
+			unsigned int v = newCache[i];
+			cachePosition[v] = (i < MESH_FORSYTH_CACHE_SIZE) ? i : -1; // The last ones fell out.
+			score[v] = vertexScore(v);
+		}
+		cacheCount = std::min(newCount, MESH_FORSYTH_CACHE_SIZE);
+		std::memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+
+		// Best triangle touching the cache.
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; ++i) {
+			unsigned int v = cache[i];
+			for (unsigned int j = 0; j < live[v]; ++j) {
+				unsigned int t = adjacency[offsets[v] + j];
+				float s = score[source[t * 3]] + score[source[t * 3 + 1]] + score[source[t * 3 + 2]];
+				if (s > bestScore) {
+					bestScore = s;
+					best = t;
+				}
+			}
+		}
+	}
+}
+
+
+// ------------------------OVERDRAW------------------------
+// After optimizeVertexCache: cut the triangle order into clusters, wherever the cache starts over anyway and wherever
+// the cluster so far has an ACMR within `threshold` of its whole run, then sort the clusters so the ones facing away
+// from the mesh center (dot of the cluster's normal with its offset from the center) are drawn first. From most
+// directions, those hide the rest, so the depth test rejects more fragments before they're shaded.
+inline void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices, size_t sourceStride, size_t vertexCount,
+	float threshold = MESH_OVERDRAW_THRESHOLD)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Cache misses of a run of triangles, starting from an empty FIFO cache.
+	std::vector<unsigned int> loadedAt(vertexCount, 0);
+	unsigned int clock = 0; // Misses so far, over all runs; a new run starts `cacheSize` misses later.
+	auto beginRun = [&]() { clock += MESH_CACHE_SIZE; };
+	auto triangleMisses = [&](size_t t) {
+		unsigned int misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			unsigned int v = indices[t * 3 + k];
+			if (loadedAt[v] == 0 || clock + 1 - loadedAt[v] > MESH_CACHE_SIZE) {
+				clock++;
+				loadedAt[v] = clock;
+				misses++;
+			}
+		}
+		return misses;
+	};
+
+	// Hard boundaries: triangles that miss all three vertices, where splitting costs nothing.
+	std::vector<size_t> hard;
+	beginRun();
+	for (size_t t = 0; t < triangleCount; ++t)
+		if (triangleMisses(t) == 3)
+			hard.push_back(t);
+	hard.push_back(triangleCount);
+
+	// Soft boundaries inside every hard cluster.
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h) {
+		size_t start = hard[h], end = hard[h + 1];
+		if (start == end)
+			continue;
+		beginRun();
+		unsigned int clusterMisses = 0;
+		for (size_t t = start; t < end; ++t)
+			clusterMisses += triangleMisses(t);
+		float target = threshold * clusterMisses / (float)(end - start);
+
+		beginRun();
+		size_t runStart = start;
+		unsigned int runMisses = 0;
+		clusters.push_back(start);
+		for (size_t t = start; t < end; ++t) {
+			runMisses += triangleMisses(t);
+			if (t + 1 < end && runMisses <= target * (t + 1 - runStart)) {
+				clusters.push_back(t + 1);
+				runStart = t + 1;
+				runMisses = 0;
+				beginRun();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Area-weighted centroid of the mesh, and of every cluster with its summed normal.
+	auto position = [&](unsigned int v) { return vertices + (size_t)v * sourceStride; };
+	std::vector<float> centroids((clusters.size() - 1) * 3, 0.0f), normals((clusters.size() - 1) * 3, 0.0f), areas(clusters.size() - 1, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f }, meshArea = 0.0f;
+	for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			const float* a = position(indices[t * 3]);
+			const float* b = position(indices[t * 3 + 1]);
+			const float* d = position(indices[t * 3 + 2]);
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; ++k) {
+				centroids[c * 3 + k] += (a[k] + b[k] + d[k]) / 3.0f * area;
+				normals[c * 3 + k] += n[k];
+			}
+			areas[c] += area;
+		}
+		for (int k = 0; k < 3; ++k)
+			meshCentroid[k] += centroids[c * 3 + k];
+		meshArea += areas[c];
+	}
+	for (int k = 0; k < 3; ++k)
+		meshCentroid[k] = (meshArea > 0.0f) ? meshCentroid[k] / meshArea : 0.0f;
+
+	std::vector<float> sortKey(clusters.size() - 1);
+	std::vector<size_t> order(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+		float* n = &normals[c * 3];
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float key = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			float center = (areas[c] > 0.0f) ? centroids[c * 3 + k] / areas[c] : 0.0f;
+			key += (center - meshCentroid[k]) * ((length > 0.0f) ? n[k] / length : 0.0f);
+		}
+		sortKey[c] = key;
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(triangleCount * 3);
+	for (size_t c : order)
+		sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	std::memcpy(indices, sorted.data(), sorted.size() * sizeof(unsigned int));
+}
+
+
+// ------------------------VERTEX FETCH------------------------
+// Renumber the vertices in the order the indices first use them and move them accordingly. Vertices no triangle uses
+// are dropped. Returns the new vertex count; `vertices` keeps its size, the first (count * sourceStride) floats are valid.
+inline size_t optimizeVertexFetch(float* vertices, size_t sourceStride, size_t vertexCount, unsigned int* indices, size_t indexCount)
+{
+	std::vector<unsigned int> remap(vertexCount, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		unsigned int& target = remap[indices[i]];
+		if (target == ~0u)
+			target = next++;
+		indices[i] = target;
+	}
+
+	std::vector<float> moved((size_t)next * sourceStride);
+	for (size_t v = 0; v < vertexCount; ++v)
+		if (remap[v] != ~0u)
+			std::memcpy(&moved[(size_t)remap[v] * sourceStride], vertices + v * sourceStride, sourceStride * sizeof(float));
+	std::memcpy(vertices, moved.data(), moved.size() * sizeof(float));
+	return next;
+}
+
+
+// All three passes, in order. Shrinks `vertices` if some were unused.
+inline void optimizeMesh(std::vector<float>& vertices, size_t sourceStride, std::vector<unsigned int>& indices)
+{
+	size_t vertexCount = vertices.size() / sourceStride;
+	optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+	optimizeOverdraw(indices.data(), indices.size(), vertices.data(), sourceStride, vertexCount);
+	vertexCount = optimizeVertexFetch(vertices.data(), sourceStride, vertexCount, indices.data(), indices.size());
+	vertices.resize(vertexCount * sourceStride);
+}
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "TileWorkers.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define REGL_MIPMAP_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REGL_MIPMAP_SSE2
+#endif
+
+
+// Mip chain generation on the CPU, in place of glGenerateMipmap: the filter is the same on every driver, and the work can
+// run on decode threads or at cook time instead of on the GL thread.
+//
+//   std::vector<MipLevel> mips = generateMipmaps(pixels, width, height, channels, options); // Levels 1..n, down to 1x1.
+//
+// Every level is filtered from the previous one in 32-bit float, so rounding errors don't accumulate down the chain:
+//   - sRGB: color channels are averaged in linear light and encoded again, so mips don't get darker than the image.
+//   - Premultiplied alpha: colors are weighted by their alpha while filtering, so transparent texels (whose color is
+//     arbitrary) don't bleed into their neighbours.
+//   - The filter is separable, a horizontal pass into a scratch image and a vertical pass, both vectorized: one RGBA
+//     pixel per SSE2 register horizontally, and 8 floats per AVX2 register vertically (where rows are contiguous).
+//   - With a TileWorkers pool, the rows of each level are split into bands filtered in parallel.
+//
+// Box is what glGenerateMipmap does, the exact average of the 2x2 (or, for odd sizes, 2.5x2.5) texels underneath.
+// Kaiser is a windowed sinc, a little more expensive but sharper, with less aliasing; taps past the edges wrap around,
+// like GL_REPEAT.
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER,
+};
+
+struct MipOptions
+{
+	MipFilter Filter = MIP_FILTER_BOX;
+	bool SRGB = true;               // Color channels are sRGB-encoded, like photos and most painted textures.
+	bool Premultiply = false;       // Weight colors by alpha (images with an alpha channel). The result is straight alpha again.
+	TileWorkers* Workers = NULL;    // Threads to split each level across; NULL runs on the calling thread.
+};
+
+// One level of the chain, same channel count as the image it came from.
+struct MipLevel
+{
+	int Width = 0, Height = 0;
+	std::vector<uint8_t> Pixels;
+};
+
+const float MIP_KAISER_RADIUS = 2.0f; // In pixels of the smaller level: 8 taps per axis when halving.
+const float MIP_KAISER_ALPHA = 4.0f;  // Window shape; higher is smoother, with less ringing but a softer result.
+const int MIP_ROWS_PER_TASK = 16;     // Rows per band handed to a worker.
+
+
+// ----CONVERSIONS----
+
+inline float srgbToLinear(float c)
+{
+	return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float c)
+{
+	return (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Lookup tables for 8-bit sRGB: decoding is one load, encoding a table guess fixed up against the exact thresholds.
+struct SrgbTables
+{
+	float ToLinear[256];
+	float Thresholds[256];      // Thresholds[c] = linear value halfway between codes c - 1 and c.
+	uint8_t Guess[4096];
+
+	static const SrgbTables& instance()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	uint8_t encode(float linear) const
+	{
+		int code = Guess[(int)(linear * 4095.0f)]; // linear is already clamped to [0, 1].
+		while (code < 255 && linear >= Thresholds[code + 1])
+			code++;
+		while (code > 0 && linear < Thresholds[code])
+			code--;
+		return (uint8_t)code;
+	}
+
+private:
+	SrgbTables()
+	{
+		for (int c = 0; c < 256; ++c) {
+			ToLinear[c] = srgbToLinear(c / 255.0f);
+			Thresholds[c] = (c == 0) ? 0.0f : srgbToLinear((c - 0.5f) / 255.0f);
+		}
+		for (int i = 0; i < 4096; ++i)
+			Guess[i] = (uint8_t)std::min(255.0f, std::floor(linearToSrgb(i / 4095.0f) * 255.0f + 0.5f));
+	}
+};
+
+
+// ----FILTERS----
+
+// Which source texels, with which weights, make up every texel of the next level along one axis.
+struct MipAxis
+{
+	int Taps = 0;               // Per destination texel; unused taps have weight 0.
+	std::vector<int> Index;     // Source texel per tap, already wrapped.
+	std::vector<float> Weight;  // Sums to 1 per destination texel.
+};
+
+inline float mipKaiserWindow(float x) // x in [-1, 1]
+{
+	// Zeroth-order modified Bessel function of the first kind, by its power series.
+	auto bessel = [](float v) {
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 20; ++k) {
+			term *= (v * 0.5f / k) * (v * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	};
+	float t = 1.0f - x * x;
+	return (t <= 0.0f) ? 0.0f : bessel(MIP_KAISER_ALPHA * std::sqrt(t)) / bessel(MIP_KAISER_ALPHA);
+}
+
+inline MipAxis mipAxis(int sourceSize, int size, MipFilter filter)
+{
+	MipAxis axis;
+	const float scale = (float)sourceSize / (float)size; // Source texels per destination texel.
+	if (scale == 1.0f) {
+		axis.Taps = 1;
+		for (int i = 0; i < size; ++i) {
+			axis.Index.push_back(i);
+			axis.Weight.push_back(1.0f);
+		}
+		return axis;
+	}
+
+	const float radius = (filter == MIP_FILTER_BOX) ? 0.5f * scale : MIP_KAISER_RADIUS * scale; // In source texels.
+	axis.Taps = (int)std::ceil(2.0f * radius) + 1;
+	for (int i = 0; i < size; ++i) {
+		const float center = (i + 0.5f) * scale; // Texel centers are at +0.5.
+		const int first = (int)std::floor(center - radius);
+		float sum = 0.0f;
+		size_t start = axis.Weight.size();
+		for (int k = 0; k < axis.Taps; ++k) {
+			int source = first + k;
+			float weight;
+			if (filter == MIP_FILTER_BOX) { // Overlap of [source, source + 1] with the destination texel.
+				weight = std::max(0.0f, std::min((float)source + 1.0f, center + radius) - std::max((float)source, center - radius));
+			}
+			else {
+				float x = ((float)source + 0.5f - center) / scale; // In destination texels.
+				float sinc = (x == 0.0f) ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+				weight = sinc * mipKaiserWindow(x / MIP_KAISER_RADIUS);
+			}
+			source %= sourceSize;
+			axis.Index.push_back((source < 0) ? source + sourceSize : source);
+			axis.Weight.push_back(weight);
+			sum += weight;
+		}
+		for (size_t k = start; k < axis.Weight.size(); ++k)
+			axis.Weight[k] /= sum;
+	}
+
+	// Drop the last tap if no texel uses it: exact halving then costs 2 box taps instead of 3, 8 Kaiser taps instead of 9.
+	bool lastUnused = true;
+	for (int i = 0; i < size; ++i)
+		lastUnused = lastUnused && axis.Weight[(size_t)i * axis.Taps + axis.Taps - 1] == 0.0f;
+	if (lastUnused) {
+		MipAxis trimmed;
+		trimmed.Taps = axis.Taps - 1;
+		for (size_t k = 0; k < axis.Weight.size(); ++k) {
+			if ((int)(k % axis.Taps) == trimmed.Taps)
+				continue;
+			trimmed.Index.push_back(axis.Index[k]);
+			trimmed.Weight.push_back(axis.Weight[k]);
+		}
+		return trimmed;
+	}
+	return axis;
+}
+
+// Horizontal pass over one row: RGBA float pixels in, `axis` taps per output pixel.
+inline void mipFilterRow(const float* source, float* destination, const MipAxis& axis, int size)
+{
+	const int* index = axis.Index.data();
+	const float* weight = axis.Weight.data();
+	for (int x = 0; x < size; ++x, index += axis.Taps, weight += axis.Taps) {
+#ifdef REGL_MIPMAP_SSE2
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < axis.Taps; ++k)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + (size_t)index[k] * 4), _mm_set1_ps(weight[k])));
+		_mm_storeu_ps(destination + (size_t)x * 4, sum);
+#else
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int k = 0; k < axis.Taps; ++k)
+			for (int c = 0; c < 4; ++c)
+				sum[c] += source[(size_t)index[k] * 4 + c] * weight[k];
+		for (int c = 0; c < 4; ++c)
+			destination[(size_t)x * 4 + c] = sum[c];
+#endif
+	}
+}
+
+// Vertical pass: destination += weight * source over `count` floats.
+inline void mipAccumulateRow(float* destination, const float* source, float weight, size_t count)
+{
+	size_t i = 0;
+#ifdef REGL_MIPMAP_AVX2
+	const __m256 weight8 = _mm256_set1_ps(weight);
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(destination + i, _mm256_add_ps(_mm256_loadu_ps(destination + i), _mm256_mul_ps(_mm256_loadu_ps(source + i), weight8)));
+#endif
+#ifdef REGL_MIPMAP_SSE2
+	const __m128 weight4 = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), weight4)));
+#endif
+	for (; i < count; ++i)
+		destination[i] += source[i] * weight;
+}
+
+// Call work(first, end) for bands of rows in [0, rows), on the workers if there are any.
+template <typename Work>
+void mipForRows(TileWorkers* workers, int rows, const Work& work)
+{
+	const int tasks = (rows + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+	if (workers == NULL || tasks < 2) {
+		work(0, rows);
+		return;
+	}
+	workers->run(tasks, [&](int task) {
+		work(task * MIP_ROWS_PER_TASK, std::min(rows, (task + 1) * MIP_ROWS_PER_TASK));
+	});
+}
+
+
+// ----MIP CHAIN----
+
+// Filter an 8-bit image (1 to 4 channels, as stb_image returns it) down to 1x1. Returns levels 1 and up; level 0 is the
+// image itself. With 2 channels the second one is alpha; with 1 or 2 there's one color channel.
+inline std::vector<MipLevel> generateMipmaps(const uint8_t* pixels, int width, int height, int channels, const MipOptions& options)
+{
+	std::vector<MipLevel> levels;
+	if (width <= 1 && height <= 1)
+		return levels;
+
+	const SrgbTables& srgb = SrgbTables::instance();
+	const int colorChannels = (channels >= 3) ? 3 : 1;
+	const int alphaChannel = (channels == 4) ? 3 : (channels == 2) ? 1 : -1;
+	const bool premultiply = options.Premultiply && alphaChannel >= 0;
+	float colorTable[256]; // 8-bit color to linear.
+	for (int i = 0; i < 256; ++i)
+		colorTable[i] = options.SRGB ? srgb.ToLinear[i] : i / 255.0f;
+
+	// Row y of level 0 as linear RGBA float, alpha premultiplied if asked for. Level 0 is converted a row at a time, right
+	// before it is filtered, so it never exists as a whole float image.
+	auto convertRow = [&](int y, float* out) {
+		const uint8_t* in = pixels + (size_t)y * width * channels;
+		for (int x = 0; x < width; ++x, in += channels, out += 4) {
+			float alpha = (alphaChannel >= 0) ? in[alphaChannel] / 255.0f : 1.0f;
+			float scale = premultiply ? alpha : 1.0f;
+			out[0] = colorTable[in[0]] * scale;
+			out[1] = colorTable[in[(colorChannels == 3) ? 1 : 0]] * scale;
+			out[2] = colorTable[in[(colorChannels == 3) ? 2 : 0]] * scale;
+			out[3] = alpha;
+		}
+	};
+
+	std::vector<float> current, scratch, next;
+	int currentWidth = width, currentHeight = height;
+	while (currentWidth > 1 || currentHeight > 1) {
+		MipLevel level;
+		level.Width = std::max(1, currentWidth / 2);
+		level.Height = std::max(1, currentHeight / 2);
+		const MipAxis horizontal = mipAxis(currentWidth, level.Width, options.Filter);
+		const MipAxis vertical = mipAxis(currentHeight, level.Height, options.Filter);
+
+		// Horizontal: every source row, narrowed to the new width.
+		const bool fromImage = levels.empty();
+		scratch.resize((size_t)level.Width * currentHeight * 4);
+		mipForRows(options.Workers, currentHeight, [&](int first, int end) {
+			std::vector<float> row(fromImage ? (size_t)width * 4 : 0);
+			for (int y = first; y < end; ++y) {
+				if (fromImage)
+					convertRow(y, row.data());
+				const float* source = fromImage ? row.data() : &current[(size_t)y * currentWidth * 4];
+				mipFilterRow(source, &scratch[(size_t)y * level.Width * 4], horizontal, level.Width);
+			}
+		});
+
+		// Vertical: every new row as a weighted sum of scratch rows. Then the 8-bit level, clamped (Kaiser overshoots a bit).
+		next.resize((size_t)level.Width * level.Height * 4);
+		level.Pixels.resize((size_t)level.Width * level.Height * channels);
+		mipForRows(options.Workers, level.Height, [&](int first, int end) {
+			const size_t rowFloats = (size_t)level.Width * 4;
+			for (int y = first; y < end; ++y) {
+				float* row = &next[y * rowFloats];
+				std::fill(row, row + rowFloats, 0.0f);
+				for (int k = 0; k < vertical.Taps; ++k) {
+					float weight = vertical.Weight[(size_t)y * vertical.Taps + k];
+					if (weight != 0.0f)
+						mipAccumulateRow(row, &scratch[vertical.Index[(size_t)y * vertical.Taps + k] * rowFloats], weight, rowFloats);
+				}
+
+				for (int x = 0; x < level.Width; ++x) {
+					const float* in = row + (size_t)x * 4;
+					uint8_t* out = &level.Pixels[((size_t)y * level.Width + x) * channels];
+					float alpha = std::min(std::max(in[3], 0.0f), 1.0f);
+					float unpremultiply = (premultiply && alpha > 0.0f) ? 1.0f / alpha : 1.0f;
+					for (int c = 0; c < colorChannels; ++c) {
+						float value = std::min(std::max(in[c] * unpremultiply, 0.0f), 1.0f);
+						out[c] = options.SRGB ? srgb.encode(value) : (uint8_t)(value * 255.0f + 0.5f);
+					}
+					if (channels == 2 || channels == 4)
+						out[alphaChannel] = (uint8_t)(alpha * 255.0f + 0.5f);
+				}
+			}
+		});
+
+		levels.push_back(level);
+		current.swap(next);
+		currentWidth = level.Width;
+		currentHeight = level.Height;
+	}
+	return levels;
+}
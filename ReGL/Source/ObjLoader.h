@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Wavefront OBJ parsing, for the mesh cook step (Cook/Cook.cpp). The runtime loads the cooked .rmesh instead
+// (Source/MeshFile.h); parsing text is what it avoids.
+//
+// Supported: v (with the optional r g b vertex color extension), vt, vn, and f with any number of corners (triangulated
+// as a fan) and negative indices. Everything else (groups, materials, lines) is skipped.
+struct ObjMesh
+{
+	// Interleaved floats, in this order: position (3), color (3) if HasColors, uv (2) if HasTexCoords, normal (3) if HasNormals.
+	std::vector<float> Vertices;
+	std::vector<unsigned int> Indices;
+	size_t Stride = 3; // Floats per vertex.
+	bool HasColors = false;
+	bool HasTexCoords = false;
+	bool HasNormals = false;
+};
+
+// Skip to the next whitespace-separated token of the line. Returns false at the end of the line.
+inline bool objNextToken(const char*& at, const char* end)
+{
+	while (at < end && (*at == ' ' || *at == '\t' || *at == '\r'))
+		at++;
+	return at < end && *at != '\n';
+}
+
+// Read up to `count` floats. Returns how many there were.
+inline int objReadFloats(const char*& at, const char* end, float* values, int count)
+{
+	int read = 0;
+	while (read < count && objNextToken(at, end)) {
+		char* next;
+		values[read] = std::strtof(at, &next);
+		if (next == at)
+			break;
+		at = next;
+		read++;
+	}
+	return read;
+}
+
+// OBJ indices start at 1, negative ones count back from the last element. Returns -1 when absent or out of range.
+inline long objResolveIndex(long index, size_t count)
+{
+	if (index > 0 && (size_t)index <= count)
+		return index - 1;
+	if (index < 0 && (size_t)-index <= count)
+		return (long)count + index;
+	return -1;
+}
+
+inline bool loadObj(const std::string& path, ObjMesh& mesh)
+{
+	mesh = ObjMesh();
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	if (!file) {
+		std::cout << "ERROR::OBJ::FILE_NOT_FOUND " << path << std::endl;
+		return false;
+	}
+	std::vector<char> text((size_t)file.tellg());
+	file.seekg(0);
+	file.read(text.data(), (std::streamsize)text.size());
+	if (!file) {
+		std::cout << "ERROR::OBJ::CANNOT_READ " << path << std::endl;
+		return false;
+	}
+
+	std::vector<float> positions, colors, texCoords, normals;
+	struct Corner
+	{
+		long Position, TexCoord, Normal;
+		bool operator==(const Corner& other) const { return Position == other.Position && TexCoord == other.TexCoord && Normal == other.Normal; }
+	};
+	struct CornerHash
+	{
+		size_t operator()(const Corner& corner) const
+		{
+			return (size_t)corner.Position * 73856093u ^ (size_t)corner.TexCoord * 19349663u ^ (size_t)corner.Normal * 83492791u;
+		}
+	};
+	std::vector<Corner> corners;             // Unique corners, in order of first use: these become the vertices.
+	std::unordered_map<Corner, unsigned int, CornerHash> cornerIndex;
+	std::vector<unsigned int> face;
+
+	const char* at = text.data();
+	const char* end = at + text.size();
+	while (at < end) {
+		const char* lineEnd = (const char*)std::memchr(at, '\n', end - at);
+		lineEnd = lineEnd ? lineEnd : end;
+		objNextToken(at, lineEnd);
+
+		if (lineEnd - at > 2 && at[0] == 'v' && (at[1] == ' ' || at[1] == '\t')) {
+			at += 2;
+			float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+			int count = objReadFloats(at, lineEnd, values, 6);
+			positions.insert(positions.end(), values, values + 3);
+			colors.insert(colors.end(), values + 3, values + 6);
+			mesh.HasColors = mesh.HasColors || count == 6;
+		}
+		else if (lineEnd - at > 3 && at[0] == 'v' && at[1] == 't') {
+			at += 2;
+			float values[2] = { 0.0f, 0.0f };
+			objReadFloats(at, lineEnd, values, 2);
+			texCoords.insert(texCoords.end(), values, values + 2);
+		}
+		else if (lineEnd - at > 3 && at[0] == 'v' && at[1] == 'n') {
+			at += 2;
+			float values[3] = { 0.0f, 0.0f, 1.0f };
+			objReadFloats(at, lineEnd, values, 3);
+			normals.insert(normals.end(), values, values + 3);
+		}
+		else if (lineEnd - at > 2 && at[0] == 'f' && (at[1] == ' ' || at[1] == '\t')) {
+			at += 2;
+			face.clear();
+			while (objNextToken(at, lineEnd)) {
+				// v, v/vt, v//vn or v/vt/vn
+				long values[3] = { 0, 0, 0 };
+				for (int part = 0; part < 3 && at < lineEnd; ++part) {
+					char* next;
+					values[part] = std::strtol(at, &next, 10);
+					at = next;
+					if (at >= lineEnd || *at != '/')
+						break;
+					at++;
+				}
+				while (at < lineEnd && *at != ' ' && *at != '\t' && *at != '\r')
+					at++; // Skip whatever we didn't understand.
+
+				Corner corner;
+				corner.Position = objResolveIndex(values[0], positions.size() / 3);
+				corner.TexCoord = objResolveIndex(values[1], texCoords.size() / 2);
+				corner.Normal = objResolveIndex(values[2], normals.size() / 3);
+				if (corner.Position < 0) {
+					std::cout << "ERROR::OBJ::BAD_FACE_INDEX " << path << std::endl;
+					return false;
+				}
+				std::pair<std::unordered_map<Corner, unsigned int, CornerHash>::iterator, bool> inserted
+					= cornerIndex.insert(std::make_pair(corner, (unsigned int)corners.size()));
+				if (inserted.second)
+					corners.push_back(corner);
+				face.push_back(inserted.first->second);
+			}
+			for (size_t i = 2; i < face.size(); ++i) { // Triangle fan
+				mesh.Indices.push_back(face[0]);
+				mesh.Indices.push_back(face[i - 1]);
+				mesh.Indices.push_back(face[i]);
+			}
+		}
+		at = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+
+	// An attribute is kept if any corner has it; corners without it get zeros.
+	for (const Corner& corner : corners) {
+		mesh.HasTexCoords = mesh.HasTexCoords || corner.TexCoord >= 0;
+		mesh.HasNormals = mesh.HasNormals || corner.Normal >= 0;
+	}
+	mesh.Stride = 3 + (mesh.HasColors ? 3 : 0) + (mesh.HasTexCoords ? 2 : 0) + (mesh.HasNormals ? 3 : 0);
+	mesh.Vertices.clear();
+	mesh.Vertices.reserve(corners.size() * mesh.Stride);
+	for (const Corner& corner : corners) {
+		mesh.Vertices.insert(mesh.Vertices.end(), &positions[corner.Position * 3], &positions[corner.Position * 3] + 3);
+		if (mesh.HasColors)
+			mesh.Vertices.insert(mesh.Vertices.end(), &colors[corner.Position * 3], &colors[corner.Position * 3] + 3);
+		if (mesh.HasTexCoords) {
+			const float none[2] = { 0.0f, 0.0f };
+			const float* uv = (corner.TexCoord >= 0) ? &texCoords[corner.TexCoord * 2] : none;
+			mesh.Vertices.insert(mesh.Vertices.end(), uv, uv + 2);
+		}
+		if (mesh.HasNormals) {
+			const float none[3] = { 0.0f, 0.0f, 0.0f };
+			const float* normal = (corner.Normal >= 0) ? &normals[corner.Normal * 3] : none;
+			mesh.Vertices.insert(mesh.Vertices.end(), normal, normal + 3);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "BVH.h"
+#include "Float4.h"
+#include "Profiler.h"
+#include "TileWorkers.h"
+
+
+// Software occlusion culling: a small depth buffer drawn on the CPU from a few big occluders, then used to skip the
+// objects hidden behind them before their draws are issued.
+//
+//   occlusion.beginFrame(projection * view);
+//   occlusion.addOccluder(wallPositions, 3, wallIndices, wallIndexCount, wallModel);
+//   occlusion.rasterize();
+//   occlusion.filter(bounds, visible); // Removes the objects whose boxes are entirely behind the occluders.
+//
+// Rasterization works like SoftwareRasterizer's, depth only: triangles are binned into TILE_SIZE tiles and the tiles
+// drawn in parallel on TileWorkers, 4 pixels at a time with SIMD edge functions. Each tile then reduces its depth to the
+// hierarchical-Z level: the farthest depth of every HIZ_BLOCK x HIZ_BLOCK block.
+//
+// A box is tested with its screen rectangle and its nearest depth. Blocks whose farthest depth is nearer than the box
+// hide it entirely; only blocks that don't are looked at pixel by pixel, and the first pixel that is farther than the
+// box makes it visible. A box crossing the near plane is always visible.
+//
+// Coverage is sampled at pixel centers, so an occluder can hide a little more than it covers at its silhouette. At the
+// default 256x128 that is at most a few screen pixels; pick occluders that are slightly smaller than what they stand for
+// (the inside walls of a building, not its bounding box).
+class OcclusionBuffer
+{
+public:
+	static const int TILE_SIZE = 32;  // Pixels per tile side, a multiple of HIZ_BLOCK.
+	static const int HIZ_BLOCK = 8;   // Pixels per hierarchical-Z block side.
+
+	int Width, Height;         // Multiples of TILE_SIZE.
+	std::vector<float> Depth;  // Window depth 0-1 (1 = nothing drawn), row by row, bottom row first.
+	std::vector<float> HiZ;    // Farthest depth per block, (Width / HIZ_BLOCK) x (Height / HIZ_BLOCK), bottom row first.
+
+	// The last frame, and totals over all of them (a frame is one rasterize()), for printStats().
+	unsigned int OccluderTriangles, Tested, Occluded;
+	double RasterMs, TestMs;
+	uint64_t Frames, TotalTested, TotalOccluded;
+	double TotalRasterMs, TotalTestMs;
+
+	// The size is rounded up to whole tiles. threads = 0 uses every hardware thread.
+	OcclusionBuffer(int width = 256, int height = 128, unsigned int threads = 0)
+		: OccluderTriangles(0), Tested(0), Occluded(0), RasterMs(0.0), TestMs(0.0), Frames(0), TotalTested(0), TotalOccluded(0),
+		TotalRasterMs(0.0), TotalTestMs(0.0), workers(threads)
+	{
+		resize(width, height);
+	}
+
+	// Rasterize on the threads of a JobSystem.
+	OcclusionBuffer(int width, int height, JobSystem& jobs)
+		: OccluderTriangles(0), Tested(0), Occluded(0), RasterMs(0.0), TestMs(0.0), Frames(0), TotalTested(0), TotalOccluded(0),
+		TotalRasterMs(0.0), TotalTestMs(0.0), workers(jobs)
+	{
+		resize(width, height);
+	}
+
+	// Change the size, rounded up to whole tiles. The buffer is cleared.
+	void resize(int width, int height)
+	{
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		Width = tilesX * TILE_SIZE;
+		Height = tilesY * TILE_SIZE;
+		Depth.assign((size_t)Width * Height, 1.0f);
+		HiZ.assign((size_t)(Width / HIZ_BLOCK) * (Height / HIZ_BLOCK), 1.0f);
+		bins.resize((size_t)tilesX * tilesY);
+	}
+
+	unsigned int threadCount() const
+	{
+		return workers.threadCount();
+	}
+
+	// Start a frame seen through `viewProjection`. Forgets the occluders of the previous frame.
+	void beginFrame(const glm::mat4& viewProjection)
+	{
+		this->viewProjection = viewProjection;
+		triangles.clear();
+		for (std::vector<uint32_t>& bin : bins)
+			bin.clear();
+		OccluderTriangles = 0;
+		Tested = 0;
+		Occluded = 0;
+		RasterMs = 0.0;
+		TestMs = 0.0;
+	}
+
+	// Add an occluder: indexed triangles, `stride` floats per vertex with the position first, placed by `model`.
+	void addOccluder(const float* positions, int stride, const unsigned int* indices, unsigned int indexCount, const glm::mat4& model)
+	{
+		REGL_PROFILE_ZONE("Occluder setup + binning");
+		const glm::mat4 mvp = viewProjection * model;
+		for (unsigned int i = 0; i + 2 < indexCount; i += 3) {
+			glm::vec4 triangle[3];
+			for (int k = 0; k < 3; ++k) {
+				const float* vertex = positions + (size_t)indices[i + k] * stride;
+				triangle[k] = mvp * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+			}
+			clipAndSetup(triangle);
+		}
+	}
+
+	// Draw the occluders added since beginFrame() and build the hierarchical-Z level.
+	void rasterize()
+	{
+		REGL_PROFILE_ZONE("Occlusion raster");
+		uint64_t start = Profiler::steadyNanoseconds();
+		workers.run(tilesX * tilesY, [this](int tile) { rasterizeTile(tile); });
+		RasterMs = (double)(Profiler::steadyNanoseconds() - start) / 1e6;
+		TotalRasterMs += RasterMs;
+		Frames++;
+	}
+
+	// False when the box is certainly hidden behind the occluders.
+	bool testBox(const AABB& box) const
+	{
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+		for (int corner = 0; corner < 8; ++corner) {
+			glm::vec4 p = viewProjection * glm::vec4((corner & 1) ? box.Max.x : box.Min.x, (corner & 2) ? box.Max.y : box.Min.y,
+				(corner & 4) ? box.Max.z : box.Min.z, 1.0f);
+			if (p.z < -p.w) // In front of the near plane: it could cover the whole screen.
+				return true;
+			float invW = 1.0f / p.w;
+			float x = (p.x * invW * 0.5f + 0.5f) * (float)Width, y = (p.y * invW * 0.5f + 0.5f) * (float)Height;
+			minX = std::min(minX, x); maxX = std::max(maxX, x);
+			minY = std::min(minY, y); maxY = std::max(maxY, y);
+			nearest = std::min(nearest, p.z * invW * 0.5f + 0.5f);
+		}
+
+		// The pixels whose centers the rectangle could touch. Entirely off screen: frustum culling's business, not ours.
+		int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(Width - 1, (int)std::floor(maxX));
+		int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(Height - 1, (int)std::floor(maxY));
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		const int blocksX = Width / HIZ_BLOCK;
+		for (int by = y0 / HIZ_BLOCK; by <= y1 / HIZ_BLOCK; ++by) {
+			for (int bx = x0 / HIZ_BLOCK; bx <= x1 / HIZ_BLOCK; ++bx) {
+				if (HiZ[(size_t)by * blocksX + bx] < nearest)
+					continue; // Everything drawn in this block is nearer than the box.
+				int px0 = std::max(x0, bx * HIZ_BLOCK), px1 = std::min(x1, bx * HIZ_BLOCK + HIZ_BLOCK - 1);
+				int py0 = std::max(y0, by * HIZ_BLOCK), py1 = std::min(y1, by * HIZ_BLOCK + HIZ_BLOCK - 1);
+				for (int y = py0; y <= py1; ++y)
+					for (int x = px0; x <= px1; ++x)
+						if (Depth[(size_t)y * Width + x] >= nearest)
+							return true;
+			}
+		}
+		return false;
+	}
+
+	// Remove from `objects` (indices into `bounds`) the ones testBox() says are hidden. Keeps the order.
+	void filter(const std::vector<AABB>& bounds, std::vector<unsigned int>& objects)
+	{
+		REGL_PROFILE_ZONE("Occlusion test");
+		uint64_t start = Profiler::steadyNanoseconds();
+		size_t kept = 0;
+		for (unsigned int object : objects)
+			if (testBox(bounds[object]))
+				objects[kept++] = object;
+		double ms = (double)(Profiler::steadyNanoseconds() - start) / 1e6;
+		Tested += (unsigned int)objects.size();
+		Occluded += (unsigned int)(objects.size() - kept);
+		TestMs += ms;
+		TotalTested += objects.size();
+		TotalOccluded += objects.size() - kept;
+		TotalTestMs += ms;
+		objects.resize(kept);
+	}
+
+	// The depth buffer as RGBA8, bottom row first like glReadPixels, for looking at: the nearest depth drawn is white,
+	// the farthest dark gray, empty pixels black with the hierarchical-Z block edges in dark blue.
+	void debugImage(std::vector<uint8_t>& rgba) const
+	{
+		float nearest = 1.0f;
+		for (float depth : Depth)
+			nearest = std::min(nearest, depth);
+		const float range = std::max(1.0f - nearest, 1e-6f);
+		rgba.resize((size_t)Width * Height * 4);
+		for (int y = 0; y < Height; ++y) {
+			for (int x = 0; x < Width; ++x) {
+				float depth = Depth[(size_t)y * Width + x];
+				uint8_t* pixel = &rgba[((size_t)y * Width + x) * 4];
+				if (depth >= 1.0f) {
+					bool edge = (x % HIZ_BLOCK == 0) || (y % HIZ_BLOCK == 0);
+					pixel[0] = 0; pixel[1] = 0; pixel[2] = edge ? 64 : 0;
+				}
+				else {
+					uint8_t gray = (uint8_t)(64.0f + 191.0f * (1.0f - (depth - nearest) / range));
+					pixel[0] = gray; pixel[1] = gray; pixel[2] = gray;
+				}
+				pixel[3] = 255;
+			}
+		}
+	}
+
+	void printStats() const
+	{
+		double frames = Frames ? (double)Frames : 1.0;
+		std::cout << std::fixed << std::setprecision(3)
+			<< "Occlusion culling: " << Width << "x" << Height << ", " << Frames << " frames, per frame " << TotalTested / frames << " tested, "
+			<< TotalOccluded / frames << " occluded (raster avg " << TotalRasterMs / frames << "ms, tests avg " << TotalTestMs / frames << "ms)"
+			<< std::endl;
+	}
+
+private:
+	// Edge functions and depth plane of one occluder triangle, in pixels.
+	struct Triangle
+	{
+		float EdgeA[3], EdgeB[3], EdgeC[3]; // Positive inside.
+		float DepthA, DepthB, DepthC;       // depth = A * x + B * y + C
+		int MinX, MinY, MaxX, MaxY;
+	};
+
+	TileWorkers workers;
+	int tilesX, tilesY;
+	glm::mat4 viewProjection;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins; // Triangle indices per tile.
+
+	// Clip against the near plane, then set up the resulting one or two triangles.
+	void clipAndSetup(const glm::vec4* triangle)
+	{
+		glm::vec4 polygon[4];
+		int count = 0;
+		for (int k = 0; k < 3; ++k) {
+			const glm::vec4& a = triangle[k];
+			const glm::vec4& b = triangle[(k + 1) % 3];
+			float da = a.z + a.w, db = b.z + b.w; // >= 0 in front of the near plane.
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				polygon[count++] = a + (b - a) * (da / (da - db));
+		}
+		for (int k = 1; k + 1 < count; ++k)
+			setup(polygon[0], polygon[k], polygon[k + 1]);
+	}
+
+	void setup(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+	{
+		const glm::vec4* input[3] = { &v0, &v1, &v2 };
+		float x[3], y[3], z[3];
+		for (int k = 0; k < 3; ++k) {
+			float invW = 1.0f / input[k]->w;
+			x[k] = (input[k]->x * invW * 0.5f + 0.5f) * (float)Width;
+			y[k] = (input[k]->y * invW * 0.5f + 0.5f) * (float)Height;
+			z[k] = input[k]->z * invW * 0.5f + 0.5f;
+		}
+
+		// Both faces occlude: make every triangle counter-clockwise.
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0.0f || area != area)
+			return;
+		if (area < 0.0f) {
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		Triangle triangle;
+		for (int k = 0; k < 3; ++k) {
+			int a = (k + 1) % 3, b = (k + 2) % 3;
+			float dx = x[b] - x[a], dy = y[b] - y[a];
+			triangle.EdgeA[k] = -dy / area;
+			triangle.EdgeB[k] = dx / area;
+			triangle.EdgeC[k] = (dy * x[a] - dx * y[a]) / area;
+		}
+		// The edges are barycentric weights, so the depth plane is their depth-weighted sum.
+		triangle.DepthA = triangle.EdgeA[0] * z[0] + triangle.EdgeA[1] * z[1] + triangle.EdgeA[2] * z[2];
+		triangle.DepthB = triangle.EdgeB[0] * z[0] + triangle.EdgeB[1] * z[1] + triangle.EdgeB[2] * z[2];
+		triangle.DepthC = triangle.EdgeC[0] * z[0] + triangle.EdgeC[1] * z[1] + triangle.EdgeC[2] * z[2];
+
+		triangle.MinX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+		triangle.MinY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+		triangle.MaxX = std::min(Width - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+		triangle.MaxY = std::min(Height - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+		if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+			return;
+
+		uint32_t index = (uint32_t)triangles.size();
+		triangles.push_back(triangle);
+		OccluderTriangles++;
+		for (int ty = triangle.MinY / TILE_SIZE; ty <= triangle.MaxY / TILE_SIZE; ++ty)
+			for (int tx = triangle.MinX / TILE_SIZE; tx <= triangle.MaxX / TILE_SIZE; ++tx)
+				bins[(size_t)ty * tilesX + tx].push_back(index);
+	}
+
+	void rasterizeTile(int tile)
+	{
+		const int originX = (tile % tilesX) * TILE_SIZE, originY = (tile / tilesX) * TILE_SIZE;
+		for (int y = originY; y < originY + TILE_SIZE; ++y)
+			std::fill(&Depth[(size_t)y * Width + originX], &Depth[(size_t)y * Width + originX] + TILE_SIZE, 1.0f);
+
+		const Float4 zero = splat4(0.0f);
+		const Float4 laneOffsets = float4(0.5f, 1.5f, 2.5f, 3.5f);
+		for (uint32_t index : bins[tile]) {
+			const Triangle& triangle = triangles[index];
+			const int minX = std::max(triangle.MinX, originX) & ~3, maxX = std::min(triangle.MaxX, originX + TILE_SIZE - 1);
+			const int minY = std::max(triangle.MinY, originY), maxY = std::min(triangle.MaxY, originY + TILE_SIZE - 1);
+			Float4 edgeA[3], edgeB[3], edgeC[3];
+			for (int k = 0; k < 3; ++k) {
+				edgeA[k] = splat4(triangle.EdgeA[k]);
+				edgeB[k] = splat4(triangle.EdgeB[k]);
+				edgeC[k] = splat4(triangle.EdgeC[k]);
+			}
+			const Float4 depthA = splat4(triangle.DepthA), depthB = splat4(triangle.DepthB), depthC = splat4(triangle.DepthC);
+
+			for (int y = minY; y <= maxY; ++y) {
+				const Float4 py = splat4((float)y + 0.5f);
+				float* row = &Depth[(size_t)y * Width];
+				for (int x = minX; x <= maxX; x += 4) {
+					const Float4 px = splat4((float)x) + laneOffsets;
+					Float4 covered = maskAll4(true);
+					for (int k = 0; k < 3; ++k)
+						covered = covered & greater4(edgeA[k] * px + edgeB[k] * py + edgeC[k], zero);
+					if (laneMask4(covered) == 0)
+						continue;
+					// Keep the nearest depth. Nothing beyond the far plane occludes anything.
+					Float4 z = depthA * px + depthB * py + depthC;
+					Float4 stored = load4u(row + x);
+					store4u(row + x, select4(covered & less4(z, stored), z, stored));
+				}
+			}
+		}
+
+		// Hierarchical-Z: the farthest depth of each block of the tile.
+		const int blocksX = Width / HIZ_BLOCK;
+		for (int by = originY / HIZ_BLOCK; by < (originY + TILE_SIZE) / HIZ_BLOCK; ++by) {
+			for (int bx = originX / HIZ_BLOCK; bx < (originX + TILE_SIZE) / HIZ_BLOCK; ++bx) {
+				float farthest = 0.0f;
+				for (int y = by * HIZ_BLOCK; y < (by + 1) * HIZ_BLOCK; ++y)
+					for (int x = bx * HIZ_BLOCK; x < (bx + 1) * HIZ_BLOCK; ++x)
+						farthest = std::max(farthest, Depth[(size_t)y * Width + x]);
+				HiZ[(size_t)by * blocksX + bx] = farthest;
+			}
+		}
+	}
+};
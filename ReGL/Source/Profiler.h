@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define REGL_PROFILER_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define REGL_PROFILER_RDTSC
+#endif
+
+
+// CPU frame profiler: scoped zones recorded into per-thread ring buffers, dumped as a Chrome trace on demand.
+//
+//   void renderFrame()
+//   {
+//       REGL_PROFILE_ZONE("Render"); // Measures until the end of the scope.
+//       ...
+//   }
+//   Profiler::instance().writeChromeTrace("regl_trace.json"); // Open in chrome://tracing or https://ui.perfetto.dev
+//
+// Recording a zone takes two timestamp reads and four relaxed stores into the calling thread's own buffer: no locks,
+// no allocation, no shared cache lines, so it can stay enabled in release builds. On x86 the timestamps are raw rdtsc
+// ticks (a few ns, against 20-40 ns for steady_clock), converted to nanoseconds against steady_clock when a trace is
+// written; that needs the invariant TSC every x86 CPU of the last 15 years has. Each thread keeps its last
+// PROFILER_RING_SIZE zones; older ones are overwritten. Zone names must be string literals (only the pointer is kept).
+// Define REGL_PROFILER_DISABLED to compile every zone out.
+
+const uint32_t PROFILER_RING_SIZE = 1 << 16; // Zones kept per thread, a power of two. 1.5 MiB per thread.
+
+class Profiler
+{
+public:
+	// The one profiler of the process.
+	static Profiler& instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// Timestamp of a zone boundary, in ticks (see nanosecondsPerTick).
+	static uint64_t now()
+	{
+#ifdef REGL_PROFILER_RDTSC
+		return __rdtsc();
+#else
+		return steadyNanoseconds();
+#endif
+	}
+
+	static uint64_t steadyNanoseconds()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Measured between the profiler's creation and now, so it gets more precise the longer the program runs.
+	double nanosecondsPerTick()
+	{
+		uint64_t ticks = now() - startTicks;
+		uint64_t nanoseconds = steadyNanoseconds() - startNanoseconds;
+		if (nanoseconds < 10000000) { // Under 10 ms the clocks' resolution dominates, measure a bit longer.
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			ticks = now() - startTicks;
+			nanoseconds = steadyNanoseconds() - startNanoseconds;
+		}
+		return (ticks == 0) ? 1.0 : (double)nanoseconds / (double)ticks;
+	}
+
+	// Name the calling thread in the trace. Threads that never call this show up as "Thread N".
+	void setThreadName(const char* name)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock(mutex);
+		buffer.Name = name;
+	}
+
+	// Record a finished zone for the calling thread.
+	void record(const char* name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		uint64_t head = buffer.Head.load(std::memory_order_relaxed);
+		Zone& zone = buffer.Zones[head & (PROFILER_RING_SIZE - 1)];
+		zone.Name.store(name, std::memory_order_relaxed);
+		zone.Start.store(start, std::memory_order_relaxed);
+		zone.End.store(end, std::memory_order_relaxed);
+		buffer.Head.store(head + 1, std::memory_order_release); // Publishes the zone to writeChromeTrace.
+	}
+
+	// Write every zone still in the ring buffers as Chrome trace-event JSON. Can be called from any thread while the
+	// others keep recording; zones overwritten during the copy are left out. Returns false if the file can't be written.
+	bool writeChromeTrace(const char* path)
+	{
+		FILE* file = std::fopen(path, "wb");
+		if (!file) {
+			std::cout << "ERROR::PROFILER::CANNOT_WRITE " << path << std::endl;
+			return false;
+		}
+
+		std::vector<ThreadBuffer*> buffers;
+		std::vector<std::string> names;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : threads) {
+				buffers.push_back(buffer.get());
+				names.push_back(buffer->Name);
+			}
+		}
+
+		std::vector<std::vector<CopiedZone>> zones(buffers.size());
+		uint64_t epoch = UINT64_MAX; // Trace time 0 is the oldest zone still in the buffers.
+		for (size_t t = 0; t < buffers.size(); ++t) {
+			copyZones(*buffers[t], zones[t]);
+			for (const CopiedZone& zone : zones[t])
+				epoch = std::min(epoch, zone.Start);
+		}
+		const double microsecondsPerTick = nanosecondsPerTick() / 1000.0;
+
+		size_t written = 0;
+		std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		for (size_t t = 0; t < buffers.size(); ++t) {
+			std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", t ? ",\n" : "", buffers[t]->Id);
+			writeEscaped(file, names[t].c_str());
+			std::fprintf(file, "\"}}");
+
+			for (const CopiedZone& zone : zones[t]) {
+				// Timestamps are microseconds; three decimals keep the nanoseconds.
+				std::fprintf(file, ",\n{\"name\":\"");
+				writeEscaped(file, zone.Name);
+				std::fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					buffers[t]->Id, (double)(zone.Start - epoch) * microsecondsPerTick, (double)(zone.End - zone.Start) * microsecondsPerTick);
+			}
+			written += zones[t].size();
+		}
+		std::fprintf(file, "\n]}\n");
+		bool ok = std::fclose(file) == 0;
+		std::cout << "Wrote " << written << " profiler zones to " << path << std::endl;
+		return ok;
+	}
+
+private:
+	struct Zone
+	{
+		std::atomic<const char*> Name;
+		std::atomic<uint64_t> Start;
+		std::atomic<uint64_t> End;
+	};
+
+	struct ThreadBuffer
+	{
+		std::atomic<uint64_t> Head; // Number of zones ever recorded; the next one goes to Zones[Head % size].
+		uint32_t Id;
+		std::string Name;         // Guarded by Profiler::mutex.
+		Zone Zones[PROFILER_RING_SIZE];
+	};
+
+	struct CopiedZone
+	{
+		const char* Name;
+		uint64_t Start, End;
+	};
+
+	std::mutex mutex; // Only taken when a thread records its first zone, names itself, or a trace is written.
+	std::vector<std::unique_ptr<ThreadBuffer>> threads; // Kept after their thread exits so its zones still get written.
+	uint64_t startTicks, startNanoseconds; // Calibration of now() against steady_clock.
+
+	Profiler() : startTicks(now()), startNanoseconds(steadyNanoseconds()) {}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// The calling thread's buffer, created on its first zone.
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = NULL;
+		if (buffer == NULL)
+			buffer = createThreadBuffer();
+		return *buffer;
+	}
+
+	ThreadBuffer* createThreadBuffer()
+	{
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		buffer->Head.store(0, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(mutex);
+		buffer->Id = (uint32_t)threads.size() + 1;
+		buffer->Name = "Thread " + std::to_string(buffer->Id);
+		threads.push_back(std::move(buffer));
+		return threads.back().get();
+	}
+
+	// Copy the ring, then drop whatever the owning thread may have overwritten in the meantime (a seqlock-style check on Head).
+	static void copyZones(const ThreadBuffer& buffer, std::vector<CopiedZone>& zones)
+	{
+		uint64_t head = buffer.Head.load(std::memory_order_acquire);
+		uint64_t first = (head > PROFILER_RING_SIZE) ? head - PROFILER_RING_SIZE : 0;
+		zones.resize((size_t)(head - first));
+		for (uint64_t i = first; i < head; ++i) {
+			const Zone& zone = buffer.Zones[i & (PROFILER_RING_SIZE - 1)];
+			CopiedZone& copy = zones[(size_t)(i - first)];
+			copy.Name = zone.Name.load(std::memory_order_relaxed);
+			copy.Start = zone.Start.load(std::memory_order_relaxed);
+			copy.End = zone.End.load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// While Head == h the owner may be writing slot h, which also held zone h - size.
+		uint64_t headAfter = buffer.Head.load(std::memory_order_relaxed);
+		uint64_t firstIntact = (headAfter >= PROFILER_RING_SIZE) ? headAfter - PROFILER_RING_SIZE + 1 : 0;
+		if (firstIntact > first)
+			zones.erase(zones.begin(), zones.begin() + (size_t)std::min<uint64_t>(firstIntact - first, zones.size()));
+	}
+
+	static void writeEscaped(FILE* file, const char* text)
+	{
+		for (; *text; ++text) {
+			if (*text == '"' || *text == '\\')
+				std::fputc('\\', file);
+			if ((unsigned char)*text >= 0x20)
+				std::fputc(*text, file);
+		}
+	}
+};
+
+
+// Measures from construction to the end of the enclosing scope. Use through REGL_PROFILE_ZONE.
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : name(name), start(Profiler::now()) {}
+
+	~ProfileZone()
+	{
+		Profiler::instance().record(name, start, Profiler::now());
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define REGL_PROFILE_CONCAT_INNER(a, b) a##b
+#define REGL_PROFILE_CONCAT(a, b) REGL_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef REGL_PROFILER_DISABLED
+#define REGL_PROFILE_ZONE(name) ProfileZone REGL_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define REGL_PROFILE_THREAD(name) Profiler::instance().setThreadName(name)
+#else
+#define REGL_PROFILE_ZONE(name) ((void)0)
+#define REGL_PROFILE_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+
+// A sort key and the index of what it sorts, so the sort moves 16 bytes per item instead of whole draw commands.
+struct SortItem
+{
+	uint64_t Key;
+	uint32_t Index;
+};
+
+// Items per block of RadixSorter: each block is one job of every pass, so this sets the smallest parallel piece.
+const int RADIX_BLOCK = 8192;
+
+
+// Least-significant-byte-first radix sort of SortItems by Key, optionally spread over a JobSystem.
+//
+// Each pass sorts by one byte: the items are cut into blocks, every block counts its 256 byte values (in parallel), the
+// counts become the first output position of every (byte value, block) pair, and every block copies its items to their
+// positions (in parallel again). Blocks write in block order within each byte value, so each pass is stable, and so is
+// the whole sort: equal keys keep their input order, and the result doesn't depend on the number of threads.
+//
+// Bytes that are the same in every key are skipped, so keys using few bits sort in few passes, and keys that are all
+// equal don't move at all.
+class RadixSorter
+{
+public:
+	// Passes run by the last sort(), out of 8.
+	int Passes;
+
+	RadixSorter() : Passes(0) {}
+
+	// Sort `items` by Key. `jobs` may be NULL: everything then runs on the calling thread.
+	void sort(std::vector<SortItem>& items, JobSystem* jobs = NULL)
+	{
+		Passes = 0;
+		const size_t count = items.size();
+		if (count < 2)
+			return;
+
+		// Bits that differ between keys: only their bytes need a pass.
+		uint64_t differing = 0;
+		for (const SortItem& item : items)
+			differing |= item.Key ^ items[0].Key;
+		if (differing == 0)
+			return;
+
+		const int blocks = jobs != NULL ? (int)std::min<size_t>(64, (count + RADIX_BLOCK - 1) / RADIX_BLOCK) : 1;
+		const size_t blockSize = (count + blocks - 1) / blocks;
+		scratch.resize(count);
+		counts.resize((size_t)blocks * 256);
+
+		SortItem* source = items.data();
+		SortItem* target = scratch.data();
+		for (int shift = 0; shift < 64; shift += 8) {
+			if (((differing >> shift) & 0xFF) == 0)
+				continue;
+
+			// Count the byte values of every block.
+			forBlocks(jobs, blocks, [&](int block) {
+				uint32_t* blockCounts = &counts[(size_t)block * 256];
+				std::fill(blockCounts, blockCounts + 256, 0u);
+				size_t end = std::min(count, (block + 1) * blockSize);
+				for (size_t i = block * blockSize; i < end; ++i)
+					blockCounts[(source[i].Key >> shift) & 0xFF]++;
+			});
+
+			// Counts to positions: byte value first, then block, which is what keeps the pass stable.
+			uint32_t position = 0;
+			for (int value = 0; value < 256; ++value)
+				for (int block = 0; block < blocks; ++block) {
+					uint32_t& slot = counts[(size_t)block * 256 + value];
+					uint32_t blockCount = slot;
+					slot = position;
+					position += blockCount;
+				}
+
+			// Scatter.
+			forBlocks(jobs, blocks, [&](int block) {
+				uint32_t* positions = &counts[(size_t)block * 256];
+				size_t end = std::min(count, (block + 1) * blockSize);
+				for (size_t i = block * blockSize; i < end; ++i)
+					target[positions[(source[i].Key >> shift) & 0xFF]++] = source[i];
+			});
+
+			std::swap(source, target);
+			Passes++;
+		}
+
+		if (source != items.data())
+			items.swap(scratch); // The sorted items are in the scratch buffer: swap the buffers, not the items.
+	}
+
+private:
+	std::vector<SortItem> scratch;
+	std::vector<uint32_t> counts; // 256 per block.
+
+	template <typename Work>
+	static void forBlocks(JobSystem* jobs, int blocks, const Work& work)
+	{
+		if (jobs != NULL && blocks > 1)
+			jobs->parallelFor(blocks, 1, work);
+		else
+			for (int block = 0; block < blocks; ++block)
+				work(block);
+	}
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../Dependencies/stb_image.h"
+#include "Float4.h"
+#include "Mipmap.h"
+#include "Profiler.h"
+#include "TileWorkers.h"
+
+
+// CPU rendering backend for machines without a GPU. It draws what Texture.vert/Texture.frag draw: positions
+// transformed by a model-view-projection matrix, two textures sampled at the interpolated texture coordinate and mixed.
+//
+// A frame is recorded first and rasterized at the end, like a tiling GPU does:
+//   1. beginFrame() remembers the clear color.
+//   2. drawTextured() transforms and clips the triangles, and bins each one into every TILE_SIZE x TILE_SIZE screen
+//      tile its bounding box touches.
+//   3. endFrame() rasterizes the tiles in parallel (TileWorkers). Each tile clears its own color and depth, then walks
+//      its bin in submission order, 4 pixels at a time with SIMD edge functions and depth test. A tile is only ever
+//      touched by one thread, so there are no locks, and its depth buffer is one contiguous block that stays in cache.
+//
+// Images match the GL path closely: same pixel centers, top-left fill rule, perspective-correct interpolation,
+// GL_REPEAT wrapping, bilinear filtering and trilinear filtering for mipmapped textures (GL_LINEAR_MIPMAP_LINEAR).
+// The result is RGBA8 rows, bottom row first, exactly like glReadPixels.
+
+
+// ----TEXTURES----
+
+// RGBA8 texture with its mip chain, rows bottom first (loaded with the same vertical flip as the GL textures).
+struct SoftwareTexture
+{
+	std::vector<MipLevel> Levels; // Only level 0 unless the texture is mipmapped.
+
+	// Load an image like loadTexture() does. mipmapped = the GL texture would use GL_LINEAR_MIPMAP_LINEAR.
+	bool load(const char* path, bool mipmapped)
+	{
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* data = stbi_load(path, &width, &height, &channels, 4); // Missing channels read as GL does: 0 for G/B, 1 for alpha.
+		if (!data) {
+			std::cout << "Failed to load texture: " << path << std::endl;
+			return false;
+		}
+		if (channels == 1) // GL_RED: G and B sample as 0, stb_image replicated R.
+			for (size_t i = 0; i < (size_t)width * height; ++i)
+				data[i * 4 + 1] = data[i * 4 + 2] = 0;
+
+		Levels.assign(1, MipLevel());
+		Levels[0].Width = width;
+		Levels[0].Height = height;
+		Levels[0].Pixels.assign(data, data + (size_t)width * height * 4);
+		stbi_image_free(data);
+
+		if (mipmapped) { // The same chain as the GL textures get, see textureMipOptions().
+			MipOptions options;
+			options.Premultiply = (channels == 2 || channels == 4);
+			std::vector<MipLevel> mips = generateMipmaps(Levels[0].Pixels.data(), width, height, 4, options);
+			Levels.insert(Levels.end(), mips.begin(), mips.end());
+		}
+		return true;
+	}
+};
+
+// GL_LINEAR with GL_REPEAT on one level. rgba is 0-255.
+inline void sampleBilinear(const MipLevel& level, float u, float v, float* rgba)
+{
+	float x = u * level.Width - 0.5f, y = v * level.Height - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float ax = x - fx, ay = y - fy;
+	int x0 = (int)fx % level.Width, y0 = (int)fy % level.Height;
+	x0 += (x0 < 0) ? level.Width : 0;
+	y0 += (y0 < 0) ? level.Height : 0;
+	int x1 = (x0 + 1 == level.Width) ? 0 : x0 + 1;
+	int y1 = (y0 + 1 == level.Height) ? 0 : y0 + 1;
+
+	const uint8_t* p00 = &level.Pixels[((size_t)y0 * level.Width + x0) * 4];
+	const uint8_t* p10 = &level.Pixels[((size_t)y0 * level.Width + x1) * 4];
+	const uint8_t* p01 = &level.Pixels[((size_t)y1 * level.Width + x0) * 4];
+	const uint8_t* p11 = &level.Pixels[((size_t)y1 * level.Width + x1) * 4];
+	for (int c = 0; c < 4; ++c) {
+		float bottom = p00[c] + (p10[c] - p00[c]) * ax;
+		float top = p01[c] + (p11[c] - p01[c]) * ax;
+		rgba[c] = bottom + (top - bottom) * ay;
+	}
+}
+
+// Level of detail for GL_LINEAR_MIPMAP_LINEAR: log2 of the texels one pixel step covers, from the texture
+// coordinate's screen-space derivatives (the longer of the x and y steps, as GL implementations usually do).
+inline float textureLod(const SoftwareTexture& texture, float dudx, float dvdx, float dudy, float dvdy)
+{
+	float w = (float)texture.Levels[0].Width, h = (float)texture.Levels[0].Height;
+	float rhoX = dudx * dudx * w * w + dvdx * dvdx * h * h;
+	float rhoY = dudy * dudy * w * w + dvdy * dvdy * h * h;
+	return 0.5f * std::log2(std::max(std::max(rhoX, rhoY), 1e-20f)); // log2(sqrt(rho^2))
+}
+
+// Like texture() in GLSL: bilinear, or trilinear between two levels when the texture has mipmaps.
+inline void sampleTexture(const SoftwareTexture& texture, float u, float v, float lod, float* rgba)
+{
+	int last = (int)texture.Levels.size() - 1;
+	if (last == 0 || lod <= 0.0f) { // Magnification uses GL_LINEAR on level 0.
+		sampleBilinear(texture.Levels[0], u, v, rgba);
+		return;
+	}
+	if (lod >= (float)last) {
+		sampleBilinear(texture.Levels[last], u, v, rgba);
+		return;
+	}
+	int level = (int)lod;
+	float blend = lod - (float)level;
+	float finer[4], coarser[4];
+	sampleBilinear(texture.Levels[level], u, v, finer);
+	sampleBilinear(texture.Levels[level + 1], u, v, coarser);
+	for (int c = 0; c < 4; ++c)
+		rgba[c] = finer[c] + (coarser[c] - finer[c]) * blend;
+}
+
+
+// ----RASTERIZER----
+
+class SoftwareRasterizer
+{
+public:
+	static const int TILE_SIZE = 64; // Pixels per tile side. 64x64 floats of depth = 16 KiB, well inside L1 + L2.
+
+	int Width, Height;
+	std::vector<uint8_t> Color; // RGBA8, bottom row first, valid after endFrame().
+
+	// Statistics of the last frame.
+	unsigned int TrianglesBinned;
+	unsigned int TileBinEntries;
+
+	// threads = 0 uses every hardware thread.
+	SoftwareRasterizer(int width, int height, unsigned int threads = 0)
+		: Width(width), Height(height), TrianglesBinned(0), TileBinEntries(0), workers(threads)
+	{
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		Color.resize((size_t)width * height * 4);
+		depth.resize((size_t)tilesX * tilesY * TILE_SIZE * TILE_SIZE);
+		bins.resize((size_t)tilesX * tilesY);
+	}
+
+	// Rasterize the tiles on the threads of a JobSystem.
+	SoftwareRasterizer(int width, int height, JobSystem& jobs)
+		: Width(width), Height(height), TrianglesBinned(0), TileBinEntries(0), workers(jobs)
+	{
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		Color.resize((size_t)width * height * 4);
+		depth.resize((size_t)tilesX * tilesY * TILE_SIZE * TILE_SIZE);
+		bins.resize((size_t)tilesX * tilesY);
+	}
+
+	unsigned int threadCount() const
+	{
+		return workers.threadCount();
+	}
+
+	// Start recording a frame that is cleared to the given color (and depth 1.0).
+	void beginFrame(const glm::vec4& clearColor)
+	{
+		for (int c = 0; c < 4; ++c)
+			clear[c] = (uint8_t)(std::min(std::max(clearColor[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+		triangles.clear();
+		draws.clear();
+		for (std::vector<uint32_t>& bin : bins)
+			bin.clear();
+		TrianglesBinned = 0;
+		TileBinEntries = 0;
+	}
+
+	// Draw indexed triangles with Texture.vert/Texture.frag: clip position = mvp * position, color = mix(texture1, texture2, mixFactor).
+	// vertices holds `stride` floats per vertex, the position at positionOffset and the texture coordinate at texCoordOffset.
+	// The textures must stay alive until endFrame().
+	void drawTextured(const float* vertices, int stride, int positionOffset, int texCoordOffset, const unsigned int* indices,
+		unsigned int indexCount, const glm::mat4& mvp, const SoftwareTexture& texture1, const SoftwareTexture& texture2, float mixFactor)
+	{
+		REGL_PROFILE_ZONE("Software setup + binning");
+		Draw draw;
+		draw.Texture1 = &texture1;
+		draw.Texture2 = &texture2;
+		draw.Mix = mixFactor;
+		draws.push_back(draw);
+
+		for (unsigned int i = 0; i + 2 < indexCount; i += 3) {
+			ClipVertex triangle[3];
+			for (int k = 0; k < 3; ++k) {
+				const float* vertex = vertices + (size_t)indices[i + k] * stride;
+				triangle[k].Position = mvp * glm::vec4(vertex[positionOffset], vertex[positionOffset + 1], vertex[positionOffset + 2], 1.0f);
+				triangle[k].TexCoord = glm::vec2(vertex[texCoordOffset], vertex[texCoordOffset + 1]);
+			}
+			clipAndSetup(triangle, (uint32_t)draws.size() - 1);
+		}
+	}
+
+	// Rasterize everything recorded since beginFrame() into Color.
+	void endFrame()
+	{
+		REGL_PROFILE_ZONE("Software raster");
+		workers.run(tilesX * tilesY, [this](int tile) { rasterizeTile(tile); });
+	}
+
+private:
+	struct ClipVertex
+	{
+		glm::vec4 Position;
+		glm::vec2 TexCoord;
+	};
+
+	// Everything the tiles need to rasterize and shade one triangle. Attributes are planes a*x + b*y + c in pixels.
+	struct Triangle
+	{
+		float EdgeA[3], EdgeB[3], EdgeC[3]; // Edge functions, positive inside.
+		bool TopLeft[3];                   // Pixels exactly on a top or left edge belong to this triangle.
+		float Depth[3];                    // Window-space depth, 0-1.
+		float InvW[3];                     // 1/w, for perspective correction.
+		float UOverW[3], VOverW[3];
+		int MinX, MinY, MaxX, MaxY;        // Pixel bounding box, clamped to the screen.
+		uint32_t Draw;
+	};
+
+	struct Draw
+	{
+		const SoftwareTexture* Texture1;
+		const SoftwareTexture* Texture2;
+		float Mix;
+	};
+
+	TileWorkers workers;
+	int tilesX, tilesY;
+	uint8_t clear[4];
+	std::vector<float> depth; // Tile by tile, TILE_SIZE * TILE_SIZE floats each.
+	std::vector<Triangle> triangles;
+	std::vector<Draw> draws;
+	std::vector<std::vector<uint32_t>> bins; // Triangle indices per tile, in submission order.
+
+	// Clip against the near plane (the other planes are handled by the screen bounding box and the depth range test),
+	// then set up the resulting one or two triangles.
+	void clipAndSetup(const ClipVertex* triangle, uint32_t draw)
+	{
+		ClipVertex polygon[4];
+		int count = 0;
+		for (int k = 0; k < 3; ++k) {
+			const ClipVertex& a = triangle[k];
+			const ClipVertex& b = triangle[(k + 1) % 3];
+			float da = a.Position.z + a.Position.w, db = b.Position.z + b.Position.w; // >= 0 in front of the near plane.
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				float t = da / (da - db);
+				polygon[count].Position = a.Position + (b.Position - a.Position) * t;
+				polygon[count].TexCoord = a.TexCoord + (b.TexCoord - a.TexCoord) * t;
+				count++;
+			}
+		}
+		for (int k = 1; k + 1 < count; ++k)
+			setup(polygon[0], polygon[k], polygon[k + 1], draw);
+	}
+
+	void setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t draw)
+	{
+		const ClipVertex* input[3] = { &v0, &v1, &v2 };
+		float x[3], y[3];
+		Triangle triangle;
+		for (int k = 0; k < 3; ++k) {
+			const glm::vec4& p = input[k]->Position;
+			float invW = 1.0f / p.w;
+			x[k] = (p.x * invW * 0.5f + 0.5f) * (float)Width; // Viewport transform; pixel centers are at +0.5.
+			y[k] = (p.y * invW * 0.5f + 0.5f) * (float)Height;
+			triangle.Depth[k] = p.z * invW * 0.5f + 0.5f;
+			triangle.InvW[k] = invW;
+			triangle.UOverW[k] = input[k]->TexCoord.x * invW;
+			triangle.VOverW[k] = input[k]->TexCoord.y * invW;
+		}
+
+		// No face culling (the GL path doesn't enable it): make every triangle counter-clockwise instead.
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0.0f || area != area)
+			return;
+		if (area < 0.0f) {
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(triangle.Depth[1], triangle.Depth[2]);
+			std::swap(triangle.InvW[1], triangle.InvW[2]);
+			std::swap(triangle.UOverW[1], triangle.UOverW[2]);
+			std::swap(triangle.VOverW[1], triangle.VOverW[2]);
+			area = -area;
+		}
+
+		// Edge k is opposite vertex k and evaluates to `area` there, so edge / area is that vertex's barycentric weight.
+		for (int k = 0; k < 3; ++k) {
+			int a = (k + 1) % 3, b = (k + 2) % 3;
+			float dx = x[b] - x[a], dy = y[b] - y[a];
+			triangle.EdgeA[k] = -dy / area;
+			triangle.EdgeB[k] = dx / area;
+			triangle.EdgeC[k] = (dy * x[a] - dx * y[a]) / area;
+			triangle.TopLeft[k] = (dy < 0.0f) || (dy == 0.0f && dx < 0.0f); // Counter-clockwise with y up.
+		}
+
+		triangle.MinX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+		triangle.MinY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+		triangle.MaxX = std::min(Width - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+		triangle.MaxY = std::min(Height - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+		if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+			return;
+		triangle.Draw = draw;
+
+		uint32_t index = (uint32_t)triangles.size();
+		triangles.push_back(triangle);
+		TrianglesBinned++;
+		for (int ty = triangle.MinY / TILE_SIZE; ty <= triangle.MaxY / TILE_SIZE; ++ty) {
+			for (int tx = triangle.MinX / TILE_SIZE; tx <= triangle.MaxX / TILE_SIZE; ++tx) {
+				bins[(size_t)ty * tilesX + tx].push_back(index);
+				TileBinEntries++;
+			}
+		}
+	}
+
+	void rasterizeTile(int tile)
+	{
+		const int originX = (tile % tilesX) * TILE_SIZE, originY = (tile / tilesX) * TILE_SIZE;
+		const int endX = std::min(originX + TILE_SIZE, Width), endY = std::min(originY + TILE_SIZE, Height);
+		float* tileDepth = &depth[(size_t)tile * TILE_SIZE * TILE_SIZE];
+
+		// Clear
+		std::fill(tileDepth, tileDepth + TILE_SIZE * TILE_SIZE, 1.0f);
+		for (int y = originY; y < endY; ++y)
+			for (int x = originX; x < endX; ++x)
+				std::memcpy(&Color[((size_t)y * Width + x) * 4], clear, 4);
+
+		for (uint32_t index : bins[tile])
+			rasterizeTriangle(triangles[index], originX, originY, endX, endY, tileDepth);
+	}
+
+	void rasterizeTriangle(const Triangle& triangle, int originX, int originY, int endX, int endY, float* tileDepth)
+	{
+		const int minX = std::max(triangle.MinX, originX) & ~3; // Groups of 4 pixels, aligned within the tile.
+		const int minY = std::max(triangle.MinY, originY);
+		const int maxX = std::min(triangle.MaxX, endX - 1);
+		const int maxY = std::min(triangle.MaxY, endY - 1);
+		const Draw& draw = draws[triangle.Draw];
+
+		// Attribute planes from the barycentric weights: f(x, y) = sum of weight_k(x, y) * f_k.
+		float depthPlane[3], invWPlane[3], uPlane[3], vPlane[3];
+		for (int p = 0; p < 3; ++p) {
+			const float* edge = (p == 0) ? triangle.EdgeA : (p == 1) ? triangle.EdgeB : triangle.EdgeC;
+			depthPlane[p] = edge[0] * triangle.Depth[0] + edge[1] * triangle.Depth[1] + edge[2] * triangle.Depth[2];
+			invWPlane[p] = edge[0] * triangle.InvW[0] + edge[1] * triangle.InvW[1] + edge[2] * triangle.InvW[2];
+			uPlane[p] = edge[0] * triangle.UOverW[0] + edge[1] * triangle.UOverW[1] + edge[2] * triangle.UOverW[2];
+			vPlane[p] = edge[0] * triangle.VOverW[0] + edge[1] * triangle.VOverW[1] + edge[2] * triangle.VOverW[2];
+		}
+
+		const Float4 zero = splat4(0.0f), one = splat4(1.0f);
+		const Float4 laneOffsets = float4(0.5f, 1.5f, 2.5f, 3.5f); // Pixel centers of the 4 lanes.
+		Float4 edgeA[3], edgeB[3], edgeC[3], topLeft[3];
+		for (int k = 0; k < 3; ++k) {
+			edgeA[k] = splat4(triangle.EdgeA[k]);
+			edgeB[k] = splat4(triangle.EdgeB[k]);
+			edgeC[k] = splat4(triangle.EdgeC[k]);
+			topLeft[k] = maskAll4(triangle.TopLeft[k]);
+		}
+
+		const bool mipmapped = draw.Texture1->Levels.size() > 1 || draw.Texture2->Levels.size() > 1;
+		alignas(16) float laneU[4], laneV[4], laneDudx[4], laneDvdx[4], laneDudy[4], laneDvdy[4];
+		for (int y = minY; y <= maxY; ++y) {
+			const Float4 py = splat4((float)y + 0.5f);
+			float* depthRow = tileDepth + (y - originY) * TILE_SIZE;
+			uint8_t* colorRow = &Color[(size_t)y * Width * 4];
+
+			for (int x = minX; x <= maxX; x += 4) {
+				const Float4 px = splat4((float)x) + laneOffsets;
+
+				// Coverage: inside all three edges, ties broken by the top-left rule so shared edges are drawn once.
+				Float4 covered = (x + 3 < endX) ? maskAll4(true) : less4(px, splat4((float)endX));
+				for (int k = 0; k < 3; ++k) {
+					Float4 w = edgeA[k] * px + edgeB[k] * py + edgeC[k];
+					covered = covered & (greater4(w, zero) | (equal4(w, zero) & topLeft[k]));
+				}
+				if (laneMask4(covered) == 0)
+					continue;
+
+				// Depth test (GL_LESS) against the tile's depth buffer, and the far plane.
+				Float4 z = splat4(depthPlane[0]) * px + splat4(depthPlane[1]) * py + splat4(depthPlane[2]);
+				Float4 stored = load4(depthRow + (x - originX));
+				Float4 pass = covered & less4(z, stored) & lessEqual4(z, one);
+				int lanes = laneMask4(pass);
+				if (lanes == 0)
+					continue;
+				store4(depthRow + (x - originX), select4(pass, z, stored));
+
+				// Perspective-correct texture coordinate, and its screen-space derivatives for the mip level.
+				Float4 q = splat4(invWPlane[0]) * px + splat4(invWPlane[1]) * py + splat4(invWPlane[2]);
+				Float4 u = (splat4(uPlane[0]) * px + splat4(uPlane[1]) * py + splat4(uPlane[2])) / q;
+				Float4 v = (splat4(vPlane[0]) * px + splat4(vPlane[1]) * py + splat4(vPlane[2])) / q;
+				store4(laneU, u);
+				store4(laneV, v);
+
+				if (mipmapped) {
+					// d(U/Q)/dx = (dU/dx - u * dQ/dx) / Q, with U = u/w and Q = 1/w both linear in screen space.
+					store4(laneDudx, (splat4(uPlane[0]) - u * splat4(invWPlane[0])) / q);
+					store4(laneDvdx, (splat4(vPlane[0]) - v * splat4(invWPlane[0])) / q);
+					store4(laneDudy, (splat4(uPlane[1]) - u * splat4(invWPlane[1])) / q);
+					store4(laneDvdy, (splat4(vPlane[1]) - v * splat4(invWPlane[1])) / q);
+				}
+
+				for (int lane = 0; lane < 4; ++lane) {
+					if (!(lanes & (1 << lane)))
+						continue;
+					float a[4], b[4];
+					sampleTexture(*draw.Texture1, laneU[lane], laneV[lane], mipmapped ? textureLod(*draw.Texture1, laneDudx[lane], laneDvdx[lane], laneDudy[lane], laneDvdy[lane]) : 0.0f, a);
+					sampleTexture(*draw.Texture2, laneU[lane], laneV[lane], mipmapped ? textureLod(*draw.Texture2, laneDudx[lane], laneDvdx[lane], laneDudy[lane], laneDvdy[lane]) : 0.0f, b);
+					uint8_t* pixel = colorRow + (size_t)(x + lane) * 4;
+					for (int c = 0; c < 4; ++c)
+						pixel[c] = (uint8_t)(a[c] + (b[c] - a[c]) * draw.Mix + 0.5f);
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+
+
+// Shadow copy of the OpenGL state the render loop changes most often: the bound program, VAO, buffers,
+// 2D textures per texture unit and enable/disable flags. Every call checks the shadow first and only reaches
+// the driver if the state actually changes.
+//
+// The cache only knows about changes made through it. Code that binds things directly (texture loading,
+// buffer uploads, ...) must either restore what it changed or call invalidate() afterwards.
+class GLStateCache
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+	// Counters of calls forwarded to OpenGL and calls skipped because the state was already current.
+	uint64_t Issued;
+	uint64_t Skipped;
+
+	GLStateCache() : Issued(0), Skipped(0)
+	{
+		invalidate();
+	}
+
+	// Forget everything, the next call for each piece of state is always issued.
+	void invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		arrayBuffer = UNKNOWN;
+		uniformBuffer = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+			textures2D[i] = UNKNOWN;
+		capabilities.clear();
+	}
+
+	void useProgram(GLuint id)
+	{
+		if (program == id) {
+			Skipped++;
+			return;
+		}
+		program = id;
+		glUseProgram(id);
+		Issued++;
+	}
+
+	void bindVertexArray(GLuint id)
+	{
+		if (vertexArray == id) {
+			Skipped++;
+			return;
+		}
+		vertexArray = id;
+		glBindVertexArray(id);
+		Issued++;
+	}
+
+	// GL_ARRAY_BUFFER and GL_UNIFORM_BUFFER are shadowed. Everything else (notably GL_ELEMENT_ARRAY_BUFFER, which is
+	// part of the VAO state) is forwarded unconditionally.
+	void bindBuffer(GLenum target, GLuint id)
+	{
+		GLuint* shadow = (target == GL_ARRAY_BUFFER) ? &arrayBuffer : (target == GL_UNIFORM_BUFFER) ? &uniformBuffer : NULL;
+		if (shadow != NULL && *shadow == id) {
+			Skipped++;
+			return;
+		}
+		if (shadow != NULL)
+			*shadow = id;
+		glBindBuffer(target, id);
+		Issued++;
+	}
+
+	void activeTexture(unsigned int unit)
+	{
+		if (activeUnit == unit) {
+			Skipped++;
+			return;
+		}
+		activeUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		Issued++;
+	}
+
+	// Bind a 2D texture to a texture unit. glActiveTexture is only issued when the binding really changes.
+	void bindTexture2D(unsigned int unit, GLuint id)
+	{
+		if (unit < MAX_TEXTURE_UNITS && textures2D[unit] == id) {
+			Skipped++;
+			return;
+		}
+		activeTexture(unit);
+		if (unit < MAX_TEXTURE_UNITS)
+			textures2D[unit] = id;
+		glBindTexture(GL_TEXTURE_2D, id);
+		Issued++;
+	}
+
+	void enable(GLenum capability)
+	{
+		setCapability(capability, true);
+	}
+
+	void disable(GLenum capability)
+	{
+		setCapability(capability, false);
+	}
+
+	void resetCounters()
+	{
+		Issued = 0;
+		Skipped = 0;
+	}
+
+	void printStats() const
+	{
+		std::cout << "GL state calls: " << Issued << " issued, " << Skipped << " skipped" << std::endl;
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu; // Never a valid object name, so the first call is always issued.
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint arrayBuffer;
+	GLuint uniformBuffer;
+	GLuint activeUnit;
+	GLuint textures2D[MAX_TEXTURE_UNITS];
+	std::unordered_map<GLenum, bool> capabilities; // Missing entry = unknown.
+
+	void setCapability(GLenum capability, bool enabled)
+	{
+		std::unordered_map<GLenum, bool>::iterator it = capabilities.find(capability);
+		if (it != capabilities.end() && it->second == enabled) {
+			Skipped++;
+			return;
+		}
+		capabilities[capability] = enabled;
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		Issued++;
+	}
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <iostream>
+#include <vector>
+
+#include "../Dependencies/stb_image.h"
+#include "KTX2.h"
+#include "Mipmap.h"
+
+
+// Pixel format matching the number of channels stb_image returned.
+inline GLenum textureFormat(int nrChannels)
+{
+	return (nrChannels == 4) ? GL_RGBA : (nrChannels == 2) ? GL_RG : (nrChannels == 1) ? GL_RED : GL_RGB;
+}
+
+// Create a new 2D texture with repeat wrapping and the given minifying filter, e.g. GL_LINEAR_MIPMAP_LINEAR or GL_LINEAR.
+// The texture is left bound to GL_TEXTURE_2D on the active texture unit.
+inline unsigned int createTexture(GLint minFilter)
+{
+	unsigned int texture;
+	glGenTextures(1, &texture); // Generate 1 texture and store the resulting identifier in texture.
+	glBindTexture(GL_TEXTURE_2D, texture); // Bind the texture so that all subsequent texture commands will configure the currently bound texture.
+
+	// Texture Wrapping S,T (x, y)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // GL_REPEAT - S
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // GL_REPEAT - T
+
+	// Texture Filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Use linear filtering for magnifying the texture. Mipmaps are not useful here.
+	return texture;
+}
+
+// True if the minifying filter samples mipmaps, i.e. the texture needs a mip chain.
+inline bool usesMipmaps(GLint minFilter)
+{
+	return minFilter != GL_NEAREST && minFilter != GL_LINEAR;
+}
+
+// How the runtime builds mip chains (see Mipmap.h): gamma-correct box filtering, alpha-weighted for images with alpha.
+inline MipOptions textureMipOptions(int nrChannels)
+{
+	MipOptions options;
+	options.Filter = MIP_FILTER_BOX;
+	options.SRGB = true;
+	options.Premultiply = (nrChannels == 2 || nrChannels == 4);
+	return options;
+}
+
+// Upload decoded pixels and their mip chain (levels 1 and up, from generateMipmaps) into the texture bound to
+// GL_TEXTURE_2D, level by level. The texture's max level is set to the last one given, so it is complete even without mipmaps.
+inline void uploadTexture(const unsigned char* data, int width, int height, int nrChannels, const std::vector<MipLevel>& mips)
+{
+	GLenum format = textureFormat(nrChannels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows of RGB images are not always 4-byte aligned.
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data); // Generate a 2D texture image.
+	for (size_t i = 0; i < mips.size(); ++i)
+		glTexImage2D(GL_TEXTURE_2D, (GLint)i + 1, format, mips[i].Width, mips[i].Height, 0, format, GL_UNSIGNED_BYTE, mips[i].Pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.size());
+}
+
+// Loads an image from disk into a new mipmapped 2D texture, on the calling thread.
+// A cooked .ktx2 next to the image (see KTX2.h) is used when there is one and the driver supports its format,
+// otherwise the image is decoded with stb_image and, for mipmap filters, its mip chain is generated on the calling thread.
+// Returns the texture ID. If the image could not be loaded, the texture is left empty and an error is printed.
+// See TextureLoader.h for loading on worker threads.
+inline unsigned int loadTexture(const char* path, GLint minFilter)
+{
+	unsigned int texture = createTexture(minFilter);
+
+	KTX2Image cooked;
+	if (readKTX2(cookedTexturePath(path), cooked) && queryCompressedFormats().supports(cooked.Format)) {
+		uploadCompressedTexture(cooked);
+		return texture;
+	}
+
+	// Load and generate the texture
+	int width, height, nrChannels;
+	stbi_set_flip_vertically_on_load(true); // Tell stb_image.h to flip loaded texture's on the y-axis.
+	unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
+	if (data) { // If the data is not null
+		std::vector<MipLevel> mips;
+		if (usesMipmaps(minFilter))
+			mips = generateMipmaps(data, width, height, nrChannels, textureMipOptions(nrChannels));
+		uploadTexture(data, width, height, nrChannels, mips);
+	}
+	else {
+		std::cout << "Failed to load texture: " << path << std::endl;
+	}
+	stbi_image_free(data); // Free the image memory.
+
+	return texture;
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Dependencies/stb_image.h"
+#include "StateCache.h"
+#include "KTX2.h"
+#include "Mipmap.h"
+#include "Profiler.h"
+#include "Texture.h"
+#include "TextureStreamer.h"
+
+
+// Decodes images on a pool of worker threads and uploads them on the GL thread.
+//
+// load() returns a texture ID right away. Until the image is decoded and uploaded the texture holds a 1x1 grey
+// placeholder, so it can be bound and drawn with immediately. The GL thread calls pump() once per frame (or
+// finish() at startup) to upload whatever the workers have finished. Startup time then scales with the number of
+// cores instead of the sum of all decode times.
+//
+// With a TextureStreamer, workers copy the decoded pixels straight into mapped PBOs and pump() uploads them within
+// the streamer's per-frame byte budget. Without one, pump() uploads every finished image with glTexImage2D.
+// Mip chains are generated by the workers too (Mipmap.h), right after decoding, and uploaded level by level.
+//
+// Cooked .ktx2 files (see KTX2.h) are preferred over the image when the driver supports their format. Workers only read
+// them, and pump() uploads every level with glCompressedTexImage2D; they are small enough to skip the streamer.
+//
+// reload() decodes an image again into an existing texture, e.g. after TextureResidency evicted some of its levels. The
+// texture keeps what it has until the new levels are uploaded, all at once, so reloads don't go through the streamer.
+//
+// stb_image is reentrant except for the vertical flip flag, which workers set with the thread-local variant.
+class TextureLoader
+{
+public:
+	// threads = 0 uses one worker per hardware thread.
+	TextureLoader(unsigned int threads = 0, TextureStreamer* streamer = NULL) : streamer(streamer), stopping(false), pending(0)
+	{
+		compressedFormats = queryCompressedFormats(); // Workers cannot ask GL themselves.
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		for (unsigned int i = 0; i < threads; ++i)
+			workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+	}
+
+	~TextureLoader()
+	{
+		shutdown();
+	}
+
+	// Stop and join the worker threads; queued images that were not decoded yet are dropped.
+	// Call this before cleaning up the streamer, whose mapped PBOs the workers may be writing to.
+	void shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		if (streamer != NULL)
+			streamer->abort(); // Wake up workers waiting for a PBO slot.
+		for (std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+		for (Image& image : decoded)
+			stbi_image_free(image.Pixels);
+		decoded.clear();
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Create the texture with a placeholder and queue the file for decoding. Must be called on the GL thread.
+	unsigned int load(const char* path, GLint minFilter)
+	{
+		unsigned int texture = createTexture(minFilter);
+		const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+		Image image;
+		image.Texture = texture;
+		image.Path = path;
+		image.Mipmapped = usesMipmaps(minFilter);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(image);
+			pending++;
+		}
+		jobReady.notify_one();
+		return texture;
+	}
+
+	// Queue the file for decoding into an existing texture, replacing all of its levels. Must be called on the GL thread.
+	void reload(unsigned int texture, const char* path, GLint minFilter)
+	{
+		Image image;
+		image.Texture = texture;
+		image.Path = path;
+		image.Mipmapped = usesMipmaps(minFilter);
+		image.Reload = true;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(image);
+			pending++;
+		}
+		jobReady.notify_one();
+	}
+
+	// Called on the GL thread, from pump() or finish(), every time a texture has received all of its levels (loaded = true)
+	// or failed to load (loaded = false). The texture is bound to GL_TEXTURE_2D during the call.
+	void setUploadCallback(const std::function<void(unsigned int texture, bool loaded)>& callback)
+	{
+		uploadCallback = callback;
+	}
+
+	// Upload every image the workers have finished (within the streamer's budget, if there is one).
+	// Must be called on the GL thread. Returns the number of textures completed.
+	// Uploading binds textures, so if anything was uploaded the given state cache is invalidated.
+	unsigned int pump(GLStateCache* state = NULL)
+	{
+		REGL_PROFILE_ZONE("TextureLoader::pump");
+		std::deque<Image> finished;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.swap(decoded);
+		}
+		for (Image& image : finished)
+			upload(image);
+
+		unsigned int completed = (unsigned int)finished.size();
+		bool touchedBindings = !finished.empty();
+		if (streamer != NULL) {
+			unsigned int bandsBefore = streamer->BandsUploaded;
+			std::vector<GLuint> streamedTextures;
+			unsigned int streamed = streamer->update(&streamedTextures);
+			touchedBindings = touchedBindings || streamer->BandsUploaded != bandsBefore;
+			for (GLuint texture : streamedTextures) {
+				if (uploadCallback) {
+					glBindTexture(GL_TEXTURE_2D, texture);
+					uploadCallback(texture, true);
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			pending -= streamed;
+			completed += streamed;
+		}
+		if (touchedBindings && state != NULL)
+			state->invalidate();
+		return completed;
+	}
+
+	// Block until every queued texture is decoded and uploaded. Must be called on the GL thread.
+	void finish()
+	{
+		if (streamer != NULL) {
+			while (pendingCount() > 0) {
+				pump();
+				streamer->waitForBands(1); // Also wakes up now and then for images that failed to decode.
+			}
+			return;
+		}
+		while (true) {
+			std::deque<Image> finished;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				imageDecoded.wait(lock, [this] { return !decoded.empty() || pending == 0; });
+				if (decoded.empty())
+					return;
+				finished.swap(decoded);
+			}
+			for (Image& image : finished)
+				upload(image);
+		}
+	}
+
+	// Number of textures queued but not yet uploaded.
+	unsigned int pendingCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pending;
+	}
+
+private:
+	struct Image
+	{
+		unsigned int Texture = 0;
+		std::string Path;
+		unsigned char* Pixels = NULL;
+		int Width = 0, Height = 0, Channels = 0;
+		bool Mipmapped = false;
+		bool Reload = false;        // Into a texture that already has content: upload all at once, bypassing the streamer.
+		std::vector<MipLevel> Mips; // Levels 1 and up of Pixels.
+		KTX2Image Cooked; // Used instead of Pixels when it has levels.
+	};
+
+	TextureStreamer* streamer;
+	CompressedFormats compressedFormats;
+	std::vector<std::thread> workers;
+	std::function<void(unsigned int texture, bool loaded)> uploadCallback;
+	std::mutex mutex;
+	std::condition_variable jobReady;     // Signaled when a job is queued or the loader is shutting down.
+	std::condition_variable imageDecoded; // Signaled when a worker finished a job.
+	std::deque<Image> jobs;               // Waiting to be decoded.
+	std::deque<Image> decoded;            // Decoded, waiting to be uploaded.
+	bool stopping;
+	unsigned int pending;                 // Queued but not yet uploaded (jobs + in flight + decoded).
+
+	void workerLoop()
+	{
+		REGL_PROFILE_THREAD("TextureLoader");
+		stbi_set_flip_vertically_on_load_thread(true); // Tell stb_image.h to flip loaded texture's on the y-axis, for this thread only.
+		while (true) {
+			Image image;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping)
+					return;
+				image = jobs.front();
+				jobs.pop_front();
+			}
+
+			{
+				REGL_PROFILE_ZONE("Decode");
+				if (!readKTX2(cookedTexturePath(image.Path), image.Cooked) || !compressedFormats.supports(image.Cooked.Format)) {
+					image.Cooked.Levels.clear();
+					image.Pixels = stbi_load(image.Path.c_str(), &image.Width, &image.Height, &image.Channels, 0);
+				}
+			}
+
+			if (image.Pixels && image.Mipmapped) {
+				REGL_PROFILE_ZONE("Mipmaps");
+				image.Mips = generateMipmaps(image.Pixels, image.Width, image.Height, image.Channels, textureMipOptions(image.Channels));
+			}
+
+			// Streamed images are finished by the streamer; pixels it cannot take go through the direct upload below.
+			if (image.Pixels && streamer != NULL && !image.Reload) {
+				REGL_PROFILE_ZONE("Stream");
+				if (streamer->stream(image.Texture, image.Pixels, image.Width, image.Height, image.Channels, image.Mips)) {
+					stbi_image_free(image.Pixels);
+					continue;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				decoded.push_back(std::move(image)); // Moved: the mip chain can be megabytes.
+			}
+			imageDecoded.notify_all();
+		}
+	}
+
+	void upload(Image& image)
+	{
+		glBindTexture(GL_TEXTURE_2D, image.Texture);
+		bool loaded = true;
+		if (!image.Cooked.Levels.empty()) {
+			uploadCompressedTexture(image.Cooked);
+		}
+		else if (image.Pixels) {
+			uploadTexture(image.Pixels, image.Width, image.Height, image.Channels, image.Mips);
+			stbi_image_free(image.Pixels); // Free the image memory.
+		}
+		else {
+			std::cout << "Failed to load texture: " << image.Path << std::endl; // The placeholder stays.
+			loaded = false;
+		}
+		if (loaded && image.Reload)
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0); // Every level is back.
+		if (uploadCallback)
+			uploadCallback(image.Texture, loaded);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		pending--;
+	}
+};
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "StateCache.h"
+#include "TextureLoader.h"
+
+
+// Keeps the textures loaded through it under a VRAM budget, evicting mip levels of the least recently used ones.
+//
+//   TextureResidency residency(textureLoader, 256 << 20);
+//   unsigned int texture = residency.load("Textures/wall.jpg", GL_LINEAR_MIPMAP_LINEAR);
+//   ...every frame:
+//   textureLoader.pump(&glState);
+//   residency.update(&glState);
+//   glState.bindTexture2D(0, residency.use(texture)); // Marks the texture as used this frame.
+//
+// The size of every level is measured from the driver once a texture is uploaded. When the resident total is over the
+// budget, update() drops the finest level of the texture that has gone unused the longest, then the next, and so on:
+// GL_TEXTURE_BASE_LEVEL moves past the level so it is no longer sampled, and the level is redefined as 1x1 so the driver
+// releases its memory. The texture ID never changes and it keeps sampling its coarser levels, just blurrier.
+// Levels at or below TEXTURE_RESIDENCY_MIN_SIZE are never evicted, so every texture always has something to show.
+//
+// A texture used while some of its levels are evicted is reloaded through the TextureLoader (re-decoded from disk),
+// as long as its full size fits in the budget next to the textures used in the same frame. Evicted levels are not kept
+// in system memory.
+const int TEXTURE_RESIDENCY_MIN_SIZE = 64; // Levels this size or smaller (largest side, in texels) are always resident.
+
+class TextureResidency
+{
+public:
+	size_t BudgetBytes;
+
+	// Statistics
+	size_t ResidentBytes;        // Sum of the measured size of every resident level.
+	size_t PeakResidentBytes;
+	unsigned int LevelsEvicted;
+	size_t BytesEvicted;
+	unsigned int StreamIns;      // Reloads that completed.
+	double StreamInMs;           // Total time from reload request to upload, over StreamIns.
+	double MaxStreamInMs;
+
+	TextureResidency(TextureLoader& loader, size_t budgetBytes)
+		: BudgetBytes(budgetBytes), ResidentBytes(0), PeakResidentBytes(0), LevelsEvicted(0), BytesEvicted(0), StreamIns(0),
+		StreamInMs(0.0), MaxStreamInMs(0.0), loader(loader), frame(1)
+	{
+		loader.setUploadCallback([this](unsigned int texture, bool loaded) { uploaded(texture, loaded); });
+	}
+
+	~TextureResidency()
+	{
+		loader.setUploadCallback(std::function<void(unsigned int, bool)>());
+	}
+
+	TextureResidency(const TextureResidency&) = delete;
+	TextureResidency& operator=(const TextureResidency&) = delete;
+
+	// Load a texture through the loader and manage its residency. Returns its ID. Must be called on the GL thread.
+	unsigned int load(const char* path, GLint minFilter)
+	{
+		unsigned int texture = loader.load(path, minFilter);
+		Entry& entry = entries[texture];
+		entry.Path = path;
+		entry.MinFilter = minFilter;
+		entry.Loading = true;
+		entry.RequestTime = std::chrono::steady_clock::now();
+		return texture;
+	}
+
+	// Mark the texture as used in the current frame. Returns it, for binding.
+	unsigned int use(unsigned int texture)
+	{
+		std::unordered_map<unsigned int, Entry>::iterator it = entries.find(texture);
+		if (it != entries.end())
+			it->second.LastUsed = frame;
+		return texture;
+	}
+
+	// Once per frame, after TextureLoader::pump(): reload the evicted textures used since the last update if they fit,
+	// then evict until the budget holds. Binds textures, so the state cache is invalidated if anything changed.
+	void update(GLStateCache* state = NULL)
+	{
+		bool touchedBindings = false;
+
+		// Textures used this frame can't be evicted to make room, the others can.
+		size_t usedBytes = 0;
+		for (std::pair<const unsigned int, Entry>& item : entries)
+			if (item.second.LastUsed == frame)
+				usedBytes += item.second.residentBytes();
+
+		for (std::pair<const unsigned int, Entry>& item : entries) {
+			Entry& entry = item.second;
+			if (entry.LastUsed != frame || entry.Loading || entry.Failed || entry.TopLevel == 0)
+				continue;
+			size_t missing = entry.fullBytes() - entry.residentBytes();
+			if (usedBytes + missing > BudgetBytes)
+				continue; // Would be evicted again right away; keep it blurry.
+			usedBytes += missing;
+			entry.Loading = true;
+			entry.RequestTime = std::chrono::steady_clock::now();
+			loader.reload(item.first, entry.Path.c_str(), entry.MinFilter);
+		}
+
+		while (ResidentBytes > BudgetBytes) {
+			unsigned int victim = 0;
+			Entry* oldest = NULL;
+			for (std::pair<const unsigned int, Entry>& item : entries) {
+				Entry& entry = item.second;
+				if (entry.LastUsed == frame || entry.Loading || !entry.canEvict())
+					continue;
+				if (oldest == NULL || entry.LastUsed < oldest->LastUsed
+					|| (entry.LastUsed == oldest->LastUsed && entry.residentBytes() > oldest->residentBytes())) {
+					oldest = &entry;
+					victim = item.first;
+				}
+			}
+			if (oldest == NULL)
+				break; // Everything left is in use or at its minimum; over budget until something goes unused.
+			evictLevel(victim, *oldest);
+			touchedBindings = true;
+		}
+
+		if (touchedBindings && state != NULL)
+			state->invalidate();
+		frame++;
+	}
+
+	// Bytes of every level of the texture, and of the levels currently resident. 0 until it is uploaded.
+	size_t fullBytes(unsigned int texture) const
+	{
+		std::unordered_map<unsigned int, Entry>::const_iterator it = entries.find(texture);
+		return (it == entries.end()) ? 0 : it->second.fullBytes();
+	}
+
+	size_t residentBytes(unsigned int texture) const
+	{
+		std::unordered_map<unsigned int, Entry>::const_iterator it = entries.find(texture);
+		return (it == entries.end()) ? 0 : it->second.residentBytes();
+	}
+
+	// Finest level the texture can sample right now (0 when nothing is evicted).
+	int topLevel(unsigned int texture) const
+	{
+		std::unordered_map<unsigned int, Entry>::const_iterator it = entries.find(texture);
+		return (it == entries.end()) ? 0 : it->second.TopLevel;
+	}
+
+	void printStats() const
+	{
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Texture residency: " << entries.size() << " textures, " << ResidentBytes / 1024 << " KiB resident"
+			<< " (peak " << PeakResidentBytes / 1024 << " KiB, budget " << BudgetBytes / 1024 << " KiB), "
+			<< LevelsEvicted << " levels evicted (" << BytesEvicted / 1024 << " KiB), "
+			<< StreamIns << " stream-ins (avg " << (StreamIns ? StreamInMs / StreamIns : 0.0) << "ms, max " << MaxStreamInMs << "ms)"
+			<< std::endl;
+	}
+
+	// De-allocate every texture. The loader must not be uploading anymore (shut it down first).
+	// Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		for (std::pair<const unsigned int, Entry>& item : entries)
+			glDeleteTextures(1, &item.first);
+		entries.clear();
+		ResidentBytes = 0;
+	}
+
+private:
+	struct Entry
+	{
+		std::string Path;
+		GLint MinFilter = GL_LINEAR;
+		std::vector<size_t> LevelBytes; // Measured size of every level of the full chain.
+		std::vector<int> LevelSize;     // Largest side of every level.
+		int TopLevel = 0;               // Levels below this one are evicted.
+		uint64_t LastUsed = 0;          // Frame number of the last use().
+		bool Loading = false;           // Load or reload requested, not uploaded yet.
+		bool Failed = false;            // The file could not be loaded; never reloaded.
+		std::chrono::steady_clock::time_point RequestTime;
+
+		size_t fullBytes() const
+		{
+			size_t bytes = 0;
+			for (size_t level : LevelBytes)
+				bytes += level;
+			return bytes;
+		}
+
+		size_t residentBytes() const
+		{
+			size_t bytes = 0;
+			for (size_t level = (size_t)TopLevel; level < LevelBytes.size(); ++level)
+				bytes += LevelBytes[level];
+			return bytes;
+		}
+
+		// The finest resident level can go if it's above the minimum size and isn't the last level.
+		bool canEvict() const
+		{
+			return TopLevel + 1 < (int)LevelBytes.size() && LevelSize[TopLevel] > TEXTURE_RESIDENCY_MIN_SIZE;
+		}
+	};
+
+	TextureLoader& loader;
+	std::unordered_map<unsigned int, Entry> entries;
+	uint64_t frame; // Starts at 1 so that LastUsed = 0 means never used.
+
+	// Upload callback of the loader: the texture is bound and has every level again.
+	void uploaded(unsigned int texture, bool loaded)
+	{
+		std::unordered_map<unsigned int, Entry>::iterator it = entries.find(texture);
+		if (it == entries.end())
+			return; // Not loaded through us.
+		Entry& entry = it->second;
+		bool reload = !entry.LevelBytes.empty();
+		entry.Loading = false;
+		if (!loaded) {
+			entry.Failed = true;
+			return;
+		}
+
+		ResidentBytes -= entry.residentBytes();
+		measureLevels(entry);
+		entry.TopLevel = 0;
+		ResidentBytes += entry.residentBytes();
+		PeakResidentBytes = (ResidentBytes > PeakResidentBytes) ? ResidentBytes : PeakResidentBytes;
+
+		if (reload) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.RequestTime).count();
+			StreamIns++;
+			StreamInMs += ms;
+			MaxStreamInMs = (ms > MaxStreamInMs) ? ms : MaxStreamInMs;
+		}
+	}
+
+	// Ask the driver how big every level of the bound texture is.
+	static void measureLevels(Entry& entry)
+	{
+		GLint maxLevel = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		entry.LevelBytes.clear();
+		entry.LevelSize.clear();
+		for (GLint level = 0; level <= maxLevel && level < 32; ++level) {
+			GLint width = 0, height = 0, compressed = GL_FALSE;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+			if (width == 0 || height == 0)
+				break;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+
+			size_t bytes;
+			if (compressed) {
+				GLint size = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+				bytes = (size_t)size;
+			}
+			else {
+				// Bits per channel of the format the driver picked; 3-byte texels are stored as 4.
+				const GLenum sizes[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE };
+				int bits = 0;
+				for (GLenum query : sizes) {
+					GLint channelBits = 0;
+					glGetTexLevelParameteriv(GL_TEXTURE_2D, level, query, &channelBits);
+					bits += channelBits;
+				}
+				size_t texelBytes = (size_t)(bits + 7) / 8;
+				texelBytes = (texelBytes == 3) ? 4 : texelBytes;
+				bytes = (size_t)width * height * texelBytes;
+			}
+			entry.LevelBytes.push_back(bytes);
+			entry.LevelSize.push_back((width > height) ? width : height);
+		}
+	}
+
+	void evictLevel(unsigned int texture, Entry& entry)
+	{
+		int level = entry.TopLevel;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1); // Levels below the base don't count for completeness.
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL); // Releases the level's storage.
+
+		entry.TopLevel = level + 1;
+		ResidentBytes -= entry.LevelBytes[level];
+		BytesEvicted += entry.LevelBytes[level];
+		LevelsEvicted++;
+	}
+};
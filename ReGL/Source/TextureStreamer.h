@@ -0,0 +1,295 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "Texture.h"
+
+
+// Streams decoded pixels into textures through a ring of Pixel Buffer Objects.
+//
+// The GL thread keeps every free PBO mapped (orphaned with GL_MAP_INVALIDATE_BUFFER_BIT, so mapping never waits for
+// the GPU) and hands the pointers to the decode threads. A decode thread copies its image and mip chain into those
+// slots band by band (a band is as many rows as fit in one slot, of one or more levels) and queues them. Each frame,
+// update() unmaps the filled slots and issues glTexSubImage2D from the PBO, which returns without waiting for the copy
+// to finish, until BudgetBytes have been uploaded. The rest waits for the next frame, so a large image never causes a hitch.
+class TextureStreamer
+{
+public:
+	size_t SlotBytes;   // Size of one PBO. One image row must fit in a slot.
+	size_t BudgetBytes; // Maximum bytes handed to glTexSubImage2D per update() (at least one band is always uploaded).
+
+	// Statistics
+	uint64_t BytesUploaded;
+	unsigned int BandsUploaded;
+	unsigned int TexturesCompleted;
+
+	TextureStreamer(size_t slotBytes = 4 << 20, unsigned int slotCount = 4, size_t budgetBytes = 8 << 20)
+		: SlotBytes(slotBytes), BudgetBytes(budgetBytes), BytesUploaded(0), BandsUploaded(0), TexturesCompleted(0), aborted(false),
+		usableSlots(slotCount)
+	{
+		slots.resize(slotCount);
+		for (unsigned int i = 0; i < slotCount; ++i) {
+			glGenBuffers(1, &slots[i].PBO);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[i].PBO);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, SlotBytes, NULL, GL_STREAM_DRAW);
+			slots[i].Mapped = NULL;
+			freeSlots.push_back(i);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glGenFramebuffers(1, &clearFBO);
+		mapFreeSlots();
+	}
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Decode thread: copy an image and its mip chain (levels 1 and up, may be empty) into PBO slots, band by band, waiting
+	// for free slots as needed. The tail of the chain is small, so several levels share a slot.
+	// `pixels` can be freed as soon as this returns. Returns false if the streamer was aborted, or if no slot can be
+	// mapped any more; the caller then uploads directly.
+	bool stream(unsigned int texture, const unsigned char* pixels, int width, int height, int channels, const std::vector<MipLevel>& mips)
+	{
+		if ((size_t)width * channels > SlotBytes)
+			return false; // Row larger than a slot; the caller falls back to a direct upload.
+
+		const int lastLevel = (int)mips.size();
+		int level = 0, y = 0;
+		while (level <= lastLevel) {
+			unsigned int slot;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotMapped.wait(lock, [this] { return aborted || !mappedSlots.empty() || usableSlots == 0; });
+				if (aborted || mappedSlots.empty())
+					return false;
+				slot = mappedSlots.front();
+				mappedSlots.pop_front();
+			}
+
+			Band band;
+			band.Slot = slot;
+			band.Texture = texture;
+			band.Channels = channels;
+			band.LastLevel = lastLevel;
+			size_t used = 0;
+			while (level <= lastLevel) {
+				const unsigned char* data = (level == 0) ? pixels : mips[level - 1].Pixels.data();
+				Piece piece;
+				piece.Level = level;
+				piece.Width = (level == 0) ? width : mips[level - 1].Width;
+				piece.Height = (level == 0) ? height : mips[level - 1].Height;
+				piece.Y = y;
+				piece.Offset = used;
+				const size_t rowBytes = (size_t)piece.Width * channels;
+				piece.Rows = (int)std::min<size_t>((size_t)(piece.Height - y), (SlotBytes - used) / rowBytes);
+				if (piece.Rows < 1)
+					break; // Slot full.
+				std::memcpy(slots[slot].Mapped + used, data + (size_t)y * rowBytes, (size_t)piece.Rows * rowBytes); // Straight into GPU-visible memory.
+				band.Pieces.push_back(piece);
+				used += (size_t)piece.Rows * rowBytes;
+				y += piece.Rows;
+				if (y == piece.Height) {
+					level++;
+					y = 0;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				filled.push_back(band);
+			}
+			bandFilled.notify_all();
+		}
+		return true;
+	}
+
+	// GL thread, once per frame: upload filled bands within the budget and re-map the slots they used.
+	// Returns the number of textures that received their last band in this call, and adds them to `completedTextures`.
+	unsigned int update(std::vector<GLuint>* completedTextures = NULL)
+	{
+		unsigned int completed = 0;
+		size_t uploaded = 0;
+		while (uploaded == 0 || uploaded < BudgetBytes) {
+			Band band;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (filled.empty())
+					break;
+				band = filled.front();
+				filled.pop_front();
+			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[band.Slot].PBO);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			slots[band.Slot].Mapped = NULL;
+
+			GLenum format = textureFormat(band.Channels);
+			glBindTexture(GL_TEXTURE_2D, band.Texture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (const Piece& piece : band.Pieces) {
+				if (piece.Y == 0)
+					allocate(band, piece, format);
+				glTexSubImage2D(GL_TEXTURE_2D, piece.Level, 0, piece.Y, piece.Width, piece.Rows, format, GL_UNSIGNED_BYTE, (void*)piece.Offset); // Source is the bound PBO.
+
+				if (piece.Level == band.LastLevel && piece.Y + piece.Rows == piece.Height) {
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, band.LastLevel); // Every level is there now.
+					completed++;
+					if (completedTextures != NULL)
+						completedTextures->push_back(band.Texture);
+				}
+
+				size_t bytes = (size_t)piece.Width * band.Channels * piece.Rows;
+				uploaded += bytes;
+				BytesUploaded += bytes;
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			BandsUploaded++;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			freeSlots.push_back(band.Slot);
+		}
+		TexturesCompleted += completed;
+		mapFreeSlots();
+		return completed;
+	}
+
+	// GL thread: wait up to `milliseconds` for a decode thread to fill a band. Returns true if there is one.
+	bool waitForBands(int milliseconds)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return bandFilled.wait_for(lock, std::chrono::milliseconds(milliseconds), [this] { return !filled.empty(); });
+	}
+
+	// Wake up and fail every stream() call, present and future. Used when shutting down.
+	void abort()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			aborted = true;
+		}
+		slotMapped.notify_all();
+	}
+
+	// De-allocate the PBOs. Decode threads must have stopped. Must be called while the GL context is still alive.
+	void cleanup()
+	{
+		abort();
+		for (Slot& slot : slots) {
+			if (slot.Mapped) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.PBO);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+			glDeleteBuffers(1, &slot.PBO);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteFramebuffers(1, &clearFBO);
+		slots.clear();
+	}
+
+private:
+	static const unsigned int UNUSABLE_SLOT = 0xFFFFFFFFu;
+
+	struct Slot
+	{
+		GLuint PBO;
+		unsigned char* Mapped; // Non-null while the slot is mapped (waiting for, or holding, a band).
+	};
+
+	// Rows of one mip level held by a slot.
+	struct Piece
+	{
+		int Level = 0;
+		int Width = 0, Height = 0; // Of the level.
+		int Y = 0, Rows = 0;
+		size_t Offset = 0;         // Byte offset in the slot.
+	};
+
+	struct Band
+	{
+		unsigned int Slot = 0;
+		GLuint Texture = 0;
+		int Channels = 0;
+		int LastLevel = 0;
+		std::vector<Piece> Pieces; // In upload order: level 0 top to bottom, then level 1, ...
+	};
+
+	std::vector<Slot> slots;
+	std::deque<unsigned int> freeSlots;   // Unmapped, owned by the GL thread.
+	std::deque<unsigned int> mappedSlots; // Mapped, waiting for a decode thread.
+	std::deque<Band> filled;              // Filled by a decode thread, waiting for upload.
+	std::mutex mutex;
+	std::condition_variable slotMapped;
+	std::condition_variable bandFilled;
+	bool aborted;
+	unsigned int usableSlots;             // Slots not lost to a failed map.
+	GLuint clearFBO;
+
+	// Map every free slot and hand it to the decode threads.
+	void mapFreeSlots()
+	{
+		std::deque<unsigned int> toMap;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			toMap.swap(freeSlots);
+		}
+		if (toMap.empty())
+			return;
+
+		unsigned int failed = 0;
+		for (unsigned int& slot : toMap) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[slot].PBO);
+			slots[slot].Mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, SlotBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (slots[slot].Mapped == NULL) {
+				// Dropped from the ring for good: no decode thread may copy into it. Without any slot left, stream()
+				// returns false and images go through the direct upload.
+				std::cout << "ERROR::TEXTURE_STREAMER::MAP_FAILED slot " << slot << " (0x" << std::hex << glGetError() << std::dec << ")" << std::endl;
+				slot = UNUSABLE_SLOT;
+				failed++;
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (unsigned int slot : toMap)
+				if (slot != UNUSABLE_SLOT)
+					mappedSlots.push_back(slot);
+			usableSlots -= failed;
+		}
+		slotMapped.notify_all();
+	}
+
+	// First rows of a level: allocate its storage. For level 0 this replaces the placeholder; if more rows are to come,
+	// the rows not uploaded yet are cleared to the placeholder grey and sampling is limited to level 0 until every level exists.
+	void allocate(const Band& band, const Piece& piece, GLenum format)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glTexImage2D(GL_TEXTURE_2D, piece.Level, format, piece.Width, piece.Height, 0, format, GL_UNSIGNED_BYTE, NULL);
+
+		if (piece.Level == 0) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); // Complete with level 0 only, even with a mipmap min filter.
+			if (piece.Rows < piece.Height) {
+				GLint previousFBO = 0;
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, clearFBO);
+				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, band.Texture, 0);
+				const GLfloat grey[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+				glClearBufferfv(GL_COLOR, 0, grey);
+				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFBO);
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[band.Slot].PBO);
+	}
+};
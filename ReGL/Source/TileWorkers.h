@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+
+
+// Runs `count` independent tasks (the screen tiles of the software rasterizer) on a fixed set of threads.
+//
+// Each thread starts on its own contiguous range of tasks, claiming them one at a time with an atomic increment. A
+// thread that finishes its range steals from the other ranges the same way, so tiles that happen to be expensive
+// (lots of triangles, lots of overdraw) don't leave the other threads idle. The calling thread works too.
+//
+// Built on a JobSystem instead, it owns no threads: run() becomes a parallelFor on the system's threads, shared with
+// everything else submitted there.
+class TileWorkers
+{
+public:
+	// threads = 0 uses one thread per hardware thread, the caller included.
+	explicit TileWorkers(unsigned int threads = 0) : jobs(NULL), task(NULL), generation(0), busy(0), stopping(false)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		ranges.reset(new Range[threads]);
+		rangeCount = threads;
+		for (unsigned int i = 1; i < threads; ++i)
+			workers.push_back(std::thread(&TileWorkers::workerLoop, this, i));
+	}
+
+	explicit TileWorkers(JobSystem& jobs) : jobs(&jobs), rangeCount(0), task(NULL), generation(0), busy(0), stopping(false) {}
+
+	~TileWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		started.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	TileWorkers(const TileWorkers&) = delete;
+	TileWorkers& operator=(const TileWorkers&) = delete;
+
+	unsigned int threadCount() const
+	{
+		return jobs != NULL ? jobs->threadCount() : rangeCount;
+	}
+
+	// Call task(i) for every i in [0, count) and return once all of them are done.
+	void run(int count, const std::function<void(int)>& work)
+	{
+		if (jobs != NULL) {
+			jobs->parallelFor(count, 1, work);
+			return;
+		}
+
+		for (unsigned int i = 0; i < rangeCount; ++i) {
+			ranges[i].Next.store((int)((long long)count * i / rangeCount), std::memory_order_relaxed);
+			ranges[i].End = (int)((long long)count * (i + 1) / rangeCount);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &work;
+			generation++;
+			busy = rangeCount - 1;
+		}
+		started.notify_all();
+
+		runTasks(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return busy == 0; });
+		task = NULL;
+	}
+
+private:
+	struct Range
+	{
+		std::atomic<int> Next; // Next task to claim; past End when the range is exhausted.
+		int End;
+		char Padding[56];      // One range per cache line, so claiming doesn't bounce lines between threads.
+	};
+
+	JobSystem* jobs; // Runs the tasks instead of the threads below, if set.
+	std::vector<std::thread> workers;
+	std::unique_ptr<Range[]> ranges;
+	unsigned int rangeCount;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	const std::function<void(int)>* task;
+	unsigned long long generation; // Bumped by every run(), so workers can tell a new batch from a spurious wake-up.
+	unsigned int busy;             // Workers (not counting the caller) still in the current batch.
+	bool stopping;
+
+	// Own range first, then steal from the others in order.
+	void runTasks(unsigned int self)
+	{
+		for (unsigned int k = 0; k < rangeCount; ++k) {
+			Range& range = ranges[(self + k) % rangeCount];
+			while (true) {
+				int i = range.Next.fetch_add(1, std::memory_order_relaxed);
+				if (i >= range.End)
+					break;
+				(*task)(i);
+			}
+		}
+	}
+
+	void workerLoop(unsigned int self)
+	{
+		unsigned long long seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				started.wait(lock, [this, seen] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+
+			runTasks(self);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0)
+				finished.notify_one();
+		}
+	}
+};